@@ -95,7 +95,8 @@ def add_args_general(parser):
                         action='store_true', default=False)
     parser.add_argument('-p', required=False, metavar='<num>', type=int, default=1,
                         help='number of parallel Qemu instances.')
-    parser.add_argument('-v', help='enable verbose logging to $work_dir/debug.log.',
+    parser.add_argument('-v', help='enable verbose logging to $work_dir/debug.log\n'
+                        'and binary Qemu logs to $work_dir/qemu_binlog_<n>.',
                         action='store_true', default=False)
     parser.add_argument('-h', '--help', action='help',
                         help='show this help message and exit'
@@ -125,8 +126,14 @@ def add_args_fuzzer(parser):
                         action='store_true', default=False)
     parser.add_argument('-hammer_jmp_tables', required=False, help='enable Redqueen jump table hammering (?)',
                         action='store_true', default=False)
-    parser.add_argument('-cpu_affinity', metavar='<n>', help="limit processes to first n cores.",
-                        type=int, required=False)
+    parser.add_argument('-distill', metavar='<secs>', help='every <secs>, stop scheduling nodes not needed to\n'
+                        'keep the corpus coverage (min-set by exec time x size)', type=int, default=0)
+    parser.add_argument('-cpu_affinity', metavar='<n>', help="pin slaves and Qemu vCPUs to CPU pairs by "
+                        "SMT/NUMA topology, using the first n CPUs (0 = all).", type=int, required=False)
+    parser.add_argument('-standby', metavar='<n>', help="keep up to n pre-booted Qemu instances per slave to\n"
+                        "replace a crashed one, as needed by the crash rate (0 = off)", type=int, default=0)
+    parser.add_argument('-template', required=False, help='boot once and launch all Qemu instances from a shared\n'
+                        'copy-on-write snapshot of the guest RAM (-vm_dir only)', action='store_true', default=False)
     parser.add_argument('-tui', required=False, help='enable TUI based monitor',
                         action='store_true', default=False)
 
@@ -181,6 +188,12 @@ def add_args_qemu(parser):
                         action='store_true', default=False)
     parser.add_argument('-graphic', required=False, help='graphic mode via X11 forwarding',
                         action='store_true', default=False)
+    parser.add_argument('-trace_pt', required=False, help='archive raw PT traces to $work_dir/pt_trace_dump_<n>\n'
+                        'and dump traces of funky inputs to $work_dir/traces/',
+                        action='store_true', default=False)
+    parser.add_argument('-hugepages', required=False, help='back bitmaps and payload buffers with 2MB huge pages\n'
+                        '(hugetlb pool or hugetlbfs mount, falls back to regular pages)',
+                        action='store_true', default=False)
 
 
 
@@ -269,9 +282,14 @@ class UserPrepareConfiguration(six.with_metaclass(Singleton)):
         parser.add_argument('mode', metavar='<Mode>', choices=modes, help=modes_help)
         parser.add_argument('-args', metavar='<args>', help='define target arguments.', default="", type=str)
         parser.add_argument('-file', metavar='<file>', help='write payload to file instead of stdin.', default="", type=str)
+        parser.add_argument('--memfd', help='serve the -file payload from memory by intercepting open() of its path.',
+                            action='store_true', default=False)
         parser.add_argument('--recompile', help='recompile all agents.', action='store_true', default=False)
         parser.add_argument('-m', metavar='<memlimit>', help='set memory limit [MB] (default 50 MB).', default=50, type=int)
         parser.add_argument('--asan', help='disables memlimit (required for ASAN binaries)', action='store_true', default=False)
+        parser.add_argument('-persistent', metavar='<iterations>', help='persistent mode: run this many inputs per forked '
+                                                                       'target process, reusing its state (0 = off)',
+                            type=int, required=False, default=0)
 
         self.argument_values = vars(parser.parse_args())
 
@@ -0,0 +1,204 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+CPU and NUMA placement of the Master, Slaves and their Qemu instances.
+
+Each Slave and its Qemu vCPU thread hand control back and forth, so they
+are pinned to a pair of logical CPUs that share caches: the two SMT threads
+of one core, or two cores of the same NUMA node without SMT. Pairs are
+handed out round-robin over the NUMA nodes, and Slave and Qemu allocate
+their memory, including the shared regions, from the node of their pair.
+The Master runs on the CPUs left over, or on all permitted CPUs if there
+are none.
+
+The topology is read from /sys/devices/system. Placement is deterministic,
+so the Master, Slaves and Qemu wrapper compute the same layout on their own.
+"""
+
+import collections
+import ctypes
+import glob
+import os
+
+from common.debug import log_debug
+
+SYSFS = "/sys/devices/system"
+
+# x86_64 syscall number and policy, not exported by the os module
+SYS_SET_MEMPOLICY = 238
+MPOL_PREFERRED = 1
+
+Slot = collections.namedtuple("Slot", ["slave_cpu", "qemu_cpu", "node"])
+
+
+def parse_cpulist(text):
+    """ Parse a sysfs CPU list such as "0-3,8,10-11" """
+    cpus = set()
+    for part in text.strip().split(","):
+        if not part:
+            continue
+        if "-" in part:
+            start, end = part.split("-")
+            cpus.update(range(int(start), int(end) + 1))
+        else:
+            cpus.add(int(part))
+    return cpus
+
+
+def read_file(path, default=None):
+    try:
+        with open(path) as f:
+            return f.read()
+    except OSError:
+        return default
+
+
+class CpuTopology:
+    """ Online logical CPUs with their NUMA node and physical core """
+
+    def __init__(self, sysfs=SYSFS):
+        self.cpus = sorted(parse_cpulist(read_file(sysfs + "/cpu/online", "0")))
+        self.node = dict()
+        self.core = dict()
+
+        for path in glob.glob(sysfs + "/node/node[0-9]*"):
+            node = int(path.rsplit("node", 1)[-1])
+            for cpu in parse_cpulist(read_file(path + "/cpulist", "")):
+                self.node[cpu] = node
+
+        for cpu in self.cpus:
+            self.node.setdefault(cpu, 0)
+            topology = sysfs + "/cpu/cpu%d/topology/" % cpu
+            package = int(read_file(topology + "physical_package_id", "0"))
+            core = int(read_file(topology + "core_id", str(cpu)))
+            self.core[cpu] = (package, core)
+
+
+class Placement:
+
+    def __init__(self, topology, num_slaves, num_cpus=0, allowed=None):
+        cpus = [cpu for cpu in topology.cpus if allowed is None or cpu in allowed]
+        if num_cpus:
+            cpus = cpus[:num_cpus]
+        self.cpus = set(cpus)
+
+        # logical CPUs per node and physical core, in CPU order
+        nodes = collections.OrderedDict()
+        for cpu in cpus:
+            cores = nodes.setdefault(topology.node[cpu], collections.OrderedDict())
+            cores.setdefault(topology.core[cpu], []).append(cpu)
+
+        pairs_by_node = list()
+        spare = list()
+        for node, cores in sorted(nodes.items()):
+            pairs = list()
+            singles = list()
+            for threads in cores.values():
+                if len(threads) >= 2:
+                    pairs.append((threads[0], threads[1], node))
+                    spare.extend(threads[2:])
+                else:
+                    singles.extend(threads)
+            while len(singles) >= 2:
+                pairs.append((singles.pop(0), singles.pop(0), node))
+            spare.extend(singles)
+            pairs_by_node.append(pairs)
+
+        # interleave nodes, so that Slaves use all memory controllers
+        pairs = list()
+        for i in range(max([len(p) for p in pairs_by_node] + [0])):
+            pairs.extend(p[i] for p in pairs_by_node if i < len(p))
+
+        if not pairs:
+            # a single CPU, everyone shares it
+            pairs = [(cpus[0], cpus[0], topology.node[cpus[0]])]
+        if num_slaves > len(pairs):
+            log_debug("Placement: %d Slaves on %d CPU pairs, pairs are shared" % (num_slaves, len(pairs)))
+
+        self.slots = [Slot(*pairs[i % len(pairs)]) for i in range(num_slaves)]
+
+        used = set(cpu for slot in self.slots for cpu in slot[:2])
+        self.master_cpus = set(spare) | (self.cpus - used)
+        if not self.master_cpus:
+            self.master_cpus = set(self.cpus)
+
+    def slot(self, slave_id):
+        return self.slots[slave_id] if 0 <= slave_id < len(self.slots) else None
+
+    def describe(self):
+        lines = ["Master: CPUs %s" % ",".join(str(c) for c in sorted(self.master_cpus))]
+        for i, slot in enumerate(self.slots):
+            lines.append("Slave %d: CPU %d, Qemu vCPU %d, node %d" % (i, slot.slave_cpu, slot.qemu_cpu, slot.node))
+        return lines
+
+
+__placement = None
+
+
+def from_config(config):
+    """ Placement for this campaign, or None unless enabled with -cpu_affinity """
+    global __placement
+    num_cpus = config.argument_values.get('cpu_affinity', None)
+    if num_cpus is None:
+        return None
+    if not __placement:
+        __placement = Placement(CpuTopology(), config.argument_values['p'], num_cpus,
+                                allowed=os.sched_getaffinity(0))
+    return __placement
+
+
+# resolved at import, prefer_node() runs between fork and exec of Qemu where
+# the dynamic loader is off limits
+__libc = ctypes.CDLL(None, use_errno=True)
+__libc.syscall.restype = ctypes.c_long
+
+
+def __syscall(*args):
+    if __libc.syscall(*[ctypes.c_ulong(a) for a in args]) < 0:
+        err = ctypes.get_errno()
+        raise OSError(err, os.strerror(err))
+
+
+def prefer_node(node):
+    """
+    Allocate new memory of this process from node. The policy is inherited by
+    Qemu, so regions shared by both are node-local whichever touches them first.
+    """
+    mask = ctypes.c_ulong(1 << node)
+    __syscall(SYS_SET_MEMPOLICY, MPOL_PREFERRED, ctypes.addressof(mask), 64)
+
+
+def pin_qemu(pid, slot):
+    """
+    Pin Qemu's vCPU thread to the Qemu CPU of its slot and all other
+    threads to the pair. vCPU threads are only named with -name debug-threads=on.
+    """
+    pinned = 0
+    for task in glob.glob("/proc/%d/task/*" % pid):
+        tid = int(os.path.basename(task))
+        comm = read_file(task + "/comm", "")
+        try:
+            if comm.startswith("CPU ") and "/KVM" in comm:
+                os.sched_setaffinity(tid, {slot.qemu_cpu})
+                pinned += 1
+            else:
+                os.sched_setaffinity(tid, {slot.slave_cpu, slot.qemu_cpu})
+        except OSError:
+            # thread has exited
+            pass
+    return pinned
+
+
+def vcpu_threads(pid):
+    return [int(os.path.basename(task)) for task in glob.glob("/proc/%d/task/*" % pid)
+            if read_file(task + "/comm", "").startswith("CPU ")]
+
+
+def migrations(pid, tid=None):
+    """ Number of times a thread was moved to another CPU (needs CONFIG_SCHED_DEBUG), or 0 """
+    path = "/proc/%d/sched" % pid if tid is None else "/proc/%d/task/%d/sched" % (pid, tid)
+    for line in (read_file(path, "") or "").splitlines():
+        if line.startswith("se.nr_migrations"):
+            return int(line.split(":")[1])
+    return 0
@@ -7,11 +7,12 @@
 Launch Qemu VMs and execute test inputs produced by kAFL-Fuzzer.
 """
 
+import collections
 import ctypes
-import mmap
 import os
 import resource
 import select
+import shutil
 import socket
 import struct
 import subprocess
@@ -21,10 +22,15 @@ from socket import error as socket_error
 import sys
 
 import common.color
+import common.placement as placement
 import common.qemu_protocol as qemu_protocol
+import common.shm as shm
+import common.telemetry as telemetry
+import common.template as template
 from common.debug import log_qemu
 from common.debug import get_log_file
 from common.execution_result import ExecutionResult
+from common.standby import StandbyPool
 from fuzzer.technique.redqueen.workdir import RedqueenWorkdir
 from common.util import read_binary_file, atomic_write, print_fail, strdump
 
@@ -51,6 +57,29 @@ def get_valid_tap(tbase, nbase=0):
     else:
         return None
 
+# Exec timeouts are enforced by Qemu based on a budget derived from recent exec
+# times. The budget is TIMEOUT_TICK_FACTOR x p99 (or the current node's baseline,
+# if slower), clamped to [EXEC_TIMEOUT_MIN, EXEC_TIMEOUT_MAX]. Until enough samples
+# are collected we fall back to EXEC_TIMEOUT_MAX. Every timeout costs a Qemu
+# restart, the floor keeps scheduling jitter of fast targets from causing them.
+EXEC_TIMEOUT_MIN = 0.1
+EXEC_TIMEOUT_MAX = 5.0
+EXEC_TIMEOUT_SLACK = 0.5    # host-side select() backstop on top of the Qemu budget
+EXEC_TIMEOUT_WINDOW = 512   # recent regular execs considered for p99
+EXEC_TIMEOUT_UPDATE = 64    # recompute budget every n execs
+
+# Bitmap and payload are anonymous shared memory (memfd) handed to Qemu as inherited
+# fds. Qemu bumps a generation counter in the page after the bitmap when a run is done.
+BITMAP_TRAILER_SIZE = 0x1000
+PAYLOAD_SHM_SIZE = (128 << 10)
+
+# refresh CPU migration counters in telemetry at most once per interval (seconds)
+PLACEMENT_INTERVAL = 1.0
+
+# state of a running Qemu process, exchanged with a standby instance on adoption
+STANDBY_ATTRS = ("process", "control", "stat_fd", "control_filename", "qemu_serial_log", "qemu_binlog",
+                 "overlay_filename", "kafl_shm_f", "kafl_shm", "fs_shm_f", "fs_shm", "c_bitmap", "bitmap_generation")
+
 def to_string_32(value):
     return [(value >> 24) & 0xff,
             (value >> 16) & 0xff,
@@ -61,7 +90,7 @@ def to_string_32(value):
 class qemu:
     CMDS = qemu_protocol.CMDS
 
-    def __init__(self, qid, config, debug_mode=False, notifiers=True):
+    def __init__(self, qid, config, debug_mode=False, notifiers=True, standby=None, template_export=False):
 
         self.hprintf_print_mode = True
         self.internal_buffer_overflow_counter = 0
@@ -71,6 +100,14 @@ class qemu:
         self.handshake_stage_2 = True
 
         self.debug_mode = debug_mode
+        self.notifiers = notifiers
+        # index of a pre-booted standby instance of slave qid (see common/standby.py), None otherwise
+        self.standby = standby
+        self.standby_pool = None
+        # export_template() instance, or launched from the exported guest RAM template (see common/template.py)
+        self.template_export = template_export
+        self.from_template = (template.enabled(config) and not template_export and
+                              os.path.exists(template.state_filename(config)))
         self.patches_enabled = False
         self.needs_execution_for_patches = False
         self.debug_counter = 0
@@ -84,49 +121,170 @@ class qemu:
         self.control = None
         self.persistent_runs = 0
 
-        project_name = self.config.argument_values['work_dir'].split("/")[-1]
-        self.payload_filename = "/dev/shm/kafl_%s_qemu_payload_%s" % (project_name, self.qemu_id)
-        self.tracedump_filename = "/dev/shm/kafl_%s_pt_trace_dump_%s" % (project_name, self.qemu_id)
+        self.tracedump_filename = self.config.argument_values['work_dir'] + "/pt_trace_dump_" + self.qemu_id
         self.binary_filename = self.config.argument_values['work_dir'] + "/program"
-        self.bitmap_filename = "/dev/shm/kafl_%s_bitmap_%s" % (project_name, self.qemu_id)
 
-        self.control_filename = self.config.argument_values['work_dir'] + "/interface_" + self.qemu_id
+        # files used by one Qemu process, each standby has its own set
+        instance = self.qemu_id if standby is None else "%s_standby%d" % (self.qemu_id, standby)
+        self.control_filename = self.config.argument_values['work_dir'] + "/interface_" + instance
         self.qemu_trace_log = self.config.argument_values['work_dir'] + "/qemu_trace_%s.log" % self.qemu_id
-        self.qemu_serial_log = self.config.argument_values['work_dir'] + "/qemu_serial_%s.log" % self.qemu_id
+        self.qemu_serial_log = self.config.argument_values['work_dir'] + "/qemu_serial_%s.log" % instance
+        self.qemu_binlog = self.config.argument_values['work_dir'] + "/qemu_binlog_%s" % instance
+        self.overlay_filename = None
+        if self.config.argument_values['vm_dir']:
+            self.overlay_filename = self.__overlay(self.config.argument_values['vm_dir'] + "/overlay_" + self.qemu_id + ".qcow2")
+        # disassembler page cache, kept across Qemu restarts of this slave only. Only valid
+        # if each restart resumes the same snapshot - a fresh -kernel/-bios boot may place
+        # kernel code elsewhere (KASLR, module load order)
+        self.page_cache_filename = None
+        if self.config.argument_values['vm_dir'] or self.from_template:
+            self.page_cache_filename = self.config.argument_values['work_dir'] + "/page_cache_%s" % self.qemu_id
+        self.telemetry_filename = telemetry.telemetry_filename(self.config, self.qemu_id)
+        if standby is None and not template_export:
+            if self.page_cache_filename:
+                try:
+                    os.remove(self.page_cache_filename)
+                except FileNotFoundError:
+                    pass
+            telemetry.create_segment(self.telemetry_filename)
+        self.telemetry = None if template_export else telemetry.TelemetryWriter(self.telemetry_filename)
+
+        # CPU pair and NUMA node of this slave, None unless -cpu_affinity is given
+        layout = placement.from_config(self.config)
+        self.slot = layout.slot(int(self.qemu_id)) if layout and not template_export else None
+        # standbys boot on the Master's CPUs and move to the slot on adoption
+        self.standby_cpus = layout.master_cpus if layout else None
+        self.vcpu_migrations = 0
+        self.vcpu_migrations_base = 0
+        self.placement_last = 0
+        self.template_last = 0
+
+        # shared memory outlives Qemu restarts, only the mapping in Qemu is recreated
+        hugepages = self.config.argument_values['hugepages']
+        self.kafl_shm_f, self.kafl_shm, _ = shm.create_memfd("kafl_bitmap_%s" % self.qemu_id,
+                                                             self.bitmap_size + BITMAP_TRAILER_SIZE, hugepages)
+        self.fs_shm_f, self.fs_shm, _ = shm.create_memfd("kafl_payload_%s" % self.qemu_id,
+                                                         PAYLOAD_SHM_SIZE, hugepages)
+        self.c_bitmap = (ctypes.c_uint8 * self.bitmap_size).from_buffer(self.kafl_shm)
+        # device state of the template, read by Qemu with -incoming on each start
+        self.template_fd = None
+        if self.from_template:
+            self.template_fd = os.open(template.state_filename(config), os.O_RDONLY)
+        self.shm_fds = self.__shm_fds()
+        self.bitmap_generation = 0
 
         # self.in_requeen = self.config.argument_values['redqueen']
         self.in_requeen = False
+        # standbys share the slave's workdir: it holds the patches/whitelist written by the slave, and
+        # Qemu only opens its result files (O_APPEND) once it runs, i.e. after adoption
         self.redqueen_workdir = RedqueenWorkdir(self.qemu_id, config)
-        self.redqueen_workdir.init_dir()
+        if standby is None:
+            self.redqueen_workdir.init_dir()
 
         self.exiting = False
         self.start_ticks = 0
         self.end_ticks = 0
         self.tick_timeout_treshold = self.config.config_values["TIMEOUT_TICK_FACTOR"]
 
-        self.cmd = self.config.config_values['QEMU_KAFL_LOCATION']
+        self.exec_times = collections.deque(maxlen=EXEC_TIMEOUT_WINDOW)
+        self.exec_timeout = EXEC_TIMEOUT_MAX
+        self.exec_timeout_baseline = 0
+        self.exec_timeout_sent = None
 
         self.catch_vm_reboots = self.config.argument_values['catch_resets']
 
+        self.crashed = False
+        self.timeout = False
+        self.kasan = False
+        self.shm_problem = False
+        self.initial_mem_usage = 0
+
+        self.stat_fd = None
+
+        self.virgin_bitmap = bytes(self.bitmap_size)
+
+        self.__build_cmd()
+
+        # restarts take over a pre-booted instance where possible
+        max_standby = self.config.argument_values.get('standby', 0)
+        if max_standby and standby is None and not (debug_mode or template_export or
+                                                    self.config.argument_values['trace_pt'] or
+                                                    self.config.argument_values['forkserver'] or
+                                                    self.config.argument_values['gdbserver']):
+            if self.overlay_filename and not self.from_template:
+                # copy while no Qemu of this slave has the overlay open for writing
+                for index in range(max_standby):
+                    shutil.copyfile(self.overlay_filename, self.__standby_overlay(index))
+            self.standby_pool = StandbyPool(self.qemu_id, self.__new_standby, max_standby)
+
+    def __new_standby(self, index):
+        return qemu(self.qemu_id, self.config, self.debug_mode, self.notifiers, standby=index)
+
+    def __overlay(self, overlay):
+        if self.template_export:
+            # any slave's overlay holds the snapshot - reverted to it by -loadvm, then shared
+            # read-only by all instances
+            overlay = self.config.argument_values['vm_dir'] + "/overlay_0.qcow2"
+            shutil.copyfile(overlay, template.overlay_filename(self.config))
+            return template.overlay_filename(self.config)
+        if self.from_template:
+            return template.overlay_filename(self.config)
+        # Qemu locks its disk images, so a standby boots from its own copy of the overlay,
+        # made by the slave's instance before it first starts
+        if self.standby is None:
+            return overlay
+        return self.__standby_overlay(self.standby)
+
+    def __standby_overlay(self, index):
+        return self.config.argument_values['work_dir'] + "/overlay_%s_standby%d.qcow2" % (self.qemu_id, index)
+
+    def __shm_fds(self):
+        fds = [self.kafl_shm_f, self.fs_shm_f]
+        if self.template_fd is not None:
+            fds.append(self.template_fd)
+        return fds
+
+    def __build_cmd(self):
+        self.cmd = self.config.config_values['QEMU_KAFL_LOCATION']
+
         # TODO: list append should work better than string concatenation, especially for str.replace() and later popen()
         self.cmd += " -serial file:" + self.qemu_serial_log + \
                     " -enable-kvm" \
-                    " -m " + str(config.argument_values['mem']) + \
+                    " -m " + str(self.config.argument_values['mem']) + \
                     " -nographic -net none" \
                     " -chardev socket,server,nowait,path=" + self.control_filename + \
                     ",id=kafl_interface" \
                     " -device kafl,chardev=kafl_interface,bitmap_size=" + str(self.bitmap_size) + ",shm0=" + self.binary_filename + \
-                    ",shm1=" + self.payload_filename + \
-                    ",bitmap=" + self.bitmap_filename + \
+                    ",shm1=/proc/self/fd/%d" % self.fs_shm_f + \
+                    ",bitmap=/proc/self/fd/%d" % self.kafl_shm_f + \
                     ",redqueen_workdir=" + self.redqueen_workdir.base_path
 
-        if False:  # do not emit tracefiles on every execution
-            self.cmd += ",dump_pt_trace"
+        if self.template_export:
+            # Qemu exits once the device state is saved
+            self.cmd += ",template=" + template.state_filename(self.config) + ".tmp"
+        else:
+            self.cmd += ",telemetry=" + self.telemetry_filename
+            if self.page_cache_filename:
+                self.cmd += ",page_cache=" + self.page_cache_filename
+
+        if self.standby is not None:
+            # Qemu leaves the slave's telemetry alone until it is adopted
+            self.cmd += ",standby=on"
+
+        if self.config.argument_values['hugepages']:
+            self.cmd += ",hugepages=on"
+
+        if self.config.argument_values['trace_pt']:
+            self.cmd += ",dump_pt_trace=" + self.tracedump_filename
 
         if self.debug_mode:
             self.cmd += ",debug_mode"
 
-        if not notifiers:
+        # binary log is cheap enough to keep on during fuzzing, decode with tools/binlog_decode.py
+        if self.verbose or self.debug_mode:
+            self.cmd += ",binlog=" + self.qemu_binlog
+
+        if not self.notifiers:
             self.cmd += ",crash_notifier=False"
 
         # fast reload is not part of redqueen release
@@ -145,6 +303,10 @@ class qemu:
                 self.cmd += ",ip" + str(i) + "_a=" + range_a + ",ip" + str(i) + "_b=" + range_b
                 #self.cmd += ",filter" + str(i) + "=/dev/shm/kafl_filter" + str(i)
 
+        if self.slot:
+            # name the vCPU threads, so that they can be told apart for pinning
+            self.cmd += " -name kafl_%s,debug-threads=on" % self.qemu_id
+
         if self.debug_mode:
             self.cmd += " -d kafl -D " + self.qemu_trace_log
 
@@ -157,12 +319,29 @@ class qemu:
         if self.config.argument_values['extra']:
             self.cmd += " " + self.config.argument_values['extra']
 
+        # guest RAM in a file shared by the template and mapped copy-on-write by all others,
+        # migration skips it and only carries the device state
+        if self.template_export or self.from_template:
+            self.cmd += " -object memory-backend-file,id=kafl_ram,size=%dM,mem-path=%s,share=%s" % (
+                    self.config.argument_values['mem'], template.ram_filename(self.config),
+                    "on" if self.template_export else "off")
+            self.cmd += " -machine memory-backend=kafl_ram -global migration.x-ignore-shared=true"
+        if self.from_template:
+            self.cmd += " -incoming fd:%d" % self.template_fd
+
         # Lauch either as VM snapshot, direct kernel/initrd boot, or -bios boot
         if self.config.argument_values['vm_dir']:
             assert(self.config.argument_values['vm_ram'])
             self.cmd += " -hdb " + self.config.argument_values['vm_ram']
-            self.cmd += " -hda " + self.config.argument_values['vm_dir'] + "/overlay_" + self.qemu_id + ".qcow2"
-            self.cmd += " -loadvm " + self.config.argument_values["S"]
+            self.cmd += " -hda " + self.overlay_filename
+            if self.from_template:
+                # disk as of the template snapshot, writes are discarded
+                self.cmd += " -snapshot"
+            else:
+                self.cmd += " -loadvm " + self.config.argument_values["S"]
+            if self.template_export:
+                # the snapshot is past HYPERCALL_KAFL_LOCK, Qemu exports once loaded
+                self.cmd += " -S"
         elif self.config.argument_values['kernel']:
             self.cmd += " -kernel " + self.config.argument_values['kernel']
             if self.config.argument_values['initrd']:
@@ -187,27 +366,6 @@ class qemu:
         if self.config.argument_values["graphic"]:
             self.cmd = self.cmd.replace("-nographic", "")
 
-        self.kafl_shm_f = None
-        self.kafl_shm   = None
-        self.fs_shm_f   = None
-        self.fs_shm     = None
-
-        self.payload_shm_f   = None
-        self.payload_shm     = None
-
-        self.bitmap_shm_f   = None
-        self.bitmap_shm     = None
-
-        self.crashed = False
-        self.timeout = False
-        self.kasan = False
-        self.shm_problem = False
-        self.initial_mem_usage = 0
-
-        self.stat_fd = None
-
-        self.virgin_bitmap = bytes(self.bitmap_size)
-
         # split cmd into list of arguments for Popen(), replace BOOTPARAM as single element
         self.cmd = [_f for _f in self.cmd.split(" ") if _f]
         c = 0
@@ -262,6 +420,11 @@ class qemu:
         self.__debug_send(qemu_protocol.ENABLE_TRACE_MODE)
         self.__debug_recv_expect(qemu_protocol.ENABLE_TRACE_MODE)
 
+    def flush_trace_dump(self):
+        """ Make all traces archived so far (-trace_pt) readable from tracedump_filename """
+        self.__debug_send(qemu_protocol.FLUSH_TRACE)
+        self.__debug_recv_expect(qemu_protocol.FLUSH_TRACE)
+
     def send_disable_trace(self):
         self.__debug_send(qemu_protocol.DISABLE_TRACE_MODE)
         self.__debug_recv_expect(qemu_protocol.DISABLE_TRACE_MODE)
@@ -289,9 +452,9 @@ class qemu:
                     info = " (Agent Run)"
                     self.handshake_stage_2 = False
                 try:
-                    log_qemu("[SEND] " + '\033[94m' + self.CMDS[cmd] + info + '\033[0m', self.qemu_id)
+                    log_qemu("[SEND] " + '\033[94m' + self.CMDS[cmd[:1]] + info + '\033[0m', self.qemu_id)
                 except:
-                    log_qemu("[SEND] " + "unknown cmd '" + res + "'", self.qemu_id)
+                    log_qemu("[SEND] " + "unknown cmd '" + repr(cmd) + "'", self.qemu_id)
         try:
             self.control.send(cmd)
         except (BrokenPipeError, OSError):
@@ -406,19 +569,30 @@ class qemu:
             sys.exit(0)
 
         self.exiting = True
+        if self.standby_pool:
+            self.standby_pool.close()
         self.shutdown()
 
         for tmp_file in [
-                self.payload_filename,
-                self.tracedump_filename,
                 self.control_filename,
-                self.binary_filename,
-                self.bitmap_filename]:
+                self.binary_filename]:
             try:
                 os.remove(tmp_file)
             except:
                 pass
 
+        for region in [self.kafl_shm, self.fs_shm]:
+            try:
+                region.close()
+            except:
+                pass
+
+        for shm_f in self.shm_fds:
+            try:
+                os.close(shm_f)
+            except:
+                pass
+
     def shutdown(self):
         log_qemu("Shutting down Qemu after %d execs.." % self.persistent_runs, self.qemu_id)
 
@@ -451,26 +625,6 @@ class qemu:
         log_qemu(header + serial_out + footer, self.qemu_id)
 
 
-        try:
-            self.kafl_shm.close()
-        except:
-            pass
-
-        try:
-            self.fs_shm.close()
-        except:
-            pass
-
-        try:
-            os.close(self.kafl_shm_f)
-        except:
-            pass
-
-        try:
-            os.close(self.fs_shm_f)
-        except:
-            pass
-
         try:
             if self.stat_fd:
                 self.stat_fd.close()
@@ -498,23 +652,31 @@ class qemu:
             log_qemu("Launching virtual machine...", self.qemu_id)
 
         self.persistent_runs = 0
+        # new Qemu instance, budget needs to be sent again
+        self.exec_timeout_sent = None
         # Have not received+send first RELEASE (init handshake)
         self.handshake_stage_1 = True
         # Have not received first ACQUIRE (ready for payload execution)
         self.handshake_stage_2 = True
 
+        # each -incoming reads the template state from the start
+        if self.template_fd is not None:
+            os.lseek(self.template_fd, 0, os.SEEK_SET)
+
         # Launch Qemu. stderr to stdout, stdout is logged on VM exit
         # os.setpgrp() prevents signals from being propagated to Qemu, instead allowing an
         # organized shutdown via async_exit()
         if self.verbose:
             self.process = subprocess.Popen(self.cmd,
-                    preexec_fn=os.setpgrp,
+                    preexec_fn=self.__preexec,
+                    pass_fds=self.shm_fds,
                     stdin=subprocess.PIPE,
                     stdout=get_log_file(),
                     stderr=get_log_file())
         else:
             self.process = subprocess.Popen(self.cmd,
-                    preexec_fn=os.setpgrp,
+                    preexec_fn=self.__preexec,
+                    pass_fds=self.shm_fds,
                     stdin=subprocess.PIPE,
                     stdout=subprocess.PIPE,
                     stderr=subprocess.STDOUT)
@@ -523,6 +685,7 @@ class qemu:
             self.stat_fd = open("/proc/" + str(self.process.pid) + "/stat")
             self.init()
             self.set_init_state()
+            self.__pin_vcpu()
         except:
             if not self.exiting:
                 debug_error("Failed to launch Qemu, please see logs.")
@@ -533,8 +696,88 @@ class qemu:
         self.initial_mem_usage = resource.getrusage(resource.RUSAGE_SELF).ru_maxrss
         self.kafl_shm.seek(0x0)
         self.kafl_shm.write(self.virgin_bitmap)
-        self.kafl_shm.flush()
+        self.bitmap_generation = self.__bitmap_generation()
+
+        return True
+
+    def __preexec(self):
+        os.setpgrp()
+        if self.slot:
+            # until the vCPU thread is known, Qemu shares the pair with its slave
+            if self.standby is None:
+                os.sched_setaffinity(0, {self.slot.slave_cpu, self.slot.qemu_cpu})
+            else:
+                os.sched_setaffinity(0, self.standby_cpus)
+            try:
+                placement.prefer_node(self.slot.node)
+            except OSError:
+                pass
+
+    def __pin_vcpu(self):
+        # vCPU threads are created during machine init, i.e. before the handshake
+        if not self.slot or self.standby is not None:
+            # standbys stay off the slave's CPU pair until adopted
+            return
+        self.vcpu_migrations_base += self.vcpu_migrations
+        self.vcpu_migrations = 0
+        if not placement.pin_qemu(self.process.pid, self.slot):
+            log_qemu("No vCPU thread found, Qemu is only pinned to its CPU pair", self.qemu_id)
+        self.__update_placement(force=True)
+
+    def __update_placement(self, force=False):
+        cur_time = time.time()
+        if not force and cur_time - self.placement_last < PLACEMENT_INTERVAL:
+            return
+        self.placement_last = cur_time
+        pid = self.process.pid
+        self.vcpu_migrations = sum(placement.migrations(pid, tid) for tid in placement.vcpu_threads(pid))
+        self.telemetry.placement(self.slot, placement.migrations(os.getpid()),
+                                 self.vcpu_migrations_base + self.vcpu_migrations)
+
+    def __update_template(self):
+        cur_time = time.time()
+        if not self.from_template or cur_time - self.template_last < template.STATS_INTERVAL:
+            return
+        self.template_last = cur_time
+        sharing = template.sharing(self.process.pid, template.ram_filename(self.config))
+        if sharing:
+            self.telemetry.template(sharing)
+
+    # Boot up to the snapshot point and save the device state for all other instances
+    def export_template(self):
+        state_filename = template.state_filename(self.config)
+        for tmp_file in [state_filename, state_filename + ".tmp", template.ram_filename(self.config)]:
+            try:
+                os.remove(tmp_file)
+            except FileNotFoundError:
+                pass
+
+        if self.config.argument_values['agent']:
+            self.__set_agent()
+
+        log_qemu("Exporting guest RAM template...CMD:\n" + ' '.join(self.cmd), self.qemu_id)
+        start_time = time.time()
+        self.process = subprocess.Popen(self.cmd,
+                preexec_fn=os.setpgrp,
+                pass_fds=self.shm_fds,
+                stdin=subprocess.PIPE,
+                stdout=subprocess.PIPE,
+                stderr=subprocess.STDOUT)
+        try:
+            output = self.process.communicate(timeout=template.EXPORT_TIMEOUT)[0]
+        except subprocess.TimeoutExpired:
+            log_qemu("No HYPERCALL_KAFL_LOCK within %ds" % template.EXPORT_TIMEOUT, self.qemu_id)
+            self.process.kill()
+            output = self.process.communicate()[0]
+
+        header = "\n=================<Qemu %s Console Output>==================\n" % self.qemu_id
+        footer = "====================</Console Output>======================\n"
+        log_qemu(header + strdump(output, verbatim=True) + footer, self.qemu_id)
+        if self.process.returncode != 0 or not os.path.exists(state_filename + ".tmp"):
+            return False
 
+        os.replace(state_filename + ".tmp", state_filename)
+        log_qemu("Template exported after %.1fs" % (time.time() - start_time), self.qemu_id)
         return True
 
     def set_init_state(self):
@@ -575,28 +818,54 @@ class qemu:
                 if self.process.returncode is not None:
                     raise
 
-        self.kafl_shm_f     = os.open(self.bitmap_filename, os.O_RDWR | os.O_SYNC | os.O_CREAT)
-        self.fs_shm_f       = os.open(self.payload_filename, os.O_RDWR | os.O_SYNC | os.O_CREAT)
-
-        open(self.tracedump_filename, "wb").close()
-
-        os.ftruncate(self.kafl_shm_f, self.bitmap_size)
-        os.ftruncate(self.fs_shm_f, (128 << 10))
-
-        self.kafl_shm = mmap.mmap(self.kafl_shm_f, self.bitmap_size, mmap.MAP_SHARED, mmap.PROT_WRITE | mmap.PROT_READ)
-        self.c_bitmap = (ctypes.c_uint8 * self.bitmap_size).from_buffer(self.kafl_shm)
-        self.fs_shm = mmap.mmap(self.fs_shm_f, (128 << 10), mmap.MAP_SHARED, mmap.PROT_WRITE | mmap.PROT_READ)
-
         return True
 
+    def is_alive(self):
+        return self.process is not None and self.process.poll() is None
+
     # Restart Qemu after crash/timeout, unless the target runs its own forkserver
     def restart(self):
         if self.config.argument_values['forkserver']:
             return True
 
         self.shutdown()
+        if self.standby_pool:
+            instance = self.standby_pool.take()
+            if instance and self.__adopt(instance):
+                return True
         return self.start()
 
+    # Take over the Qemu process of a ready standby, which gets our dead one in return
+    def __adopt(self, instance):
+        for attr in STANDBY_ATTRS:
+            mine = getattr(self, attr)
+            setattr(self, attr, getattr(instance, attr))
+            setattr(instance, attr, mine)
+        for q in (self, instance):
+            q.shm_fds = q.__shm_fds()
+            q.__build_cmd()
+        self.standby_pool.give_back(instance)
+
+        self.persistent_runs = 0
+        self.exec_timeout_sent = None
+        self.handshake_stage_1 = False
+        self.handshake_stage_2 = False
+        try:
+            self.__debug_send(qemu_protocol.ADOPT)
+            self.__debug_recv_expect(qemu_protocol.ADOPT)
+        except Exception:
+            log_qemu("Standby instance did not respond, launching a new one", self.qemu_id)
+            self.shutdown()
+            return False
+        log_qemu("Adopted standby instance (pid %d)" % self.process.pid, self.qemu_id)
+
+        if self.slot:
+            self.vcpu_migrations_base += self.vcpu_migrations
+            self.vcpu_migrations = 0
+            placement.pin_qemu(self.process.pid, self.slot)
+            self.__update_placement(force=True)
+        return True
+
     # Reload is not part of released Redqueen backend, it seems we can simply disable it here..
     def soft_reload(self):
         return
@@ -616,13 +885,43 @@ class qemu:
             log_qemu("soft reload failed (ipt ovp quirk)", self.qemu_id)
             self.soft_reload()
 
+    # guest address of the last kernel crash report, 0 for user mode agents
+    def crash_ip(self):
+        return self.telemetry.crash_ip()
+
+    # Set baseline exec time of the node currently being processed (0 = none)
+    def set_timeout_baseline(self, baseline):
+        self.exec_timeout_baseline = baseline or 0
+        self.__update_exec_timeout()
+
+    def __update_exec_timeout(self):
+        if len(self.exec_times) < EXEC_TIMEOUT_UPDATE:
+            self.exec_timeout = EXEC_TIMEOUT_MAX
+            return
+
+        samples = sorted(self.exec_times)
+        p99 = samples[int(len(samples) * 0.99)]
+        budget = self.tick_timeout_treshold * max(p99, self.exec_timeout_baseline)
+        self.exec_timeout = min(EXEC_TIMEOUT_MAX, max(EXEC_TIMEOUT_MIN, budget))
+
+    def __record_exec_time(self, runtime):
+        self.exec_times.append(runtime)
+        if len(self.exec_times) % EXEC_TIMEOUT_UPDATE == 0:
+            self.__update_exec_timeout()
+
+    # Qemu only needs an update when the budget changes - 0 disables the timer
+    def __send_exec_timeout(self, timeout):
+        usec = int(timeout * 1000 * 1000)
+        if usec != self.exec_timeout_sent:
+            self.__debug_send(qemu_protocol.SET_TIMEOUT + struct.pack("<I", usec))
+            self.exec_timeout_sent = usec
+
     # TODO: can directly return result for handling by caller?
     # TODO: document protocol and meaning/effect of each message
     def check_recv(self, timeout_detection=True):
         if timeout_detection:
-            #debugging_code
-            #ready = select.select([self.control], [], [], 0.25)
-            ready = select.select([self.control], [], [], 5)
+            # Qemu enforces exec_timeout and reports TIMEOUT - this is only a backstop
+            ready = select.select([self.control], [], [], self.exec_timeout + EXEC_TIMEOUT_SLACK)
             if not ready[0]:
                 return 2
         else:
@@ -676,6 +975,9 @@ class qemu:
         result = self.__debug_recv()
         return result
 
+    def __bitmap_generation(self):
+        return struct.unpack_from("<Q", self.kafl_shm, self.bitmap_size)[0]
+
     def send_payload(self, apply_patches=True, timeout_detection=True, max_iterations=10):
         log_qemu("Send payload..", self.qemu_id)
 
@@ -690,6 +992,7 @@ class qemu:
                 self.send_enable_patches()
             else:
                 self.send_disable_patches()
+        self.__send_exec_timeout(self.exec_timeout if timeout_detection else 0)
         self.__debug_send(qemu_protocol.RELEASE)
 
         self.crashed = False
@@ -698,28 +1001,40 @@ class qemu:
 
         repeat = False
         value = self.check_recv(timeout_detection=timeout_detection)
+        # the control message orders our reads after Qemu's bitmap stores
+        generation = self.__bitmap_generation()
+        if value == 0 and generation == self.bitmap_generation:
+            log_qemu("Bitmap was not published for this execution!", self.qemu_id)
+        self.bitmap_generation = generation
         if value == 0:
             pass # all good
         elif value == 1:
             log_qemu("Crash detected!", self.qemu_id)
             self.crashed = True
+            self.telemetry.count(telemetry.CRASHES)
         elif value == 2:
             log_qemu("Timeout detected!", self.qemu_id)
             self.timeout = True
+            self.telemetry.count(telemetry.TIMEOUTS)
         elif value == 3:
             log_qemu("Kasan detected!", self.qemu_id)
             self.kasan = True
+            self.telemetry.count(telemetry.KASAN)
         elif value == 4:
             repeat = True
+            self.telemetry.count(telemetry.PT_TRASHED)
         elif value == 5:
             repeat = True
+            self.telemetry.count(telemetry.PT_TRASHED)
             self.soft_reload()
         elif value == 6:
             repeat = True
+            self.telemetry.count(telemetry.PT_TRASHED)
             self.soft_reload()
         elif value == 7:
             log_qemu("Timeout detected!", self.qemu_id)
             self.timeout = True
+            self.telemetry.count(telemetry.TIMEOUTS)
         else:
             # TODO: detect+log errors without affecting fuzz campaigns
             #raise ValueError("Unhandled return code %s" % str(value))
@@ -737,7 +1052,14 @@ class qemu:
                 res.performance = time.time() - start_time
                 return res
 
-        return ExecutionResult(self.c_bitmap, self.bitmap_size, self.exit_reason(), time.time() - start_time)
+        runtime = time.time() - start_time
+        if timeout_detection and value == 0:
+            self.__record_exec_time(runtime)
+        self.telemetry.record(telemetry.HIST_EXEC, runtime)
+        self.__update_placement()
+        self.__update_template()
+
+        return ExecutionResult(self.c_bitmap, self.bitmap_size, self.exit_reason(), runtime)
 
     def exit_reason(self):
         if self.crashed:
@@ -796,6 +1118,35 @@ class qemu:
             return False
         return True
 
+    # Execute a batch of inputs in Redqueen mode, toggling the instrumentation
+    # only once per batch. Qemu truncates the result file only when intercept
+    # mode is enabled, so we truncate it before each input and hand it to
+    # collect(payload) right after the execution.
+    def execute_in_redqueen_mode_batch(self, payloads, collect):
+        log_qemu("Performing redqueen batch of %d iterations..." % len(payloads), self.qemu_id)
+        try:
+            self.soft_reload()
+            self.send_rq_set_light_instrumentation()
+            self.send_enable_redqueen()
+            for payload in payloads:
+                open(self.redqueen_workdir.redqueen(), "wb").close()
+                self.set_payload(payload)
+                self.send_payload(timeout_detection=False)
+                collect(payload)
+        except Exception as e:
+            log_qemu("%s" % traceback.format_exc(), self.qemu_id)
+            return False
+
+        try:
+            self.send_disable_redqueen()
+            self.set_payload(payloads[-1])
+            self.send_payload(timeout_detection=False)
+            self.soft_reload()
+        except Exception as e:
+            log_qemu("%s" % traceback.format_exc(), self.qemu_id)
+            return False
+        return True
+
     def set_payload(self, payload):
         if self.exiting:
             sys.exit(0)
@@ -805,6 +1156,7 @@ class qemu:
         if len(payload) > 65400:
             payload = payload[:65400]
 
+        start_time = time.time()
         try:
             self.fs_shm.seek(0)
             input_len = to_string_32(len(payload))
@@ -813,7 +1165,7 @@ class qemu:
             self.fs_shm.write_byte(input_len[1])
             self.fs_shm.write_byte(input_len[0])
             self.fs_shm.write(payload)
-            self.fs_shm.flush()
+            self.telemetry.record(telemetry.HIST_PAYLOAD, time.time() - start_time)
         except:
             if self.exiting:
                 sys.exit(0)
@@ -11,6 +11,9 @@ ENABLE_SAMPLING = b'S'
 DISABLE_SAMPLING = b'O'
 COMMIT_FILTER = b'T'
 FINALIZE = b'F'
+SET_TIMEOUT = b'J' # followed by exec budget in usec (uint32, little endian)
+ADOPT = b'Y' # standby instance taken over by a slave, acknowledged with ADOPT
+FLUSH_TRACE = b'f' # PT trace archive written to disk, acknowledged with FLUSH_TRACE
 
 ENABLE_RQI_MODE = b'A'
 DISABLE_RQI_MODE = b'B'
@@ -44,6 +47,9 @@ CMDS = {
     DISABLE_SAMPLING: "DISABLE_SAMPLING",
     COMMIT_FILTER: "COMMIT_FILTER",
     FINALIZE: "FINALIZE",
+    SET_TIMEOUT: "SET_TIMEOUT",
+    ADOPT: "ADOPT",
+    FLUSH_TRACE: "FLUSH_TRACE",
 
     ENABLE_RQI_MODE: "ENABLE_RQI_MODE",
     DISABLE_RQI_MODE: "DISABLE_RQI_MODE",
@@ -59,6 +65,7 @@ CMDS = {
     CRASH: "CRASH",
     KASAN: "KASAN",
     INFO: "INFO",
+    TIMEOUT: "TIMEOUT",
 
     PRINTF: "PRINTF",
 
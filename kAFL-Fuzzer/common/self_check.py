@@ -13,8 +13,9 @@ from common.color import WARNING_PREFIX, ERROR_PREFIX, FAIL, WARNING, ENDC
 
 def check_if_nativ_lib_compiled(kafl_root):
     if not (os.path.exists(kafl_root + "fuzzer/native/") and
-            os.path.exists(kafl_root + "fuzzer/native/bitmap.so")):
-        print(WARNING + "Attempting to build missing file fuzzer/native/bitmap.so ..." + ENDC)
+            os.path.exists(kafl_root + "fuzzer/native/bitmap.so") and
+            os.path.exists(kafl_root + "fuzzer/native/grimoire.so")):
+        print(WARNING + "Attempting to build missing files in fuzzer/native/ ..." + ENDC)
 
         p = subprocess.Popen(("make -C " + kafl_root + "fuzzer/native/").split(" "),
                              stdout=subprocess.PIPE, stdin=subprocess.PIPE, stderr=subprocess.PIPE)
@@ -199,7 +200,17 @@ def self_check(rootdir):
     return True
 
 
+def check_template(config):
+    # the template is taken at HYPERCALL_KAFL_LOCK, only issued by the loaders of VM snapshots
+    if config.argument_values.get("template") and not config.argument_values.get("vm_dir"):
+        print(FAIL + ERROR_PREFIX + "-template requires -vm_dir!" + ENDC)
+        return False
+    return True
+
+
 def post_self_check(config):
+    if not check_template(config):
+        return False
     if not check_apple_ignore_msrs(config):
         return False
     if not check_apple_osk(config):
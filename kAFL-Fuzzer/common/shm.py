@@ -0,0 +1,117 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Shared memory regions with optional 2MB huge page backing.
+
+With huge pages requested, regions are allocated from hugetlb (memfd with
+MFD_HUGETLB, or a file on a hugetlbfs mount). If the huge page pool is
+missing or exhausted, they fall back to regular pages with a transparent
+huge page hint. Huge page regions are prefaulted by the opening process,
+reading one byte per page - other processes may already be updating a
+region shared via hugetlbfs, writes would race with them. Under the
+default first-touch policy, new regions therefore end up on the NUMA
+node the slave is running on. With -cpu_affinity, the slave prefers the
+node of its CPU pair before any region is created (see common/placement.py).
+"""
+
+import mmap
+import os
+
+from common.debug import log_debug
+
+HUGE_PAGE_SIZE = (2 << 20)
+
+# not exported by the os module
+MFD_HUGETLB = 0x0004
+MFD_HUGE_2MB = 21 << 26
+
+
+def round_up(size, align):
+    return (size + align - 1) & ~(align - 1)
+
+
+def hugetlbfs_mount():
+    """ First writable hugetlbfs mount with 2MB pages, or None """
+    try:
+        with open("/proc/mounts") as f:
+            mounts = [line.split() for line in f]
+    except OSError:
+        return None
+    for mount in mounts:
+        if mount[2] != "hugetlbfs":
+            continue
+        if any(o.startswith("pagesize=") and o != "pagesize=2M" for o in mount[3].split(",")):
+            continue
+        if os.access(mount[1], os.W_OK):
+            return mount[1]
+    return None
+
+
+def __map(fd, size, hugepages):
+    # hugetlb pages are reserved here, so an exhausted pool fails now and not on first access
+    mm = mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_WRITE | mmap.PROT_READ)
+    if hugepages:
+        # only a hint for regular pages (e.g. transparent_hugepage/shmem_enabled=advise)
+        try:
+            mm.madvise(mmap.MADV_HUGEPAGE)
+        except (AttributeError, OSError):
+            pass
+    return mm
+
+
+def __try_huge(open_fd, size, what):
+    fd = None
+    try:
+        fd = open_fd()
+        huge_size = round_up(size, HUGE_PAGE_SIZE)
+        os.ftruncate(fd, huge_size)
+        mm = __map(fd, huge_size, True)
+        # first touch from this process decides NUMA placement, a read fault allocates the page
+        for offset in range(0, huge_size, HUGE_PAGE_SIZE):
+            mm[offset]
+        return fd, mm, huge_size
+    except OSError as e:
+        log_debug("No huge pages for %s (%s), using regular pages" % (what, str(e)))
+        if fd is not None:
+            os.close(fd)
+        return None
+
+
+def create_memfd(name, size, hugepages=False):
+    """ Anonymous shared memory of at least size bytes. Returns (fd, mmap, size). """
+    if hugepages:
+        region = __try_huge(lambda: os.memfd_create(name, os.MFD_CLOEXEC | MFD_HUGETLB | MFD_HUGE_2MB), size, name)
+        if region:
+            return region
+    fd = os.memfd_create(name)
+    os.ftruncate(fd, size)
+    return fd, __map(fd, size, hugepages), size
+
+
+def open_shared(path, huge_name, size, hugepages=False):
+    """
+    Open or create a named region shared between processes. With huge pages,
+    it is placed on a hugetlbfs mount as huge_name instead of path.
+    Returns (fd, mmap, size).
+    """
+    mount = hugetlbfs_mount() if hugepages else None
+    if mount:
+        huge_path = os.path.join(mount, huge_name)
+        region = __try_huge(lambda: os.open(huge_path, os.O_RDWR | os.O_CREAT, 0o600), size, huge_path)
+        if region:
+            return region
+    fd = os.open(path, os.O_RDWR | os.O_CREAT)
+    os.ftruncate(fd, size)
+    return fd, __map(fd, size, hugepages), size
+
+
+def unlink_shared(huge_name):
+    """ Remove a region opened by open_shared() from hugetlbfs, its pages stay reserved otherwise """
+    mount = hugetlbfs_mount()
+    if not mount:
+        return
+    try:
+        os.remove(os.path.join(mount, huge_name))
+    except FileNotFoundError:
+        pass
@@ -0,0 +1,151 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Pool of pre-booted standby Qemu instances for one Slave.
+
+Restarting Qemu after a crash or timeout means a full VM load and both
+handshake stages. With -standby <n>, each Slave keeps up to n instances
+booted in the background, parked right after the handshake. On restart,
+the Slave's qemu takes over the processes, control socket and shared
+memory of a ready instance (see qemu.restart()) and hands its dead ones
+back to the pool, to be booted again.
+
+Standbys cost a VM each, so the pool only grows with the observed restart
+rate: it targets the number of restarts expected while one instance boots,
+and shrinks again when restarts become rare.
+"""
+
+import collections
+import math
+import threading
+import time
+
+from common.debug import log_qemu
+
+RATE_WINDOW = 60.0      # seconds of restart history used for the rate
+BOOT_HEADROOM = 1.5     # boot more than the expected restarts per boot time
+BOOT_FAILURES_MAX = 3   # give up after this many failed boots in a row
+
+
+class StandbyPool:
+
+    def __init__(self, qemu_id, factory, max_size):
+        self.qemu_id = qemu_id
+        self.factory = factory      # index -> new, not started standby instance
+        self.max_size = max_size
+        self.lock = threading.Lock()
+        self.wakeup = threading.Event()
+        self.ready = list()
+        self.idle = list()
+        self.num_instances = 0
+        self.restarts = collections.deque()
+        self.boot_time = None
+        self.boot_failures = 0
+        self.adopted = 0
+        self.exiting = False
+        self.thread = threading.Thread(target=self.__loop, name="standby-%s" % qemu_id, daemon=True)
+        self.thread.start()
+
+    def target_size(self, now=None):
+        """ Standby instances needed to cover the restarts expected while one boots """
+        now = now or time.time()
+        while self.restarts and self.restarts[0] < now - RATE_WINDOW:
+            self.restarts.popleft()
+        if not self.restarts or self.boot_failures >= BOOT_FAILURES_MAX:
+            return 0
+        if self.boot_time is None:
+            return 1
+        rate = len(self.restarts) / RATE_WINDOW
+        return min(self.max_size, max(1, math.ceil(rate * self.boot_time * BOOT_HEADROOM)))
+
+    def take(self):
+        """ A ready instance, or None - also records the restart for pool sizing """
+        with self.lock:
+            self.restarts.append(time.time())
+            instance = None
+            while self.ready and not instance:
+                instance = self.ready.pop(0)
+                if not instance.is_alive():
+                    self.idle.append(instance)
+                    instance = None
+        self.wakeup.set()
+        if instance:
+            self.adopted += 1
+        return instance
+
+    def give_back(self, instance):
+        """ Return an instance whose Qemu is gone, to be booted again """
+        with self.lock:
+            if not self.exiting:
+                self.idle.append(instance)
+                instance = None
+        if instance:
+            instance.async_exit()
+        self.wakeup.set()
+
+    def close(self):
+        with self.lock:
+            self.exiting = True
+            instances = self.ready + self.idle
+            self.ready = list()
+            self.idle = list()
+        self.wakeup.set()
+        for instance in instances:
+            instance.async_exit()
+
+    def __add_ready(self, instance):
+        with self.lock:
+            if not self.exiting:
+                self.ready.append(instance)
+                return len(self.ready)
+        instance.async_exit()
+        return 0
+
+    def __next_job(self):
+        # (instance, boot) to boot or to shut down, or None
+        with self.lock:
+            target = self.target_size()
+            if len(self.ready) > target:
+                return self.ready.pop(), False
+            # instances not in ready/idle are currently booting
+            booting = self.num_instances - len(self.ready) - len(self.idle)
+            if len(self.ready) + booting >= target:
+                return None
+            if self.idle:
+                return self.idle.pop(0), True
+            if self.num_instances < self.max_size:
+                self.num_instances += 1
+                return None, True
+        return None
+
+    def __loop(self):
+        while not self.exiting:
+            job = self.__next_job()
+            if not job:
+                self.wakeup.wait(timeout=1.0)
+                self.wakeup.clear()
+                continue
+
+            instance, boot = job
+            if not boot:
+                log_qemu("Restarts are rare, shutting down a standby", self.qemu_id)
+                instance.shutdown()
+                self.give_back(instance)
+                continue
+
+            if not instance:
+                instance = self.factory(self.num_instances - 1)
+            start_time = time.time()
+            if instance.start():
+                elapsed = time.time() - start_time
+                self.boot_time = elapsed if self.boot_time is None else 0.8 * self.boot_time + 0.2 * elapsed
+                self.boot_failures = 0
+                num_ready = self.__add_ready(instance)
+                log_qemu("Standby ready after %.1fs (%d ready)" % (elapsed, num_ready), self.qemu_id)
+            else:
+                self.boot_failures += 1
+                self.give_back(instance)
+                if self.boot_failures >= BOOT_FAILURES_MAX:
+                    log_qemu("Standby failed to boot %d times, pool disabled" % self.boot_failures, self.qemu_id)
+                self.wakeup.wait(timeout=5.0)
@@ -0,0 +1,406 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Shared-memory telemetry of slaves and their Qemu instances.
+
+Each slave owns one segment in /dev/shm with a block written by the slave
+and a block written by Qemu (see qemu-5.0.0/pt/telemetry.h for the layout).
+Blocks have a single writer each and are protected by a seqlock, so monitors
+can take consistent snapshots at any time without touching the fuzzer.
+"""
+
+import csv
+import glob
+import io
+import json
+import mmap
+import os
+import struct
+import time
+
+TELEMETRY_MAGIC = 0x4c45544b
+TELEMETRY_VERSION = 6
+
+HEADER_SIZE = 4096
+BLOCK_SIZE = 32768
+SIZE = HEADER_SIZE + 2 * BLOCK_SIZE
+
+BLOCK_SLAVE = 0
+BLOCK_QEMU = 1
+BLOCK_NAMES = ["slave", "qemu"]
+
+EXECS = 0
+RELOADS = 1
+TIMEOUTS = 2
+CRASHES = 3
+KASAN = 4
+FUNKY = 5
+PT_OVERFLOWS = 6
+PT_TRASHED = 7
+CRASH_DUPS = 8
+NUM_COUNTERS = 16
+COUNTER_NAMES = ["execs", "reloads", "timeouts", "crashes", "kasan", "funky", "pt_overflows", "pt_trashed",
+                 "crash_dups"]
+
+HIST_EXEC = 0
+HIST_DECODE = 1
+HIST_BITMAP = 2
+HIST_PAYLOAD = 3
+NUM_HISTS = 8
+HIST_NAMES = ["exec", "decode", "bitmap", "payload"]
+
+# exec cycle phases, only written by Qemu built with TELEMETRY_PHASE_SPANS
+PHASE_RELEASE = 0
+PHASE_PT_DISABLE = 1
+PHASE_DECODE = 2
+PHASE_PT_SYNC = 3
+PHASE_LOCK_WAIT = 4
+PHASE_NEXT_PAYLOAD = 5
+PHASE_PAYLOAD = 6
+PHASE_ACQUIRE = 7
+PHASE_OVERFLOW = 8
+NUM_PHASES = 16
+PHASE_NAMES = ["release", "pt_disable", "decode", "pt_sync", "lock_wait", "next_payload", "payload", "acquire", "overflow"]
+
+# flag a phase once its recent average exceeds the long-term mean by this factor
+PHASE_REGRESSION_FACTOR = 1.5
+PHASE_REGRESSION_MIN_RUNS = 1000
+
+# havoc operator/stacking depth scheduling, slave block only
+HAVOC_OPS = 32
+HAVOC_DEPTHS = 8
+# operator names are stored NUL-separated in the header page
+HAVOC_NAMES_OFFSET = 256
+
+HIST_SUB_BITS = 3
+HIST_BUCKETS = 272
+
+HEADER = struct.Struct("<8I")
+
+# offsets in 64-bit words, relative to block start
+W_SEQ = 0
+W_PID = 1
+W_UPDATE = 2
+W_COUNTERS = 3
+W_HISTS = W_COUNTERS + NUM_COUNTERS
+HIST_WORDS = 3 + HIST_BUCKETS
+W_TSC_HZ = W_HISTS + NUM_HISTS * HIST_WORDS
+W_PHASE_RUNS = W_TSC_HZ + 1
+W_PHASES = W_PHASE_RUNS + 1
+PHASE_WORDS = 4
+W_HAVOC_OPS = W_PHASES + NUM_PHASES * PHASE_WORDS
+W_HAVOC_DEPTHS = W_HAVOC_OPS + 2 * HAVOC_OPS
+W_CRASH_IP = W_HAVOC_DEPTHS + 2 * HAVOC_DEPTHS
+# slave block: slave CPU, Qemu vCPU, NUMA node (each +1, 0 if not placed), slave and vCPU migrations
+W_PLACEMENT = W_CRASH_IP + 1
+PLACEMENT_WORDS = 5
+# slave block: guest RAM template mapping of Qemu in kB - resident, shared, copied on write (see common/template.py)
+W_TEMPLATE = W_PLACEMENT + PLACEMENT_WORDS
+TEMPLATE_WORDS = 3
+BLOCK_WORDS = W_TEMPLATE + TEMPLATE_WORDS
+
+
+def telemetry_filename(config, slave_id):
+    project_name = config.argument_values['work_dir'].split("/")[-1]
+    return "/dev/shm/kafl_%s_telemetry_%s" % (project_name, slave_id)
+
+
+def hist_bucket(value):
+    if value < (1 << HIST_SUB_BITS):
+        return value
+    e = value.bit_length() - 1
+    idx = ((e - HIST_SUB_BITS + 1) << HIST_SUB_BITS) + ((value >> (e - HIST_SUB_BITS)) & ((1 << HIST_SUB_BITS) - 1))
+    return min(idx, HIST_BUCKETS - 1)
+
+
+def hist_bucket_value(idx):
+    """ Lower bound of values counted in bucket idx """
+    if idx < (1 << HIST_SUB_BITS):
+        return idx
+    e = (idx >> HIST_SUB_BITS) + HIST_SUB_BITS - 1
+    sub = idx & ((1 << HIST_SUB_BITS) - 1)
+    return ((1 << HIST_SUB_BITS) + sub) << (e - HIST_SUB_BITS)
+
+
+def create_segment(filename):
+    """ Create or reset a telemetry segment - called by the slave on startup """
+    # reset in place, truncating would SIGBUS readers that still have the segment mapped
+    fd = os.open(filename, os.O_RDWR | os.O_CREAT, 0o644)
+    try:
+        os.ftruncate(fd, SIZE)
+        os.pwrite(fd, bytes(SIZE - HEADER_SIZE), HEADER_SIZE)
+        os.pwrite(fd, HEADER.pack(TELEMETRY_MAGIC, TELEMETRY_VERSION, HEADER_SIZE, BLOCK_SIZE,
+                                  NUM_COUNTERS, NUM_HISTS, HIST_BUCKETS, HIST_SUB_BITS), 0)
+    finally:
+        os.close(fd)
+
+
+def map_segment(filename, writable=False):
+    fd = os.open(filename, os.O_RDWR if writable else os.O_RDONLY)
+    try:
+        prot = mmap.PROT_READ | mmap.PROT_WRITE if writable else mmap.PROT_READ
+        mm = mmap.mmap(fd, SIZE, mmap.MAP_SHARED, prot)
+    finally:
+        os.close(fd)
+
+    header = HEADER.unpack_from(mm, 0)
+    if header != (TELEMETRY_MAGIC, TELEMETRY_VERSION, HEADER_SIZE, BLOCK_SIZE,
+                  NUM_COUNTERS, NUM_HISTS, HIST_BUCKETS, HIST_SUB_BITS):
+        mm.close()
+        raise ValueError("%s: not a telemetry segment or layout mismatch" % filename)
+    return mm
+
+
+class TelemetryWriter:
+    """ Writer side of the slave block. Several writers may exist in one thread. """
+
+    def __init__(self, filename):
+        self.mm = map_segment(filename, writable=True)
+        self.words = memoryview(self.mm).cast('B')[HEADER_SIZE:HEADER_SIZE + BLOCK_SIZE].cast('Q')
+        self.words[W_PID] = os.getpid()
+
+    def __begin(self):
+        self.words[W_SEQ] += 1
+
+    def __end(self):
+        self.words[W_UPDATE] = time.monotonic_ns()
+        self.words[W_SEQ] += 1
+
+    def count(self, counter, n=1):
+        self.__begin()
+        self.words[W_COUNTERS + counter] += n
+        self.__end()
+
+    def record(self, hist, seconds):
+        ns = int(seconds * 1e9)
+        base = W_HISTS + hist * HIST_WORDS
+        words = self.words
+
+        self.__begin()
+        words[base] += 1
+        words[base + 1] += ns
+        if ns > words[base + 2]:
+            words[base + 2] = ns
+        words[base + 3 + hist_bucket(ns)] += 1
+        self.__end()
+
+    def set_havoc_names(self, names):
+        blob = b"\0".join(name.encode() for name in names[:HAVOC_OPS])
+        blob = blob[:HEADER_SIZE - HAVOC_NAMES_OFFSET - 1]
+        self.mm[HAVOC_NAMES_OFFSET:HEADER_SIZE] = blob.ljust(HEADER_SIZE - HAVOC_NAMES_OFFSET, b"\0")
+
+    def havoc(self, ops, depths):
+        """ Set [uses, finds] per havoc operator and per stacking depth """
+        words = self.words
+        self.__begin()
+        for base, counts, num in ((W_HAVOC_OPS, ops, HAVOC_OPS), (W_HAVOC_DEPTHS, depths, HAVOC_DEPTHS)):
+            for i, (uses, finds) in enumerate(counts[:num]):
+                words[base + 2 * i] = uses
+                words[base + 2 * i + 1] = finds
+        self.__end()
+
+    def placement(self, slot, slave_migrations, vcpu_migrations):
+        """ CPU placement of this slave (see common/placement.py) and CPU migrations seen so far """
+        words = self.words
+        self.__begin()
+        words[W_PLACEMENT] = slot.slave_cpu + 1 if slot else 0
+        words[W_PLACEMENT + 1] = slot.qemu_cpu + 1 if slot else 0
+        words[W_PLACEMENT + 2] = slot.node + 1 if slot else 0
+        words[W_PLACEMENT + 3] = slave_migrations
+        words[W_PLACEMENT + 4] = vcpu_migrations
+        self.__end()
+
+    def template(self, sharing):
+        """ Sharing of the guest RAM template by this slave's Qemu, a template.Sharing in kB """
+        words = self.words
+        self.__begin()
+        words[W_TEMPLATE] = sharing.rss
+        words[W_TEMPLATE + 1] = sharing.shared
+        words[W_TEMPLATE + 2] = sharing.private_dirty
+        self.__end()
+
+    def crash_ip(self):
+        """ Address of the last kernel crash report, as written by Qemu """
+        offset = HEADER_SIZE + BLOCK_QEMU * BLOCK_SIZE + 8 * W_CRASH_IP
+        return struct.unpack_from("<Q", self.mm, offset)[0]
+
+
+def read_block(mm, block, retries=100):
+    """ Consistent copy of a block as a tuple of 64-bit words, or None on contention """
+    offset = HEADER_SIZE + block * BLOCK_SIZE
+    layout = struct.Struct("<%dQ" % BLOCK_WORDS)
+    for _ in range(retries):
+        seq = struct.unpack_from("<Q", mm, offset)[0]
+        if seq & 1:
+            continue
+        words = layout.unpack_from(mm, offset)
+        if struct.unpack_from("<Q", mm, offset)[0] == seq:
+            return words
+    return None
+
+
+def hist_summary(words, hist):
+    base = W_HISTS + hist * HIST_WORDS
+    count, total, maximum = words[base:base + 3]
+    buckets = words[base + 3:base + 3 + HIST_BUCKETS]
+    summary = {"count": count, "mean": total / count if count else 0, "max": maximum}
+    for name, q in (("p50", 0.5), ("p90", 0.9), ("p99", 0.99)):
+        summary[name] = 0
+        if not count:
+            continue
+        rank = q * count
+        seen = 0
+        for idx, n in enumerate(buckets):
+            seen += n
+            if seen >= rank:
+                summary[name] = min(hist_bucket_value(idx), maximum)
+                break
+    return summary
+
+
+def havoc_summary(words, names):
+    """ Per-operator and per-stacking depth yield, or None if havoc has not been scheduled """
+    summary = {"ops": dict(), "depths": dict()}
+    for key, base, labels in (("ops", W_HAVOC_OPS, names), ("depths", W_HAVOC_DEPTHS,
+                                                              ["stack_%d" % (2 << i) for i in range(HAVOC_DEPTHS)])):
+        for i, label in enumerate(labels):
+            uses, finds = words[base + 2 * i:base + 2 * i + 2]
+            if uses:
+                summary[key][label] = {"uses": uses, "finds": finds, "yield": finds / uses}
+    return summary if summary["ops"] else None
+
+
+def phase_summary(words):
+    """ Per-phase breakdown in usec per exec cycle, or None if Qemu records no phases """
+    tsc_hz, runs = words[W_TSC_HZ], words[W_PHASE_RUNS]
+    if not tsc_hz or not runs:
+        return None
+    us = 1e6 / tsc_hz
+    summary = dict()
+    for i, name in enumerate(PHASE_NAMES):
+        base = W_PHASES + i * PHASE_WORDS
+        cycles, maximum, last, ema = words[base:base + PHASE_WORDS]
+        mean = cycles / runs
+        summary[name] = {
+                "mean_us": mean * us,
+                "recent_us": ema * us,
+                "last_us": last * us,
+                "max_us": maximum * us,
+                "regression": runs >= PHASE_REGRESSION_MIN_RUNS and ema > PHASE_REGRESSION_FACTOR * mean,
+                }
+    return summary
+
+
+def placement_summary(words):
+    """ Placement of a slave block, or None if neither pinned nor migrations counted """
+    slave_cpu, qemu_cpu, node, slave_migrations, vcpu_migrations = words[W_PLACEMENT:W_PLACEMENT + PLACEMENT_WORDS]
+    if not slave_cpu and not slave_migrations and not vcpu_migrations:
+        return None
+    return {"slave_cpu": slave_cpu - 1 if slave_cpu else None,
+            "qemu_cpu": qemu_cpu - 1 if qemu_cpu else None,
+            "node": node - 1 if node else None,
+            "slave_migrations": slave_migrations,
+            "vcpu_migrations": vcpu_migrations}
+
+
+def template_summary(words):
+    """ Guest RAM template sharing of a slave block, or None if not launched from a template """
+    rss, shared, private_dirty = words[W_TEMPLATE:W_TEMPLATE + TEMPLATE_WORDS]
+    if not rss:
+        return None
+    return {"rss_kb": rss, "shared_kb": shared, "cow_kb": private_dirty}
+
+
+class TelemetryReader:
+    """ Reader for monitors: snapshots of one or more telemetry segments """
+
+    def __init__(self, filename):
+        self.filename = filename
+        self.mm = map_segment(filename)
+
+    def snapshot(self):
+        result = dict()
+        for block, name in enumerate(BLOCK_NAMES):
+            words = read_block(self.mm, block)
+            if words is None:
+                continue
+            result[name] = {
+                    "pid": words[W_PID],
+                    "update_ns": words[W_UPDATE],
+                    "counters": {cname: words[W_COUNTERS + i] for i, cname in enumerate(COUNTER_NAMES)},
+                    "hists": {hname: hist_summary(words, i) for i, hname in enumerate(HIST_NAMES)},
+                    }
+            phases = phase_summary(words)
+            if phases:
+                result[name]["phases"] = phases
+            if block == BLOCK_QEMU and words[W_CRASH_IP]:
+                result[name]["crash_ip"] = words[W_CRASH_IP]
+            if block == BLOCK_SLAVE:
+                havoc = havoc_summary(words, self.havoc_names())
+                if havoc:
+                    result[name]["havoc"] = havoc
+                placement = placement_summary(words)
+                if placement:
+                    result[name]["placement"] = placement
+                template = template_summary(words)
+                if template:
+                    result[name]["template"] = template
+        return result
+
+    def havoc_names(self):
+        blob = bytes(self.mm[HAVOC_NAMES_OFFSET:HEADER_SIZE]).rstrip(b"\0")
+        names = [name.decode(errors="replace") for name in blob.split(b"\0")] if blob else []
+        return names + ["op_%d" % i for i in range(len(names), HAVOC_OPS)]
+
+    def counter(self, counter, block=BLOCK_SLAVE):
+        offset = HEADER_SIZE + block * BLOCK_SIZE + 8 * (W_COUNTERS + counter)
+        return struct.unpack_from("<Q", self.mm, offset)[0]
+
+    def close(self):
+        self.mm.close()
+
+
+def read_all(work_dir):
+    """ Snapshot all telemetry segments of a campaign: {slave_id: snapshot} """
+    project_name = os.path.basename(os.path.normpath(work_dir))
+    result = dict()
+    for filename in glob.glob("/dev/shm/kafl_%s_telemetry_*" % project_name):
+        try:
+            reader = TelemetryReader(filename)
+        except (OSError, ValueError):
+            continue
+        result[filename.rsplit("_", 1)[-1]] = reader.snapshot()
+        reader.close()
+    return result
+
+
+def to_json(snapshots):
+    return json.dumps(snapshots, indent=2, sort_keys=True)
+
+
+def to_csv(snapshots):
+    out = io.StringIO()
+    writer = csv.writer(out)
+    writer.writerow(["slave", "block", "metric", "count", "mean", "p50", "p90", "p99", "max"])
+    for slave_id in sorted(snapshots, key=lambda x: int(x) if x.isdigit() else x):
+        for block, data in sorted(snapshots[slave_id].items()):
+            for name, value in data["counters"].items():
+                writer.writerow([slave_id, block, name, value, "", "", "", "", ""])
+            for name, h in data["hists"].items():
+                writer.writerow([slave_id, block, name + "_ns", h["count"], "%.0f" % h["mean"],
+                                 h["p50"], h["p90"], h["p99"], h["max"]])
+            for name, p in data.get("phases", {}).items():
+                writer.writerow([slave_id, block, "phase_" + name + "_us", "", "%.2f" % p["mean_us"],
+                                 "", "", "", "%.2f" % p["max_us"]])
+            for name in ("slave_migrations", "vcpu_migrations"):
+                if "placement" in data:
+                    writer.writerow([slave_id, block, name, data["placement"][name], "", "", "", "", ""])
+            for name, value in sorted(data.get("template", {}).items()):
+                writer.writerow([slave_id, block, "template_" + name, value, "", "", "", "", ""])
+            for entries in data.get("havoc", {}).values():
+                for name, h in entries.items():
+                    metric = name if name.startswith("havoc_") else "havoc_" + name
+                    writer.writerow([slave_id, block, metric + "_yield", h["uses"], "%.6f" % h["yield"],
+                                     "", "", "", ""])
+    return out.getvalue()
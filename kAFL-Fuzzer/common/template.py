@@ -0,0 +1,82 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Shared copy-on-write guest RAM template.
+
+With -template, the Master boots one Qemu instance up to the snapshot point
+before the Slaves start: from the -loadvm snapshot until the loader's
+HYPERCALL_KAFL_LOCK. This needs -vm_dir, the agents booted with -kernel or
+-bios never issue it. Its guest RAM lives in a shared file
+in /dev/shm, and Qemu exports the remaining device state as a migration
+stream that skips shared RAM (x-ignore-shared, see qemu-5.0.0/pt/template.h).
+
+Slaves and their standby instances map the RAM file privately and load the
+device state with -incoming. Guest pages are only copied when a Slave writes
+to them, all others are shared by every Qemu instance via the page cache.
+How much is actually shared is read from /proc/<pid>/smaps and reported in
+the Slave's telemetry.
+"""
+
+import collections
+import os
+
+# give up on the template if Qemu does not reach the snapshot point in time (seconds)
+EXPORT_TIMEOUT = 120
+# refresh sharing stats in telemetry at most once per interval (seconds), smaps is expensive
+STATS_INTERVAL = 5.0
+
+Sharing = collections.namedtuple("Sharing", ["rss", "shared", "private_dirty"])
+
+
+def enabled(config):
+    return config.argument_values.get('template', False)
+
+
+def ram_filename(config):
+    project_name = os.path.basename(os.path.normpath(config.argument_values['work_dir']))
+    return "/dev/shm/kafl_%s_template_ram" % project_name
+
+
+def state_filename(config):
+    return config.argument_values['work_dir'] + "/template_state"
+
+
+def overlay_filename(config):
+    # disk of the template, used read-only (-snapshot) by all Slaves
+    return config.argument_values['work_dir'] + "/overlay_template.qcow2"
+
+
+def parse_smaps(text, path):
+    """ Sharing of the mapping of path in /proc/<pid>/smaps text, in kB, or None if not mapped """
+    sharing = None
+    in_mapping = False
+    for line in text.splitlines():
+        fields = line.split()
+        if not fields:
+            continue
+        if not fields[0].endswith(":"):
+            # mapping header: address perms offset dev inode [path]
+            in_mapping = len(fields) >= 6 and " ".join(fields[5:]) == path
+            if in_mapping and not sharing:
+                sharing = Sharing(0, 0, 0)
+            continue
+        if not in_mapping:
+            continue
+        key = fields[0][:-1]
+        if key == "Rss":
+            sharing = sharing._replace(rss=sharing.rss + int(fields[1]))
+        elif key in ("Shared_Clean", "Shared_Dirty"):
+            sharing = sharing._replace(shared=sharing.shared + int(fields[1]))
+        elif key == "Private_Dirty":
+            # pages copied on write
+            sharing = sharing._replace(private_dirty=sharing.private_dirty + int(fields[1]))
+    return sharing
+
+
+def sharing(pid, path):
+    try:
+        with open("/proc/%d/smaps" % pid) as f:
+            return parse_smaps(f.read(), path)
+    except OSError:
+        return None
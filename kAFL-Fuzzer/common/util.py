@@ -6,6 +6,7 @@
 import glob
 import os
 import shutil
+import struct
 import sys
 import tempfile
 import string
@@ -53,6 +54,48 @@ def read_binary_file(filename):
     with open(filename, 'rb') as f:
         return f.read()
 
+# PT trace archive as written by Qemu (see qemu-5.0.0/pt/trace_dump.h)
+PT_TRACE_DUMP_MAGIC = 0x4450544b
+PT_TRACE_DUMP_ALIGN = 4096
+PT_TRACE_DUMP_FLAG_LZ4 = 1 << 0
+PT_TRACE_DUMP_FLAG_DROPPED = 1 << 1
+PT_TRACE_DUMP_FLAG_LAST = 1 << 2
+PT_TRACE_DUMP_HEADER = struct.Struct("<IIQII")
+
+def read_pt_trace_dump(filename):
+    """
+    Parse a PT trace archive and return a list of (exec_id, flags, trace) for
+    all executions completely written to disk so far, in execution order.
+    Qemu moves a full archive to <filename>.1 and starts over.
+    """
+    data = read_binary_file(filename)
+    execs = list()
+    pending = dict()
+    offset = 0
+    while offset + PT_TRACE_DUMP_HEADER.size <= len(data):
+        magic, flags, exec_id, size, raw_size = PT_TRACE_DUMP_HEADER.unpack_from(data, offset)
+        if magic != PT_TRACE_DUMP_MAGIC:
+            # O_DIRECT padding
+            offset = (offset // PT_TRACE_DUMP_ALIGN + 1) * PT_TRACE_DUMP_ALIGN
+            continue
+        offset += PT_TRACE_DUMP_HEADER.size
+        if offset + size > len(data):
+            break
+        chunk = data[offset:offset+size]
+        offset += size
+        if flags & PT_TRACE_DUMP_FLAG_LZ4:
+            import lz4.block
+            chunk = lz4.block.decompress(chunk, uncompressed_size=raw_size)
+        if execs and exec_id < execs[-1][0]:
+            # Qemu was restarted and appends with new exec_ids
+            pending.clear()
+        all_flags, trace = pending.pop(exec_id, (0, b''))
+        if flags & PT_TRACE_DUMP_FLAG_LAST:
+            execs.append((exec_id, all_flags | flags, trace + chunk))
+        else:
+            pending[exec_id] = (all_flags | flags, trace + chunk)
+    return execs
+
 def find_diffs(data_a, data_b):
     first_diff = 0
     last_diff = 0
@@ -77,6 +120,13 @@ def prepare_working_dir(workdir, purge=False):
     for path in glob.glob("/dev/shm/kafl_%s_*" % project_name):
         os.remove(path)
 
+    # global bitmaps created with -hugepages (common.shm imports util via debug)
+    from common.shm import hugetlbfs_mount
+    mount = hugetlbfs_mount()
+    if mount:
+        for path in glob.glob(mount + "/kafl_%s_*" % project_name):
+            os.remove(path)
+
     if os.path.exists("/dev/shm/kafl_tfilter"):
         os.remove("/dev/shm/kafl_tfilter")
 
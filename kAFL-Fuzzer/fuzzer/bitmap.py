@@ -10,15 +10,18 @@ kAFL Fuzzer Bitmap
 import array
 import ctypes
 import inspect
-import mmap
 import os
 
+from common import shm
+
 
 class GlobalBitmap:
     bitmap_native_so = ctypes.CDLL(
         os.path.dirname(os.path.abspath(inspect.getfile(inspect.currentframe()))) + '/native/bitmap.so')
     bitmap_native_so.are_new_bits_present_no_apply_lut.restype = ctypes.c_uint64
     bitmap_native_so.are_new_bits_present_do_apply_lut.restype = ctypes.c_uint64
+    bitmap_native_so.are_bits_still_set.restype = ctypes.c_bool
+    bitmap_native_so.crash_edge_signature.restype = ctypes.c_uint64
     bitmap_size = None
 
     def __init__(self, name, config, bitmap_size, read_only=True):
@@ -39,10 +42,17 @@ class GlobalBitmap:
             self.c_bitmap[i] = 0
 
     def create_bitmap(self, name):
-        self.bitmap_fd = os.open(self.config.argument_values['work_dir'] + "/bitmaps/" + name,
-                                 os.O_RDWR | os.O_SYNC | os.O_CREAT)
-        os.ftruncate(self.bitmap_fd, self.config.config_values['BITMAP_SHM_SIZE'])
-        self.bitmap = mmap.mmap(self.bitmap_fd, self.bitmap_size, mmap.MAP_SHARED, mmap.PROT_WRITE | mmap.PROT_READ)
+        work_dir = self.config.argument_values['work_dir']
+        project_name = os.path.basename(os.path.normpath(work_dir))
+        self.huge_name = "kafl_%s_%s" % (project_name, name)
+        self.bitmap_fd, self.bitmap, _ = shm.open_shared(work_dir + "/bitmaps/" + name,
+                                                         self.huge_name,
+                                                         self.config.config_values['BITMAP_SHM_SIZE'],
+                                                         self.config.argument_values.get('hugepages', False))
+
+    def unlink(self):
+        if self.config.argument_values.get('hugepages', False):
+            shm.unlink_shared(self.huge_name)
 
     def get_new_byte_and_bit_counts(self, local_bitmap):
         c_new_bitmap = local_bitmap.cbuffer
@@ -87,10 +97,23 @@ class GlobalBitmap:
         exec_result.lut_applied = True
 
     @staticmethod
-    def all_new_bits_still_set(old_bits, new_bitmap):
+    def expected_bits(old_bits):
+        """ Native form of {index: byteval} for repeated all_expected_bits_set() checks """
+        num = len(old_bits)
+        indices = (ctypes.c_uint32 * num)(*old_bits.keys())
+        values = (ctypes.c_uint8 * num)(*old_bits.values())
+        return indices, values, num
+
+    @staticmethod
+    def all_expected_bits_set(expected, new_bitmap):
         assert new_bitmap.is_lut_applied()
-        c_new_bitmap = new_bitmap.cbuffer
-        return all([c_new_bitmap[index] == byteval for (index, byteval) in old_bits.items()])
+        indices, values, num = expected
+        return GlobalBitmap.bitmap_native_so.are_bits_still_set(new_bitmap.cbuffer, indices, values,
+                                                                ctypes.c_uint64(num))
+
+    @staticmethod
+    def all_new_bits_still_set(old_bits, new_bitmap):
+        return GlobalBitmap.all_expected_bits_set(GlobalBitmap.expected_bits(old_bits), new_bitmap)
 
     def determine_new_bytes(self, exec_result):
         new_bytes = {}
@@ -120,6 +143,12 @@ class BitmapStorage:
         self.crash_bitmap = GlobalBitmap(prefix + "_crash_bitmap", config, self.bitmap_size, read_only)
         self.kasan_bitmap = GlobalBitmap(prefix + "_kasan_bitmap", config, self.bitmap_size, read_only)
         self.timeout_bitmap = GlobalBitmap(prefix + "_timeout_bitmap", config, self.bitmap_size, read_only)
+        # regular coverage as of the first crash signature, see crash_signature()
+        self.crash_baseline = None
+
+    def unlink(self):
+        for bitmap in (self.normal_bitmap, self.crash_bitmap, self.kasan_bitmap, self.timeout_bitmap):
+            bitmap.unlink()
 
     def get_bitmap_for_node_type(self, exit_reason):
         if exit_reason == "regular":
@@ -151,6 +180,18 @@ class BitmapStorage:
 
         return self.check_storage_logic(exec_result, new_bytes, new_bits)
 
+    def crash_signature(self, exec_result):
+        """
+        Hash of the edges of a crashing execution that regular executions had
+        not hit when the first crash was seen. The baseline is not updated
+        later on, so the signature of a crash does not depend on the progress
+        of the campaign.
+        """
+        if self.crash_baseline is None:
+            self.crash_baseline = (ctypes.c_uint8 * self.bitmap_size).from_buffer_copy(self.normal_bitmap.c_bitmap)
+        return GlobalBitmap.bitmap_native_so.crash_edge_signature(self.crash_baseline, exec_result.cbuffer,
+                                                                  ctypes.c_uint64(self.bitmap_size))
+
     def should_store_in_queue(self, exec_result):
         relevant_bitmap = self.get_bitmap_for_node_type(exec_result.exit_reason)
         new_bytes, new_bits = relevant_bitmap.get_new_byte_and_bit_offsets(exec_result)
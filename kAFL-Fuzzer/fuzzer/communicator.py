@@ -84,6 +84,7 @@ class ClientConnection:
         self.sock.send_bytes(
             msgpack.packb({"type": MSG_NEW_INPUT, "input": {"payload": data, "bitmap": bitmap, "info": info}}, use_bin_type=True))
 
-    def send_node_done(self, node_id, results, new_payload):
+    def send_node_done(self, node_id, results, new_payload, havoc_stats=None, new_bitmap=None):
         self.sock.send_bytes(msgpack.packb(
-            {"type": MSG_NODE_DONE, "node_id": node_id, "results": results, "new_payload": new_payload}, use_bin_type=True))
+            {"type": MSG_NODE_DONE, "node_id": node_id, "results": results, "new_payload": new_payload,
+             "havoc_stats": havoc_stats, "new_bitmap": new_bitmap}, use_bin_type=True))
@@ -14,12 +14,16 @@ Prepare the kAFL workdir and copy any provided seeds to be picked up by the sche
 """
 
 import multiprocessing
+import os
 import time
 import pgrep
 import sys
 import traceback
 
-from common.debug import enable_logging
+import common.placement as placement
+import common.template as template
+from common.debug import enable_logging, log_master
+from common.qemu import qemu
 from common.self_check import post_self_check
 from common.util import prepare_working_dir, print_fail, print_note, print_warning, copy_seed_files
 from fuzzer.process.master import MasterProcess
@@ -51,6 +55,15 @@ def graceful_exit(slaves):
                 slaves.remove(s)
 
 
+def build_template(config):
+    print_note("Booting guest RAM template...")
+    instance = qemu("template", config, template_export=True)
+    exported = instance.export_template()
+    instance.async_exit()
+    if not exported:
+        print_warning("Failed to export the guest RAM template, see logs. Slaves boot on their own.")
+
+
 def start(config):
 
     if not post_self_check(config):
@@ -75,6 +88,17 @@ def start(config):
     if not config.argument_values['ip0']:
         print_warning("No trace region configured! PT feedback disabled!")
 
+    # pin before the Master starts its worker threads, they inherit the mask
+    layout = placement.from_config(config)
+    if layout:
+        for line in layout.describe():
+            log_master("Placement: " + line)
+        os.sched_setaffinity(0, layout.master_cpus)
+
+    # Slaves launch from the template if it exists when they start
+    if template.enabled(config):
+        build_template(config)
+
     master = MasterProcess(config)
 
     slaves = []
@@ -91,6 +115,13 @@ def start(config):
         print(traceback.format_exc())
     finally:
         graceful_exit(slaves)
+        master.shutdown()
+
+    if template.enabled(config):
+        try:
+            os.remove(template.ram_filename(config))
+        except FileNotFoundError:
+            pass
 
     time.sleep(0.2)
     qemu_sweep()
@@ -0,0 +1,37 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Slave-side deduplication of crashing inputs.
+
+A crash signature combines the exit reason, the crash address reported by
+Qemu (0 for user mode agents) and the hash of the crash edges that regular
+executions had not hit by the time of the slave's first crash.
+Crashes with new coverage in the crash bitmaps always go to the Master. Of
+the others, only the first BUDGET inputs per signature are sent, the rest
+is counted.
+"""
+
+# inputs sent to the Master per signature
+BUDGET = 4
+# once the index is full, unknown signatures are sent rather than dropped
+MAX_SIGNATURES = 1 << 16
+
+
+class CrashIndex:
+
+    def __init__(self, budget=BUDGET, max_signatures=MAX_SIGNATURES):
+        self.budget = budget
+        self.max_signatures = max_signatures
+        self.counts = dict()
+
+    def __len__(self):
+        return len(self.counts)
+
+    def submit(self, signature):
+        """ Count a crash, returns True if it is within the budget of its signature """
+        count = self.counts.get(signature, 0)
+        if not count and len(self.counts) >= self.max_signatures:
+            return True
+        self.counts[signature] = count + 1
+        return count < self.budget
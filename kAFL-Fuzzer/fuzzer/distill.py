@@ -0,0 +1,143 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Periodic corpus distillation (min-set) for the Master queue.
+
+The coverage of all regular nodes is kept in a native min-set (native/minset.c).
+A background thread recomputes the smallest-weight set of nodes that still
+covers all of it, with node weight = exec time x payload size. Nodes outside
+that set are redundant and demoted by the queue to a cold tier, which is not
+scheduled. Nodes enter the min-set again when later results favor them.
+"""
+
+import ctypes
+import inspect
+import os
+import queue
+import re
+import threading
+import time
+
+from common.debug import log_master
+
+native_so = ctypes.CDLL(
+    os.path.dirname(os.path.abspath(inspect.getfile(inspect.currentframe()))) + '/native/minset.so')
+native_so.minset_new.argtypes = [ctypes.c_size_t]
+native_so.minset_new.restype = ctypes.c_void_p
+native_so.minset_free.argtypes = [ctypes.c_void_p]
+native_so.minset_add.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_double]
+native_so.minset_add.restype = ctypes.c_int64
+native_so.minset_set_weight.argtypes = [ctypes.c_void_p, ctypes.c_uint32, ctypes.c_double]
+native_so.minset_size.argtypes = [ctypes.c_void_p]
+native_so.minset_size.restype = ctypes.c_size_t
+native_so.minset_capacity.argtypes = [ctypes.c_void_p]
+native_so.minset_capacity.restype = ctypes.c_size_t
+native_so.minset_memory.argtypes = [ctypes.c_void_p]
+native_so.minset_memory.restype = ctypes.c_size_t
+native_so.minset_compute.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+native_so.minset_compute.restype = ctypes.c_int64
+
+KEEP = re.compile(b'\x01')
+
+
+def node_weight(performance, payload_len):
+    return performance * max(payload_len, 1)
+
+
+class MinSet:
+    """ Node coverage features and weights, see native/minset.c """
+
+    def __init__(self, bitmap_size):
+        self.bitmap_size = bitmap_size
+        self.minset = native_so.minset_new(bitmap_size)
+        if not self.minset:
+            raise MemoryError("minset_new")
+
+    def __del__(self):
+        if self.minset:
+            native_so.minset_free(self.minset)
+
+    def __len__(self):
+        return native_so.minset_size(self.minset)
+
+    def add(self, nid, bitmap, weight):
+        """ Add a node by its bucketized bitmap, returns its number of features """
+        count = native_so.minset_add(self.minset, nid, bytes(bitmap), len(bitmap), weight)
+        if count < 0:
+            raise MemoryError("minset_add")
+        return count
+
+    def set_weight(self, nid, weight):
+        native_so.minset_set_weight(self.minset, nid, weight)
+
+    def memory(self):
+        return native_so.minset_memory(self.minset)
+
+    def compute(self):
+        """ Ids of the nodes in the min-set. The GIL is released while computing. """
+        size = native_so.minset_capacity(self.minset)
+        keep = ctypes.create_string_buffer(size)
+        if native_so.minset_compute(self.minset, keep, size) < 0:
+            raise MemoryError("minset_compute")
+        return [m.start() for m in KEEP.finditer(keep.raw)]
+
+
+class CorpusDistiller:
+    """
+    Background min-set computation. New nodes and weight updates are queued
+    by the Master's workers, results are picked up by the dispatch loop.
+    """
+
+    def __init__(self, bitmap_size, interval):
+        self.minset = MinSet(bitmap_size)
+        self.interval = interval
+        self.ids = set()
+        self.dirty = False
+        self.last = time.time()
+        self.jobs = queue.SimpleQueue()
+        self.results = queue.SimpleQueue()
+        self.thread = threading.Thread(target=self.__loop, name="master-distill", daemon=True)
+        self.thread.start()
+
+    def add(self, nid, bitmap, weight):
+        self.jobs.put((nid, bitmap, weight))
+
+    def set_weight(self, nid, weight):
+        self.jobs.put((nid, None, weight))
+
+    def get_cold(self):
+        """ Ids of nodes outside the latest min-set, or None if there is no new result """
+        cold = None
+        while True:
+            try:
+                cold = self.results.get_nowait()
+            except queue.Empty:
+                return cold
+
+    def distill(self):
+        start = time.time()
+        ids = set(self.ids)
+        kept = self.minset.compute()
+        cold = ids.difference(kept)
+        log_master("Distilled %d nodes to %d in %.2fs (%d MB)" % (
+            len(ids), len(kept), time.time() - start, self.minset.memory() >> 20))
+        return cold
+
+    def __loop(self):
+        while True:
+            timeout = max(0.1, self.last + self.interval - time.time())
+            try:
+                nid, bitmap, weight = self.jobs.get(timeout=timeout)
+                if bitmap is None:
+                    self.minset.set_weight(nid, weight)
+                elif self.minset.add(nid, bitmap, weight):
+                    self.ids.add(nid)
+                self.dirty = True
+            except queue.Empty:
+                pass
+
+            if self.dirty and time.time() - self.last >= self.interval:
+                self.results.put(self.distill())
+                self.dirty = False
+                self.last = time.time()
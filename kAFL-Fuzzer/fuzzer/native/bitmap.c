@@ -55,6 +55,23 @@ uint64_t are_new_bits_present_do_apply_lut(uint8_t* bitmap, uint8_t* new_bitmap,
   return (uint64_t)((byte_count << 32) + (bit_count));
 }
 
+/**
+ * @brief Hash of the edges in a crash bitmap that are not in a baseline bitmap.
+ * These are typically the faulting edge and the error path, while the rest of
+ * the coverage differs between inputs that trigger the same bug. The baseline
+ * must not change, or signatures of the same crash drift apart.
+ * @return 64-bit FNV-1a hash over the indices of these edges.
+ */
+uint64_t crash_edge_signature(uint8_t* baseline_bitmap, uint8_t* crash_bitmap, uint64_t bitmap_size) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (uint64_t i = 0; i < bitmap_size; i++) {
+    if (crash_bitmap[i] && !baseline_bitmap[i]) {
+      hash = (hash ^ i) * 0x100000001b3ULL;
+    }
+  }
+  return hash;
+}
+
 uint64_t are_new_bits_present_no_apply_lut(uint8_t* bitmap, uint8_t* new_bitmap, uint64_t bitmap_size) {
   uint64_t bit_count = 0;
   uint64_t byte_count = 0;
@@ -72,6 +89,23 @@ uint64_t are_new_bits_present_no_apply_lut(uint8_t* bitmap, uint8_t* new_bitmap,
   return (uint64_t)((byte_count << 32) + (bit_count));
 }
 
+/**
+ * @brief Checks if a bucketed bitmap still has all expected entries.
+ * @param bitmap A bitmap from a recent run, with bucket_lut applied.
+ * @param indices Offsets of the expected entries.
+ * @param values Expected bucket values at these offsets.
+ * @param num Number of expected entries.
+ * @return true if bitmap[indices[i]] == values[i] for all entries.
+ */
+bool are_bits_still_set(uint8_t* bitmap, uint32_t* indices, uint8_t* values, uint64_t num) {
+  for (uint64_t i = 0; i < num; i++) {
+    if (bitmap[indices[i]] != values[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
 void update_global_bitmap(uint8_t* bitmap, uint8_t* new_bitmap, uint64_t bitmap_size) {
   for (uint64_t i = 0; i < bitmap_size; i++) {
         bitmap[i] |= new_bitmap[i];
@@ -0,0 +1,551 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Grimoire input generalization, input/token store and havoc mutators.
+ *
+ * A generalized input is an array of uint16_t elements, each either a byte
+ * value (0-255) or GRIMOIRE_GAP. A generalization pass first computes all
+ * candidate cuts [start, end) of the current input, then renders them in
+ * batches to concrete payloads for execution. Accepted cuts are turned into
+ * gaps and runs of gaps are collapsed at the end of the pass.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GRIMOIRE_GAP 0x100
+
+static int all_gaps(const uint16_t* elems, size_t start, size_t end) {
+	for (size_t i = start; i < end; i++) {
+		if (elems[i] != GRIMOIRE_GAP) {
+			return 0;
+		}
+	}
+	return 1;
+}
+
+/**
+ * @brief Cuts of fixed size: [0, step), [step, 2*step), ...
+ * Cuts covering only gaps would not change the payload and are skipped.
+ * @return Number of cuts written to starts/ends (at most len).
+ */
+size_t grimoire_cuts_fixed(const uint16_t* elems, size_t len, size_t step, uint32_t* starts, uint32_t* ends) {
+	size_t num = 0;
+	for (size_t i = 0; i < len; i += step) {
+		size_t end = (i + step < len) ? i + step : len;
+		if (all_gaps(elems, i, end)) {
+			continue;
+		}
+		starts[num] = i;
+		ends[num] = end;
+		num++;
+	}
+	return num;
+}
+
+/**
+ * @brief Cuts ending after each occurrence of split, the last one ends at len.
+ * Cuts covering only gaps are skipped.
+ * @return Number of cuts written to starts/ends (at most len).
+ */
+size_t grimoire_cuts_split(const uint16_t* elems, size_t len, uint8_t split, uint32_t* starts, uint32_t* ends) {
+	size_t num = 0;
+	size_t index = 0;
+	while (index < len) {
+		size_t resume = index;
+		while (resume < len && elems[resume] != split) {
+			resume++;
+		}
+		if (resume < len) {
+			resume++;
+		}
+		if (!all_gaps(elems, index, resume)) {
+			starts[num] = index;
+			ends[num] = resume;
+			num++;
+		}
+		index = resume;
+	}
+	return num;
+}
+
+/**
+ * @brief Find the next opening char at or after index and all possible closure
+ * ends after it, from the outermost (largest) to the innermost.
+ * @param start Position of the opening char, or len if there is none.
+ * @return Number of endings written (at most len).
+ */
+size_t grimoire_closure(const uint16_t* elems, size_t len, size_t index, uint8_t opening, uint8_t closing,
+		uint32_t* start, uint32_t* endings) {
+	size_t num = 0;
+	while (index < len && elems[index] != opening) {
+		index++;
+	}
+	*start = index;
+	for (size_t i = len; i > index + 1; i--) {
+		if (elems[i - 1] == closing) {
+			endings[num++] = i;
+		}
+	}
+	return num;
+}
+
+/**
+ * @brief Render the input once per cut, leaving out gaps and the cut range.
+ * @param out Output buffer of at least num * len bytes, payloads are stored back to back.
+ * @param out_lens Length of each rendered payload.
+ * @return Total number of bytes written to out.
+ */
+size_t grimoire_render(const uint16_t* elems, size_t len, const uint32_t* starts, const uint32_t* ends, size_t num,
+		uint8_t* out, uint32_t* out_lens) {
+	uint8_t* pos = out;
+	for (size_t c = 0; c < num; c++) {
+		uint8_t* begin = pos;
+		for (size_t i = 0; i < len; i++) {
+			if (i == starts[c]) {
+				i = ends[c];
+				if (i >= len) {
+					break;
+				}
+			}
+			if (elems[i] != GRIMOIRE_GAP) {
+				*pos++ = elems[i];
+			}
+		}
+		out_lens[c] = pos - begin;
+	}
+	return pos - out;
+}
+
+/**
+ * @brief Replace all elements covered by an accepted cut with gaps.
+ */
+void grimoire_apply(uint16_t* elems, const uint32_t* starts, const uint32_t* ends, const uint8_t* accepted, size_t num) {
+	for (size_t c = 0; c < num; c++) {
+		if (!accepted[c]) {
+			continue;
+		}
+		for (size_t i = starts[c]; i < ends[c]; i++) {
+			elems[i] = GRIMOIRE_GAP;
+		}
+	}
+}
+
+/**
+ * @brief Collapse runs of gaps into a single gap, in place.
+ * @return New number of elements.
+ */
+size_t grimoire_trim(uint16_t* elems, size_t len) {
+	size_t out = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (elems[i] == GRIMOIRE_GAP && out > 0 && elems[out - 1] == GRIMOIRE_GAP) {
+			continue;
+		}
+		elems[out++] = elems[i];
+	}
+	return out;
+}
+
+/*
+ * Store of generalized inputs or tokens.
+ *
+ * Entries are interned in a single arena of elements and deduplicated with an
+ * open addressing hash table. Each entry costs 16 bytes of metadata, a few
+ * bytes of table and 2 bytes per element, and can be picked at random in O(1).
+ */
+
+typedef struct {
+	uint32_t offset;
+	uint32_t len;
+	uint32_t count;
+	uint32_t hash;
+} grimoire_entry_t;
+
+typedef struct {
+	uint16_t* arena;
+	size_t arena_len;
+	size_t arena_cap;
+	grimoire_entry_t* entries;
+	size_t num;
+	size_t cap;
+	uint32_t* table;	/* entry index + 1, 0 marks a free slot */
+	size_t table_size;	/* power of two */
+	size_t max_len;
+} grimoire_store_t;
+
+static uint32_t hash_elems(const uint16_t* elems, size_t len) {
+	uint32_t hash = 2166136261u;
+	for (size_t i = 0; i < len; i++) {
+		hash = (hash ^ (elems[i] & 0xff)) * 16777619u;
+		hash = (hash ^ (elems[i] >> 8)) * 16777619u;
+	}
+	return hash;
+}
+
+static int grow(void** ptr, size_t* cap, size_t needed, size_t elem_size) {
+	size_t new_cap = *cap ? *cap : 64;
+	void* new_ptr;
+
+	if (needed <= *cap) {
+		return 1;
+	}
+	while (new_cap < needed) {
+		new_cap *= 2;
+	}
+	new_ptr = realloc(*ptr, new_cap * elem_size);
+	if (!new_ptr) {
+		return 0;
+	}
+	*ptr = new_ptr;
+	*cap = new_cap;
+	return 1;
+}
+
+static int rehash(grimoire_store_t* s, size_t table_size) {
+	uint32_t* table = calloc(table_size, sizeof(uint32_t));
+	if (!table) {
+		return 0;
+	}
+	for (size_t i = 0; i < s->num; i++) {
+		size_t slot = s->entries[i].hash & (table_size - 1);
+		while (table[slot]) {
+			slot = (slot + 1) & (table_size - 1);
+		}
+		table[slot] = i + 1;
+	}
+	free(s->table);
+	s->table = table;
+	s->table_size = table_size;
+	return 1;
+}
+
+/* slot holding elems, or the free slot where they belong */
+static size_t lookup(const grimoire_store_t* s, const uint16_t* elems, size_t len, uint32_t hash) {
+	size_t slot = hash & (s->table_size - 1);
+	while (s->table[slot]) {
+		const grimoire_entry_t* e = &s->entries[s->table[slot] - 1];
+		if (e->hash == hash && e->len == len && !memcmp(s->arena + e->offset, elems, len * sizeof(uint16_t))) {
+			break;
+		}
+		slot = (slot + 1) & (s->table_size - 1);
+	}
+	return slot;
+}
+
+grimoire_store_t* grimoire_store_new(void) {
+	grimoire_store_t* s = calloc(1, sizeof(grimoire_store_t));
+	if (s && !rehash(s, 1024)) {
+		free(s);
+		return NULL;
+	}
+	return s;
+}
+
+void grimoire_store_free(grimoire_store_t* s) {
+	if (!s) {
+		return;
+	}
+	free(s->arena);
+	free(s->entries);
+	free(s->table);
+	free(s);
+}
+
+/**
+ * @brief Add an entry or count another occurrence of it.
+ * @return Number of occurrences including this one, 0 if out of memory.
+ */
+uint32_t grimoire_store_add(grimoire_store_t* s, const uint16_t* elems, size_t len) {
+	uint32_t hash = hash_elems(elems, len);
+	size_t slot = lookup(s, elems, len, hash);
+	grimoire_entry_t* e;
+
+	if (s->table[slot]) {
+		return ++s->entries[s->table[slot] - 1].count;
+	}
+
+	if (!grow((void**)&s->arena, &s->arena_cap, s->arena_len + len, sizeof(uint16_t)) ||
+		!grow((void**)&s->entries, &s->cap, s->num + 1, sizeof(grimoire_entry_t))) {
+		return 0;
+	}
+
+	e = &s->entries[s->num];
+	e->offset = s->arena_len;
+	e->len = len;
+	e->count = 1;
+	e->hash = hash;
+	memcpy(s->arena + s->arena_len, elems, len * sizeof(uint16_t));
+	s->arena_len += len;
+	s->table[slot] = ++s->num;
+	if (len > s->max_len) {
+		s->max_len = len;
+	}
+
+	/* keep the load factor below 1/2 */
+	if (2 * s->num > s->table_size && !rehash(s, 2 * s->table_size)) {
+		return 0;
+	}
+	return 1;
+}
+
+/**
+ * @brief Number of occurrences of an entry, 0 if it is not stored.
+ */
+uint32_t grimoire_store_count(const grimoire_store_t* s, const uint16_t* elems, size_t len) {
+	size_t slot = lookup(s, elems, len, hash_elems(elems, len));
+	return s->table[slot] ? s->entries[s->table[slot] - 1].count : 0;
+}
+
+size_t grimoire_store_size(const grimoire_store_t* s) {
+	return s->num;
+}
+
+/**
+ * @brief Elements of entry index, its length is written to len.
+ */
+const uint16_t* grimoire_store_entry(const grimoire_store_t* s, size_t index, size_t* len) {
+	*len = s->entries[index].len;
+	return s->arena + s->entries[index].offset;
+}
+
+/**
+ * @brief Bytes of heap memory used by the store.
+ */
+size_t grimoire_store_memory(const grimoire_store_t* s) {
+	return sizeof(*s) + s->arena_cap * sizeof(uint16_t) + s->cap * sizeof(grimoire_entry_t) +
+		s->table_size * sizeof(uint32_t);
+}
+
+/*
+ * Grimoire havoc mutators.
+ *
+ * Mutators work on buffers of cap elements allocated once per mutator and
+ * render their result to the out buffer. Results that would not fit are cut
+ * short: recursive replacement stops early, string replacement truncates.
+ */
+
+#define GRIMOIRE_CHOOSE_SUBINPUT 50
+#define GRIMOIRE_MAX_RECURSIVE (64 << 10)
+
+typedef struct {
+	uint64_t rng;
+	size_t cap;
+	uint16_t* cur;
+	uint16_t* next;
+	uint16_t* tmp;
+	uint8_t* out;
+} grimoire_mutator_t;
+
+grimoire_mutator_t* grimoire_mutator_new(size_t cap) {
+	grimoire_mutator_t* m = calloc(1, sizeof(grimoire_mutator_t));
+	if (!m) {
+		return NULL;
+	}
+	m->cap = cap;
+	m->cur = malloc(cap * sizeof(uint16_t));
+	m->next = malloc(cap * sizeof(uint16_t));
+	m->tmp = malloc(cap * sizeof(uint16_t));
+	m->out = malloc(cap);
+	if (!m->cur || !m->next || !m->tmp || !m->out) {
+		free(m->cur);
+		free(m->next);
+		free(m->tmp);
+		free(m->out);
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+void grimoire_mutator_free(grimoire_mutator_t* m) {
+	if (!m) {
+		return;
+	}
+	free(m->cur);
+	free(m->next);
+	free(m->tmp);
+	free(m->out);
+	free(m);
+}
+
+void grimoire_mutator_seed(grimoire_mutator_t* m, uint64_t seed) {
+	m->rng = seed;
+}
+
+const uint8_t* grimoire_mutator_out(const grimoire_mutator_t* m) {
+	return m->out;
+}
+
+/* splitmix64, returns 0 <= n < limit */
+static uint32_t rnd(grimoire_mutator_t* m, uint32_t limit) {
+	uint64_t z = (m->rng += 0x9e3779b97f4a7c15ull);
+	if (!limit) {
+		return 0;
+	}
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+	z ^= z >> 31;
+	return (uint32_t)(((z >> 32) * limit) >> 32);
+}
+
+static size_t count_gaps(const uint16_t* elems, size_t len) {
+	size_t gaps = 0;
+	for (size_t i = 0; i < len; i++) {
+		gaps += (elems[i] == GRIMOIRE_GAP);
+	}
+	return gaps;
+}
+
+static size_t nth_gap(const uint16_t* elems, size_t n) {
+	size_t i = 0;
+	for (;; i++) {
+		if (elems[i] == GRIMOIRE_GAP && !n--) {
+			return i;
+		}
+	}
+}
+
+/* copy a random entry to out with a gap on both ends */
+static size_t random_padded(grimoire_mutator_t* m, const grimoire_store_t* s, uint16_t* out) {
+	const uint16_t* elems = NULL;
+	size_t len = 0;
+	size_t pos = 0;
+
+	if (s->num) {
+		elems = grimoire_store_entry(s, rnd(m, s->num), &len);
+		if (len + 2 > m->cap) {
+			len = 0;
+		}
+	}
+	if (!len || elems[0] != GRIMOIRE_GAP) {
+		out[pos++] = GRIMOIRE_GAP;
+	}
+	if (len) {
+		memcpy(out + pos, elems, len * sizeof(uint16_t));
+		pos += len;
+		if (elems[len - 1] != GRIMOIRE_GAP) {
+			out[pos++] = GRIMOIRE_GAP;
+		}
+	}
+	return pos;
+}
+
+/* random input, subinput between two gaps or token, padded with gaps */
+static size_t random_generalized(grimoire_mutator_t* m, const grimoire_store_t* inputs,
+		const grimoire_store_t* tokens, uint16_t* out) {
+	size_t len = random_padded(m, inputs, out);
+
+	if (rnd(m, 100) > GRIMOIRE_CHOOSE_SUBINPUT) {
+		if (rnd(m, 100) < 50) {
+			size_t gaps = count_gaps(out, len);
+			size_t a = nth_gap(out, rnd(m, gaps));
+			size_t b = nth_gap(out, rnd(m, gaps));
+			size_t lo = a < b ? a : b;
+			size_t hi = a < b ? b : a;
+			memmove(out, out + lo, (hi - lo + 1) * sizeof(uint16_t));
+			len = hi - lo + 1;
+		} else {
+			len = random_padded(m, tokens, out);
+		}
+	}
+	return len;
+}
+
+static size_t render(const uint16_t* elems, size_t len, uint8_t* out) {
+	size_t pos = 0;
+	for (size_t i = 0; i < len; i++) {
+		if (elems[i] != GRIMOIRE_GAP) {
+			out[pos++] = elems[i];
+		}
+	}
+	return pos;
+}
+
+/**
+ * @brief Render a random generalized input, subinput or token to out.
+ * @return Number of bytes written to out.
+ */
+size_t grimoire_random_payload(grimoire_mutator_t* m, const grimoire_store_t* inputs, const grimoire_store_t* tokens) {
+	return render(m->tmp, random_generalized(m, inputs, tokens, m->tmp), m->out);
+}
+
+/**
+ * @brief Replace up to depth random gaps of elems with random generalized inputs
+ * and render the result to out.
+ * @return Number of bytes written to out.
+ */
+size_t grimoire_recursive_replacement(grimoire_mutator_t* m, const grimoire_store_t* inputs,
+		const grimoire_store_t* tokens, const uint16_t* elems, size_t len, size_t depth) {
+	uint16_t* swap;
+
+	if (len > m->cap) {
+		len = m->cap;
+	}
+	memcpy(m->cur, elems, len * sizeof(uint16_t));
+
+	for (size_t d = 0; d < depth && len < GRIMOIRE_MAX_RECURSIVE; d++) {
+		size_t gaps = count_gaps(m->cur, len);
+		size_t index, rlen;
+
+		if (!gaps) {
+			break;
+		}
+		index = nth_gap(m->cur, rnd(m, gaps));
+		rlen = random_generalized(m, inputs, tokens, m->tmp);
+		if (len - 1 + rlen > m->cap) {
+			break;
+		}
+
+		memcpy(m->next, m->cur, index * sizeof(uint16_t));
+		memcpy(m->next + index, m->tmp, rlen * sizeof(uint16_t));
+		memcpy(m->next + index + rlen, m->cur + index + 1, (len - index - 1) * sizeof(uint16_t));
+		len = len - 1 + rlen;
+
+		swap = m->cur;
+		m->cur = m->next;
+		m->next = swap;
+	}
+	return render(m->cur, len, m->out);
+}
+
+static size_t append(grimoire_mutator_t* m, size_t pos, const uint8_t* data, size_t len) {
+	if (pos + len > m->cap) {
+		len = m->cap - pos;
+	}
+	memcpy(m->out + pos, data, len);
+	return pos + len;
+}
+
+/**
+ * @brief Replace payload[start:end] with repl, or all non-overlapping
+ * occurrences of it if all is set, and write the result to out.
+ * @return Number of bytes written to out.
+ */
+size_t grimoire_replace(grimoire_mutator_t* m, const uint8_t* payload, size_t len, size_t start, size_t end,
+		const uint8_t* repl, size_t repl_len, int all) {
+	const uint8_t* needle = payload + start;
+	size_t needle_len = end - start;
+	size_t pos = 0;
+	size_t copied = 0;
+
+	if (!all || !needle_len) {
+		pos = append(m, pos, payload, start);
+		pos = append(m, pos, repl, repl_len);
+		return append(m, pos, payload + end, len - end);
+	}
+
+	for (size_t i = 0; i + needle_len <= len;) {
+		if (payload[i] == needle[0] && !memcmp(payload + i, needle, needle_len)) {
+			pos = append(m, pos, payload + copied, i - copied);
+			pos = append(m, pos, repl, repl_len);
+			i += needle_len;
+			copied = i;
+		} else {
+			i++;
+		}
+	}
+	return append(m, pos, payload + copied, len - copied);
+}
@@ -0,0 +1,286 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: AGPL-3.0-or-later
+ *
+ * Corpus min-set (distillation) over the bitmaps of all queue nodes.
+ *
+ * Each node is reduced to its coverage features, i.e. (bitmap index, hit
+ * count bucket) pairs, and a weight (exec time x payload size). The min-set
+ * is a greedy weighted set cover: repeatedly take the node with the lowest
+ * weight per feature not covered yet. Nodes are keyed lazily in a min-heap,
+ * a node's key is only recomputed when it reaches the top of the heap.
+ */
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+	uint64_t offset;	/* first feature in the arena */
+	uint32_t count;		/* 0 if the id is unused */
+	double weight;
+} minset_node_t;
+
+typedef struct {
+	double key;		/* weight per uncovered feature */
+	uint32_t id;
+} minset_heap_t;
+
+typedef struct {
+	uint32_t* arena;
+	size_t arena_num;
+	size_t arena_cap;
+	size_t arena_unused;	/* features of replaced nodes, reclaimed by compact() */
+	minset_node_t* nodes;	/* indexed by node id */
+	size_t nodes_cap;
+	size_t num;
+	uint8_t* covered;	/* bitset over all features */
+	size_t num_features;
+	minset_heap_t* heap;
+	size_t heap_cap;
+} minset_t;
+
+static int grow(void** ptr, size_t* cap, size_t needed, size_t elem_size) {
+	size_t new_cap = *cap ? *cap : 64;
+	void* new_ptr;
+
+	if (needed <= *cap) {
+		return 1;
+	}
+	while (new_cap < needed) {
+		new_cap *= 2;
+	}
+	new_ptr = realloc(*ptr, new_cap * elem_size);
+	if (!new_ptr) {
+		return 0;
+	}
+	memset((char*)new_ptr + *cap * elem_size, 0, (new_cap - *cap) * elem_size);
+	*ptr = new_ptr;
+	*cap = new_cap;
+	return 1;
+}
+
+minset_t* minset_new(size_t bitmap_size) {
+	minset_t* m = calloc(1, sizeof(minset_t));
+	if (!m) {
+		return NULL;
+	}
+	m->num_features = bitmap_size * 8;
+	m->covered = calloc(m->num_features / 8, 1);
+	if (!m->covered) {
+		free(m);
+		return NULL;
+	}
+	return m;
+}
+
+void minset_free(minset_t* m) {
+	if (!m) {
+		return;
+	}
+	free(m->arena);
+	free(m->nodes);
+	free(m->covered);
+	free(m->heap);
+	free(m);
+}
+
+/*
+ * Move the features of all nodes but skip to a new arena with room for extra
+ * more, dropping those of replaced nodes.
+ */
+static int compact(minset_t* m, uint32_t skip, size_t extra) {
+	size_t cap = m->arena_num - m->arena_unused - m->nodes[skip].count + extra;
+	uint32_t* arena = malloc((cap ? cap : 1) * sizeof(*arena));
+	size_t num = 0;
+
+	if (!arena) {
+		return 0;
+	}
+	for (uint32_t id = 0; id < m->nodes_cap; id++) {
+		minset_node_t* node = &m->nodes[id];
+		if (id == skip) {
+			continue;
+		}
+		memcpy(arena + num, m->arena + node->offset, node->count * sizeof(uint32_t));
+		node->offset = num;
+		num += node->count;
+	}
+	free(m->arena);
+	m->arena = arena;
+	m->arena_num = num;
+	m->arena_cap = cap;
+	m->arena_unused = 0;
+	return 1;
+}
+
+/**
+ * @brief Add node id with the features of its (bucketized) bitmap.
+ * Adding an id again replaces its features, in place if they still fit.
+ * @return Number of features of the node, or -1 if out of memory.
+ */
+int64_t minset_add(minset_t* m, uint32_t id, const uint8_t* bitmap, size_t bitmap_size, double weight) {
+	minset_node_t* node;
+	uint32_t* features;
+	uint32_t old;
+	size_t count = 0;
+
+	if (bitmap_size * 8 > m->num_features) {
+		bitmap_size = m->num_features / 8;
+	}
+	if (!grow((void**)&m->nodes, &m->nodes_cap, (size_t)id + 1, sizeof(minset_node_t))) {
+		return -1;
+	}
+	for (size_t i = 0; i < bitmap_size; i++) {
+		count += bitmap[i] != 0;
+	}
+
+	node = &m->nodes[id];
+	old = node->count;
+	if (count > old) {
+		/* the old features no longer fit and become unused */
+		if (m->arena_unused + old > m->arena_num / 2) {
+			if (!compact(m, id, count)) {
+				return -1;
+			}
+		} else {
+			if (!grow((void**)&m->arena, &m->arena_cap, m->arena_num + count, sizeof(uint32_t))) {
+				return -1;
+			}
+			m->arena_unused += old;
+		}
+		node->offset = m->arena_num;
+		m->arena_num += count;
+	} else {
+		m->arena_unused += old - count;
+	}
+
+	if (!old && count) {
+		m->num++;
+	} else if (old && !count) {
+		m->num--;
+	}
+	node->count = count;
+	node->weight = weight;
+
+	features = m->arena + node->offset;
+	for (size_t i = 0; i < bitmap_size; i++) {
+		if (bitmap[i]) {
+			/* highest bucket bit, buckets are single bits once the lut is applied */
+			*features++ = i * 8 + (31 - __builtin_clz(bitmap[i]));
+		}
+	}
+	return count;
+}
+
+void minset_set_weight(minset_t* m, uint32_t id, double weight) {
+	if (id < m->nodes_cap) {
+		m->nodes[id].weight = weight;
+	}
+}
+
+/* number of nodes with at least one feature */
+size_t minset_size(const minset_t* m) {
+	return m->num;
+}
+
+size_t minset_memory(const minset_t* m) {
+	return sizeof(minset_t) + m->arena_cap * sizeof(uint32_t) + m->nodes_cap * sizeof(minset_node_t) +
+	       m->num_features / 8 + m->heap_cap * sizeof(minset_heap_t);
+}
+
+static int heap_less(const minset_heap_t* a, const minset_heap_t* b) {
+	return a->key < b->key || (a->key == b->key && a->id < b->id);
+}
+
+static void sift_down(minset_heap_t* heap, size_t num, size_t pos) {
+	minset_heap_t item = heap[pos];
+	while (2 * pos + 1 < num) {
+		size_t child = 2 * pos + 1;
+		if (child + 1 < num && heap_less(&heap[child + 1], &heap[child])) {
+			child++;
+		}
+		if (!heap_less(&heap[child], &item)) {
+			break;
+		}
+		heap[pos] = heap[child];
+		pos = child;
+	}
+	heap[pos] = item;
+}
+
+static uint32_t uncovered(const minset_t* m, const minset_node_t* node) {
+	const uint32_t* features = m->arena + node->offset;
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < node->count; i++) {
+		count += !(m->covered[features[i] >> 3] & (1 << (features[i] & 7)));
+	}
+	return count;
+}
+
+static double key(const minset_node_t* node, uint32_t count) {
+	return (node->weight > 0 ? node->weight : 0) / count;
+}
+
+/**
+ * @brief Compute the min-set over all nodes added so far.
+ * @param keep Array of at least minset_capacity() bytes, set to 1 for nodes
+ * in the min-set and 0 otherwise.
+ * @return Number of nodes in the min-set, or -1 if out of memory.
+ */
+int64_t minset_compute(minset_t* m, uint8_t* keep, size_t keep_size) {
+	size_t num = 0;
+	int64_t selected = 0;
+
+	if (!grow((void**)&m->heap, &m->heap_cap, m->num, sizeof(minset_heap_t))) {
+		return -1;
+	}
+	memset(m->covered, 0, m->num_features / 8);
+	memset(keep, 0, keep_size);
+
+	for (uint32_t id = 0; id < m->nodes_cap && id < keep_size; id++) {
+		if (m->nodes[id].count) {
+			m->heap[num].key = key(&m->nodes[id], m->nodes[id].count);
+			m->heap[num].id = id;
+			num++;
+		}
+	}
+	for (size_t i = num / 2; i-- > 0;) {
+		sift_down(m->heap, num, i);
+	}
+
+	while (num) {
+		minset_node_t* node = &m->nodes[m->heap[0].id];
+		uint32_t count = uncovered(m, node);
+
+		if (!count) {
+			m->heap[0] = m->heap[--num];
+			sift_down(m->heap, num, 0);
+			continue;
+		}
+
+		/* keys only grow as coverage grows, so an up-to-date key at the top is the minimum */
+		double new_key = key(node, count);
+		if (new_key != m->heap[0].key) {
+			m->heap[0].key = new_key;
+			sift_down(m->heap, num, 0);
+			continue;
+		}
+
+		const uint32_t* features = m->arena + node->offset;
+		for (uint32_t i = 0; i < node->count; i++) {
+			m->covered[features[i] >> 3] |= 1 << (features[i] & 7);
+		}
+		keep[m->heap[0].id] = 1;
+		selected++;
+		m->heap[0] = m->heap[--num];
+		sift_down(m->heap, num, 0);
+	}
+	return selected;
+}
+
+/* size of the keep array needed by minset_compute() */
+size_t minset_capacity(const minset_t* m) {
+	return m->nodes_cap;
+}
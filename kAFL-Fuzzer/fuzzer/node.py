@@ -17,6 +17,8 @@ from common.util import read_binary_file, atomic_write
 
 class QueueNode:
     NextID = 1
+    # Master sets this to an AsyncWriter to keep disk I/O off the dispatch loop
+    writer = None
 
     def __init__(self, payload, bitmap, node_struct, write=True):
         self.node_struct = node_struct
@@ -54,6 +56,16 @@ class QueueNode:
         workdir = FuzzerConfiguration().argument_values['work_dir']
         return workdir + "/metadata/node_%05d" % id
 
+    def get_payload_filename(self):
+        return QueueNode.__get_payload_filename(self.get_exit_reason(), self.get_id())
+
+    @staticmethod
+    def __write(filename, data):
+        if QueueNode.writer:
+            QueueNode.writer.write(filename, data)
+        else:
+            atomic_write(filename, data)
+
     def update_file(self, write=True):
         if write:
             self.write_metadata()
@@ -62,10 +74,10 @@ class QueueNode:
             self.dirty = True
 
     def write_bitmap(self, bitmap):
-        atomic_write(self.__get_bitmap_filename(), lz4.frame.compress(bitmap))
+        QueueNode.__write(self.__get_bitmap_filename(), lz4.frame.compress(bitmap))
 
     def write_metadata(self):
-        return atomic_write(QueueNode.__get_metadata_filename(self.get_id()), msgpack.packb(self.node_struct, use_bin_type=True))
+        return QueueNode.__write(QueueNode.__get_metadata_filename(self.get_id()), msgpack.packb(self.node_struct, use_bin_type=True))
 
     def load_metadata(self):
         QueueNode.get_metadata(self.id)
@@ -95,7 +107,7 @@ class QueueNode:
 
     def set_payload(self, payload, write=True):
         self.set_payload_len(len(payload), write=False)
-        atomic_write(QueueNode.__get_payload_filename(self.get_exit_reason(), self.get_id()), payload)
+        QueueNode.__write(self.get_payload_filename(), payload)
 
     def load_payload(self):
         QueueNode.get_payload(self.get_exit_reason(), self.get_id())
@@ -0,0 +1,100 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Indexed max-heap used by the queue to keep nodes ordered by scheduler priority.
+
+Entries are re-keyed in O(log n) whenever a node changes, so selecting the
+top-k nodes for the next cycle no longer requires sorting the whole queue.
+"""
+
+import heapq
+
+
+class IndexedMaxHeap:
+
+    def __init__(self):
+        self.heap = []      # list of (key, item), max-heap ordered by key
+        self.index = {}     # item -> position in heap
+
+    def __len__(self):
+        return len(self.heap)
+
+    def __contains__(self, item):
+        return item in self.index
+
+    def key(self, item):
+        return self.heap[self.index[item]][0]
+
+    def update(self, item, key):
+        pos = self.index.get(item)
+        if pos is None:
+            self.heap.append((key, item))
+            self.index[item] = len(self.heap) - 1
+            self.__sift_up(len(self.heap) - 1)
+            return
+
+        old_key = self.heap[pos][0]
+        self.heap[pos] = (key, item)
+        if key > old_key:
+            self.__sift_up(pos)
+        elif key < old_key:
+            self.__sift_down(pos)
+
+    def remove(self, item):
+        pos = self.index.pop(item)
+        last = self.heap.pop()
+        if pos == len(self.heap):
+            return
+        self.heap[pos] = last
+        self.index[last[1]] = pos
+        self.__sift_up(pos)
+        self.__sift_down(self.index[last[1]])
+
+    def top(self, k):
+        """ Return up to k items with highest key, in descending order. O(k log k) """
+        result = []
+        if not self.heap:
+            return result
+
+        # best-first walk of the heap tree, candidates are ordered by negated key
+        candidates = [(self.__neg(self.heap[0][0]), 0)]
+        while candidates and len(result) < k:
+            _, pos = heapq.heappop(candidates)
+            result.append(self.heap[pos][1])
+            for child in (2*pos + 1, 2*pos + 2):
+                if child < len(self.heap):
+                    heapq.heappush(candidates, (self.__neg(self.heap[child][0]), child))
+        return result
+
+    @staticmethod
+    def __neg(key):
+        return tuple(-x for x in key)
+
+    def __swap(self, a, b):
+        heap = self.heap
+        heap[a], heap[b] = heap[b], heap[a]
+        self.index[heap[a][1]] = a
+        self.index[heap[b][1]] = b
+
+    def __sift_up(self, pos):
+        heap = self.heap
+        while pos > 0:
+            parent = (pos - 1) // 2
+            if heap[pos][0] <= heap[parent][0]:
+                break
+            self.__swap(pos, parent)
+            pos = parent
+
+    def __sift_down(self, pos):
+        heap = self.heap
+        size = len(heap)
+        while True:
+            largest = pos
+            for child in (2*pos + 1, 2*pos + 2):
+                if child < size and heap[child][0] > heap[largest][0]:
+                    largest = child
+            if largest == pos:
+                break
+            self.__swap(pos, largest)
+            pos = largest
@@ -7,27 +7,29 @@
 kAFL Master Implementation.
 
 Manage overall fuzz inputs/findings and schedule work for Slave instances.
+
+The main loop only dispatches tasks and updates the in-memory queue. Coverage
+accounting of new inputs and all disk I/O are done by background workers.
 """
 
-import glob
 import os
 from   pprint import pformat
 import mmh3
 
 from common.debug import log_master
-from common.util import read_binary_file, print_note
-from common.execution_result import ExecutionResult
+from common.util import print_note
 from fuzzer.communicator import ServerConnection, MSG_NODE_DONE, MSG_NEW_INPUT, MSG_READY
 from fuzzer.queue import InputQueue
 from fuzzer.statistics import MasterStatistics
 from fuzzer.technique.redqueen.cmp import enable_hammering
 from fuzzer.bitmap import BitmapStorage
+from fuzzer.distill import CorpusDistiller
 from fuzzer.node import QueueNode
+from fuzzer.process.master_worker import AsyncWriter, CoverageWorker
 
 # debug
-from debug.log import debug_info, debug_flow
+from debug.log import debug_flow
 from kafl_conf import SHOW_FLOW
-import time
 
 class MasterProcess:
 
@@ -43,6 +45,16 @@ class MasterProcess:
         self.queue = InputQueue(self.config, self.statistics)
         self.bitmap_storage = BitmapStorage(config, config.config_values['BITMAP_SHM_SIZE'], "master", read_only=False)
 
+        self.writer = AsyncWriter()
+        QueueNode.writer = self.writer
+        self.statistics.writer = self.writer
+        self.distiller = None
+        if self.config.argument_values.get('distill'):
+            self.distiller = CorpusDistiller(config.config_values['BITMAP_SHM_SIZE'],
+                                             self.config.argument_values['distill'])
+            self.queue.distiller = self.distiller
+        self.coverage = CoverageWorker(self.config, self.bitmap_storage, self.statistics.write_thres, self.distiller)
+
         if self.config.argument_values['hammer_jmp_tables']:
             enable_hammering()
 
@@ -51,21 +63,23 @@ class MasterProcess:
                 pformat(config.argument_values, indent=4, compact=True))
 
     def send_next_task(self, conn):
-        # Inputs placed to imports/ folder have priority.
-        # This can also be used to inject additional seeds at runtime.
-        imports = glob.glob(self.config.argument_values['work_dir'] + "/imports/*")
-        if imports:
-            path = imports.pop()
-            debug_info("Importing payload from %s" % path)
-            seed = read_binary_file(path)
-            os.remove(path)
+        # Inputs placed to imports/ folder have priority (scanned by the coverage worker)
+        seed = self.coverage.get_import()
+        if seed is not None:
             return self.comm.send_import(conn, {"type": "import", "payload": seed})
         # Process items from queue..
 
+        self.insert_new_nodes()
         node = self.queue.get_next()
 
         if node:
-            return self.comm.send_node(conn, {"type": "node", "nid": node.get_id()})
+            # node files may not be on disk yet - send metadata along and the payload if still pending
+            task = {"type": "node", "nid": node.get_id(), "metadata": node.node_struct,
+                    "havoc_stats": self.statistics.data["havoc"]}
+            payload = self.writer.get_pending(node.get_payload_filename())
+            if payload is not None:
+                task["payload"] = payload
+            return self.comm.send_node(conn, task)
 
         # No work in queue. Tell slave to wait a little or attempt blind fuzzing.
         # If we see a lot of busy events, check the bitmap and warn on coverage issues.
@@ -80,42 +94,42 @@ class MasterProcess:
 
     def loop(self):
         while True:
-            for conn, msg in self.comm.wait(self.statistics.plot_thres):
+            for conn, msg in self.comm.wait(self.statistics.write_thres):
                 if msg["type"] == MSG_NODE_DONE:
                     # Slave execution done, update queue item + send new task
                     log_master("Received results, sending next task..")
                     if msg["node_id"]:
-                        self.queue.update_node_results(msg["node_id"], msg["results"], msg["new_payload"])
+                        self.queue.update_node_results(msg["node_id"], msg["results"], msg["new_payload"],
+                                                       msg.get("new_bitmap"))
+                    if msg.get("havoc_stats"):
+                        self.statistics.event_havoc_stats(msg["havoc_stats"])
                     self.send_next_task(conn)
                 elif msg["type"] == MSG_NEW_INPUT:
                     log_master("Received new input: {}".format(repr(msg["input"]["payload"])))
-                    node_struct = {"info": msg["input"]["info"], "state": {"name": "initial"}}
-                    self.maybe_insert_node(msg["input"]["payload"], msg["input"]["bitmap"], node_struct)
+                    self.coverage.submit(msg)
                 elif msg["type"] == MSG_READY:
                     # Initial slave hello, send first task...
                     # log_master("Slave is ready..")
                     self.send_next_task(conn)
                 else:
                     raise ValueError("unknown message type {}".format(msg))
+            self.coverage.check()
+            self.insert_new_nodes()
             self.statistics.event_slave_poll()
             self.statistics.maybe_write_stats()
 
+    def shutdown(self):
+        # make sure queue and stats on disk are complete
+        self.statistics.write_statistics()
+        self.writer.flush()
+        # slaves are gone, release huge pages held by the global bitmaps
+        self.bitmap_storage.unlink()
+
+    def insert_new_nodes(self):
+        for node, bitmap_entries in self.coverage.get_new_nodes():
+            self.queue.insert_input(node, bitmap_entries)
+        if self.distiller:
+            cold = self.distiller.get_cold()
+            if cold is not None:
+                self.queue.apply_distillation(cold)
 
-    def maybe_insert_node(self, payload, bitmap_array, node_struct):
-        bitmap = ExecutionResult.bitmap_from_bytearray(bitmap_array, node_struct["info"]["exit_reason"],
-                                                       node_struct["info"]["performance"])
-        bitmap.lut_applied = True  # since we received the bitmap from the slave, the lut was already applied
-        backup_data = bitmap.copy_to_array()
-        should_store, new_bytes, new_bits = self.bitmap_storage.should_store_in_queue(bitmap)
-        new_data = bitmap.copy_to_array()
-        if should_store:
-            node = QueueNode(payload, bitmap_array, node_struct, write=False)
-            node.set_new_bytes(new_bytes, write=False)
-            node.set_new_bits(new_bits, write=False)
-            self.queue.insert_input(node, bitmap)
-        else:
-            if node_struct["info"]["exit_reason"] != "regular":
-                log_master("Payload found to be boring, not saved (exit=%s)" % node_struct["info"]["exit_reason"])
-            for i in range(len(bitmap_array)):
-                if backup_data[i] != new_data[i]:
-                    assert(False), "Bitmap mangled at {} {} {}".format(i, repr(backup_data[i]), repr(new_data[i]))
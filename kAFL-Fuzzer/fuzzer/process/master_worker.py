@@ -0,0 +1,172 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Background workers for the kAFL Master.
+
+The Master's dispatch loop only talks to slaves and the in-memory queue. Any
+disk I/O (node metadata, payloads, stats) goes through the AsyncWriter, and
+coverage accounting of new inputs is done by the CoverageWorker. Both are
+fed by queue.SimpleQueue, which needs no Python-level locking. Statistics
+are only updated by the dispatch loop.
+"""
+
+import glob
+import os
+import queue
+import re
+import threading
+import time
+import traceback
+
+from common.debug import log_master
+from common.util import atomic_write, read_binary_file
+from common.execution_result import ExecutionResult
+from fuzzer.distill import node_weight
+from fuzzer.node import QueueNode
+
+# debug
+from debug.log import debug_info
+
+NONZERO = re.compile(b'[^\x00]')
+
+
+class AsyncWriter:
+
+    def __init__(self):
+        self.jobs = queue.SimpleQueue()
+        self.pending = dict()   # filename -> data not yet on disk
+        self.thread = threading.Thread(target=self.__loop, name="master-writer", daemon=True)
+        self.thread.start()
+
+    def write(self, filename, data):
+        self.pending[filename] = data
+        self.jobs.put((filename, data, False))
+
+    def append(self, filename, data):
+        self.jobs.put((filename, data, True))
+
+    def get_pending(self, filename):
+        return self.pending.get(filename, None)
+
+    def flush(self):
+        done = threading.Event()
+        self.jobs.put((None, done, False))
+        done.wait()
+
+    def __loop(self):
+        while True:
+            filename, data, append = self.jobs.get()
+            if filename is None:
+                data.set()
+                continue
+            try:
+                if append:
+                    with open(filename, 'a') as fd:
+                        fd.write(data)
+                else:
+                    atomic_write(filename, data)
+            except OSError as e:
+                log_master("Failed to write %s: %s" % (filename, str(e)))
+            # only drop the entry if it was not replaced by a newer write
+            if not append and self.pending.get(filename) is data:
+                self.pending.pop(filename, None)
+
+
+class CoverageWorker:
+
+    def __init__(self, config, bitmap_storage, poll_interval, distiller=None):
+        self.bitmap_storage = bitmap_storage
+        self.distiller = distiller
+        self.poll_interval = poll_interval
+        self.imports_dir = config.argument_values['work_dir'] + "/imports"
+        self.inputs = queue.SimpleQueue()
+        self.nodes = queue.SimpleQueue()
+        self.imports = queue.SimpleQueue()
+        self.poll_last = 0
+        self.error = None
+        self.thread = threading.Thread(target=self.__loop, name="master-coverage", daemon=True)
+        self.thread.start()
+
+    def submit(self, msg):
+        self.inputs.put(msg)
+
+    # Raise in the dispatch loop if the worker has died, new inputs would be lost otherwise
+    def check(self):
+        if self.error:
+            raise RuntimeError("Coverage worker failed") from self.error
+
+    # Payloads picked up from imports/ folder, or None
+    def get_import(self):
+        try:
+            return self.imports.get_nowait()
+        except queue.Empty:
+            return None
+
+    # Nodes accepted for the queue, to be inserted by the dispatch loop
+    def get_new_nodes(self):
+        nodes = []
+        while True:
+            try:
+                nodes.append(self.nodes.get_nowait())
+            except queue.Empty:
+                return nodes
+
+    def __loop(self):
+        try:
+            self.__run()
+        except Exception as e:
+            log_master("Coverage worker failed:\n%s" % traceback.format_exc())
+            self.error = e
+
+    def __run(self):
+        while True:
+            # poll imports out of band, rate limited as this touches the disk
+            cur_time = time.time()
+            if cur_time - self.poll_last > self.poll_interval:
+                self.poll_last = cur_time
+                if self.imports.empty():
+                    self.__scan_imports()
+
+            try:
+                msg = self.inputs.get(timeout=self.poll_interval)
+            except queue.Empty:
+                continue
+            self.__check_input(msg["input"]["payload"], msg["input"]["bitmap"], msg["input"]["info"])
+
+    def __scan_imports(self):
+        # Inputs placed to imports/ folder have priority.
+        # This can also be used to inject additional seeds at runtime.
+        for path in glob.glob(self.imports_dir + "/*"):
+            try:
+                seed = read_binary_file(path)
+                os.remove(path)
+            except OSError:
+                continue
+            debug_info("Importing payload from %s" % path)
+            self.imports.put(seed)
+
+    def __check_input(self, payload, bitmap_array, info):
+        node_struct = {"info": info, "state": {"name": "initial"}}
+        bitmap = ExecutionResult.bitmap_from_bytearray(bitmap_array, info["exit_reason"], info["performance"])
+        bitmap.lut_applied = True  # since we received the bitmap from the slave, the lut was already applied
+        backup_data = bitmap.copy_to_array()
+        should_store, new_bytes, new_bits = self.bitmap_storage.should_store_in_queue(bitmap)
+        new_data = bitmap.copy_to_array()
+        if should_store:
+            node = QueueNode(payload, bitmap_array, node_struct, write=False)
+            node.set_new_bytes(new_bytes, write=False)
+            node.set_new_bits(new_bits, write=False)
+            # find non-zero bitmap entries here so that fav bit updates in the dispatch loop stay cheap
+            data = bytes(bitmap.cbuffer)
+            entries = [(m.start(), data[m.start()]) for m in NONZERO.finditer(data)]
+            if self.distiller and info["exit_reason"] == "regular":
+                self.distiller.add(node.get_id(), data, node_weight(info["performance"], len(payload)))
+            self.nodes.put((node, entries))
+        else:
+            if info["exit_reason"] != "regular":
+                log_master("Payload found to be boring, not saved (exit=%s)" % info["exit_reason"])
+            if backup_data != new_data:
+                for i in range(len(bitmap_array)):
+                    if backup_data[i] != new_data[i]:
+                        assert(False), "Bitmap mangled at {} {} {}".format(i, repr(backup_data[i]), repr(new_data[i]))
@@ -16,15 +16,18 @@ import time
 import signal
 import sys
 
+import common.placement as placement
 from common.config import FuzzerConfiguration
 from common.debug import log_slave
 from common.qemu import qemu
-from common.util import read_binary_file, atomic_write, print_warning
+from common.util import read_pt_trace_dump, atomic_write, print_warning, PT_TRACE_DUMP_FLAG_DROPPED
 from fuzzer.bitmap import BitmapStorage, GlobalBitmap
 from fuzzer.communicator import ClientConnection, MSG_IMPORT, MSG_RUN_NODE, MSG_BUSY
+from fuzzer.crash_index import CrashIndex
 from fuzzer.node import QueueNode
 from fuzzer.state_logic import FuzzingStateLogic
 from fuzzer.statistics import SlaveStatistics
+import fuzzer.technique.havoc as havoc
 from fuzzer.technique.helper import rand
 
 from kafl_fuzz import PAYQ
@@ -44,10 +47,15 @@ def slave_loader(slave_id):
     # sys.stdout = open("slave_%d.out"%slave_id, "w")
     config = FuzzerConfiguration()
 
-    #if config.argument_values["cpu_affinity"]:
-    #    psutil.Process().cpu_affinity([config.argument_values["cpu_affinity"]])
-    #else:
-    #    psutil.Process().cpu_affinity([slave_id])
+    # pin before Qemu and the shared memory are created, both inherit the node
+    layout = placement.from_config(config)
+    slot = layout.slot(slave_id) if layout else None
+    if slot:
+        os.sched_setaffinity(0, {slot.slave_cpu})
+        try:
+            placement.prefer_node(slot.node)
+        except OSError as e:
+            log_slave("Failed to set NUMA policy: %s" % str(e), slave_id)
 
     connection = ClientConnection(slave_id, config)
 
@@ -78,10 +86,12 @@ class SlaveProcess:
         self.conn = connection
 
         self.bitmap_storage = BitmapStorage(self.config, self.config.config_values['BITMAP_SHM_SIZE'], "master")
+        self.crash_index = CrashIndex()
 
     def handle_import(self, msg):
         meta_data = {"state": {"name": "import"}, "id": 0}
         payload = msg["task"]["payload"]
+        self.q.set_timeout_baseline(0)
         self.logic.process_node(payload, meta_data)
         self.conn.send_ready()
 
@@ -103,14 +113,22 @@ class SlaveProcess:
         self.conn.send_ready()
 
     def handle_node(self, msg):
-        meta_data = QueueNode.get_metadata(msg["task"]["nid"])
-        payload = QueueNode.get_payload(meta_data["info"]["exit_reason"], meta_data["id"])
-
+        # Master sends node metadata (and payload, if not yet written) along with the task
+        meta_data = msg["task"].get("metadata") or QueueNode.get_metadata(msg["task"]["nid"])
+        if msg["task"].get("havoc_stats"):
+            havoc.get_scheduler().set_global(msg["task"]["havoc_stats"])
+        payload = msg["task"].get("payload")
+        if payload is None:
+            payload = QueueNode.get_payload(meta_data["info"]["exit_reason"], meta_data["id"])
+
+        self.q.set_timeout_baseline(meta_data.get("performance", 0))
         results, new_payload = self.logic.process_node(payload, meta_data)
 
+        new_bitmap = None
         if new_payload:
             default_info = {"method": "validate_bits", "parent": meta_data["id"]}
-            if self.validate_bits(new_payload, meta_data, default_info):
+            new_bitmap = self.validate_bits(new_payload, meta_data, default_info)
+            if new_bitmap is not None:
                 """ log_slave("Stage %s found alternative payload for node %d"
                           % (meta_data["state"]["name"], meta_data["id"]),
                           self.slave_id) """
@@ -126,7 +144,7 @@ class SlaveProcess:
                         % meta_data["state"]["name"])
                 time.sleep(5)
 
-        self.conn.send_node_done(meta_data["id"], results, new_payload)
+        self.conn.send_node_done(meta_data["id"], results, new_payload, havoc.get_scheduler().share(), new_bitmap)
 
     def loop(self):
         if not self.q.start():
@@ -171,13 +189,18 @@ class SlaveProcess:
         return False, None
 
     def validate_bits(self, data, old_node, default_info):
+        """ Bucketized bitmap of the alternative payload data, or None if it lost any of the node's new bits """
         new_bitmap, _ = self.execute(data, default_info)
         # handle non-det inputs
         if new_bitmap is None:
-            return False
+            return None
+        if not new_bitmap.is_lut_applied():
+            new_bitmap.apply_lut()
         old_bits = old_node["new_bytes"].copy()
         old_bits.update(old_node["new_bits"])
-        return GlobalBitmap.all_new_bits_still_set(old_bits, new_bitmap)
+        if not GlobalBitmap.all_new_bits_still_set(old_bits, new_bitmap):
+            return None
+        return bytes(new_bitmap.cbuffer)
 
     def validate_bytes(self, data, old_node, default_info):
         new_bitmap, _ = self.execute(data, default_info)
@@ -191,11 +214,16 @@ class SlaveProcess:
         self.statistics.event_exec_redqueen()
         return self.q.execute_in_redqueen_mode(data)
 
+    def execute_redqueen_batch(self, payloads, collect):
+        for _ in payloads:
+            self.statistics.event_exec_redqueen()
+        return self.q.execute_in_redqueen_mode_batch(payloads, collect)
+
     def __execute(self, data, retry=0):
 
         try:
             self.q.set_payload(data)
-            if False:  # activate detailed comparison of execution traces?
+            if self.config.argument_values['trace_pt']:
                 return self.check_funkyness_and_store_trace(data)
             else:
                 return self.q.send_payload()
@@ -221,21 +249,43 @@ class SlaveProcess:
         if self.conn is not None:
             self.conn.send_new_input(data, execution_res.copy_to_array(), info)
 
+    def __last_traces(self, num):
+        # complete and intact traces of the last num execs, or None
+        # Qemu archives traces asynchronously, flush to get the latest ones
+        self.q.flush_trace_dump()
+        traces = list()
+        for filename in [self.q.tracedump_filename, self.q.tracedump_filename + ".1"]:
+            try:
+                traces = read_pt_trace_dump(filename) + traces
+            except OSError:
+                pass
+            if len(traces) >= num:
+                break
+        traces = traces[-num:]
+        if len(traces) < num or any(flags & PT_TRACE_DUMP_FLAG_DROPPED for _, flags, _ in traces):
+            return None
+        # an exec without archived trace (ring full) leaves a gap in the exec_ids
+        if any(b[0] != a[0] + 1 for a, b in zip(traces, traces[1:])):
+            return None
+        return [trace for _, _, trace in traces]
+
     def check_funkyness_and_store_trace(self, data):
         global num_funky
         exec_res = self.q.send_payload()
         hash = exec_res.hash()
-        trace1 = read_binary_file(self.config.argument_values['work_dir'] + "/pt_trace_dump_%d" % self.slave_id)
         exec_res = self.q.send_payload()
         if (hash != exec_res.hash()):
             print_warning("Validation identified funky bits, dumping!")
+            traces = self.__last_traces(2)
+            if not traces:
+                log_slave("PT traces of this input are incomplete, skipping trace dump", self.slave_id)
+                return exec_res
             num_funky += 1
             trace_folder = self.config.argument_values['work_dir'] + "/traces/funky_%d_%d" % (num_funky, self.slave_id);
             os.makedirs(trace_folder)
             atomic_write(trace_folder + "/input", data)
-            atomic_write(trace_folder + "/trace_a", trace1)
-            trace2 = read_binary_file(self.config.argument_values["work_dir"] + "/pt_trace_dump_%d" % self.slave_id)
-            atomic_write(trace_folder + "/trace_b", trace2)
+            atomic_write(trace_folder + "/trace_a", traces[0])
+            atomic_write(trace_folder + "/trace_b", traces[1])
         return exec_res
 
     # For debug purpose, receive state info
@@ -253,7 +303,9 @@ class SlaveProcess:
         '''
         debug(msg) """
 
+        check_time = time.time()
         is_new_input = self.bitmap_storage.should_send_to_master(exec_res)
+        self.statistics.event_bitmap_check(time.time() - check_time)
         crash, timeout, kasan = self.execution_exited_abnormally()
 
         # show mutated payloads
@@ -304,17 +356,23 @@ class SlaveProcess:
                 self.__send_to_master(data, exec_res, info)
 
         else:
-            if crash:
-                # Do not discard crashing inputs anymore!
-                # log_slave("Crashing input found (%s), but not new (discarding)" % (exec_res.exit_reason), self.slave_id)
-                self.__send_to_master(data, exec_res, info)
+            if crash or kasan:
+                # Do not discard crashing inputs anymore, but only send a few per crash signature
+                if self.crash_index.submit(self.crash_signature(exec_res)):
+                    self.__send_to_master(data, exec_res, info)
+                else:
+                    self.statistics.event_crash_dup()
 
-        # restart Qemu on crash
-        if crash:
+        # restart Qemu on crash or timeout - Qemu parks the vCPU when the exec budget runs out
+        if crash or timeout:
             self.statistics.event_reload()
             self.q.restart()
 
         return exec_res, is_new_input
 
+    def crash_signature(self, exec_res):
+        # the crash address alone is mostly the caller of panic(), the edges tell the bugs apart
+        return exec_res.exit_reason, self.q.crash_ip(), self.bitmap_storage.crash_signature(exec_res)
+
     def execution_exited_abnormally(self):
         return self.q.crashed, self.q.timeout, self.q.kasan
@@ -7,7 +7,9 @@
 Queue of fuzz inputs (nodes). Interface with scheduler to determine next input to be fuzzed.
 """
 
+from fuzzer.distill import node_weight
 from fuzzer.scheduler import Scheduler
+from fuzzer.priority_queue import IndexedMaxHeap
 
 # debug
 import time
@@ -19,10 +21,14 @@ class InputQueue:
         self.num_slaves = config.argument_values['p']
         self.scheduler = Scheduler()
         self.id_to_node = {}
+        self.priorities = IndexedMaxHeap()
         self.current_cycle = []
         self.bitmap_index_to_fav_node = {}
         self.num_cycles = 0
         self.statistics = statistics
+        # corpus distillation: ids of redundant nodes, kept out of the priority heap
+        self.distiller = None
+        self.cold = set()
 
     def get_next(self, retry=False):
         if len(self.id_to_node) == 0:
@@ -52,10 +58,13 @@ class InputQueue:
 
         while self.current_cycle:
             node = self.current_cycle.pop()
+            if node.get_id() in self.cold:
+                continue
             if self.scheduler.should_be_scheduled(self, node):
                 if not node.is_busy():
                     if node.get_state() != "final":
                         node.set_busy()
+                        self.update_priority(node)
                     return node
 
         self.update_current_cycle()
@@ -73,16 +82,15 @@ class InputQueue:
         # for slow targets since we don't have good queue culling and early
         # Redqueen/Grimoire stages seem to be the most efficient.
         #
-        # TODO: Sorting the queue is relatively expensive and can turn the
-        # master into a bottleneck. Experiment with cylce_factor to find a nice
-        # compromise, or fix Slaves to return less often.
+        # Nodes are kept in a max-heap keyed by scheduler priority and re-keyed
+        # on every node update, so a new cycle only costs O(k log k) for the
+        # top-most k = cycle_factor*num_slaves entries.
         cycle_factor = 2
         cycle_size = int(cycle_factor*self.num_slaves)
 
         self.num_cycles += 1
-        self.current_cycle = list(self.id_to_node.values())
-        self.sort_queue(self.current_cycle)
-        self.current_cycle = self.current_cycle[-cycle_size:]
+        # current_cycle is consumed from the end, highest priority first
+        self.current_cycle = [self.id_to_node[nid] for nid in reversed(self.priorities.top(cycle_size))]
         self.statistics.event_queue_cycle(self)
 
         #for i in self.current_cycle:
@@ -99,8 +107,12 @@ class InputQueue:
         #        i.get_state(),
         #        ))
 
-    def sort_queue(self, nodes):
-        nodes.sort(key=lambda n: self.scheduler.score_priority_favs(n))
+    def update_priority(self, node):
+        if node.get_id() in self.cold:
+            return
+        # tie-break on node id to match the previous stable sort of id_to_node
+        prio = self.scheduler.score_priority_favs(node) + (node.get_id(),)
+        self.priorities.update(node.get_id(), prio)
 
     def get_node_by_id(self, nid):
         return self.id_to_node[nid]
@@ -111,19 +123,41 @@ class InputQueue:
     def maybe_pushback_to_cycle(self, node):
         # put nodes in early stages directly at head of queue, to reduce global sorting
         if node.get_exit_reason() == "regular" and node.get_state() in ["initial", "redq/grim"]:
-            if len(node.get_fav_bits()) > 0:
+            if len(node.get_fav_bits()) > 0 and node.get_id() not in self.cold:
                 self.current_cycle.append(node)
 
-    def update_node_results(self, nid, results, new_payload):
+    def update_node_results(self, nid, results, new_payload, new_bitmap=None):
         node = self.get_node_by_id(nid)
         self.statistics.event_node_update(node, results)
         node.update_metadata(results)
         if new_payload:
             node.set_payload(new_payload)
         node.set_free()
+        if self.distiller and node.get_exit_reason() == "regular":
+            weight = node_weight(node.get_performance(), node.get_payload_len())
+            if new_bitmap:
+                # coverage of the trimmed payload replaces the node's features
+                self.distiller.add(nid, new_bitmap, weight)
+            else:
+                self.distiller.set_weight(nid, weight)
+        self.update_priority(node)
         self.maybe_pushback_to_cycle(node)
 
-    def insert_input(self, node, bitmap):
+    def apply_distillation(self, cold):
+        """ Demote nodes outside the corpus min-set to the cold tier, promote the others back """
+        # nodes still in the initial stage are not fuzzed yet, their trimmed coverage is not final
+        cold = {nid for nid in cold if nid not in self.id_to_node or self.id_to_node[nid].get_state() != "initial"}
+        promoted = self.cold.difference(cold)
+        self.cold = cold
+        for nid in cold:
+            if nid in self.priorities:
+                self.priorities.remove(nid)
+        for nid in promoted:
+            if nid in self.id_to_node:
+                self.update_priority(self.id_to_node[nid])
+        self.statistics.event_queue_distill(self)
+
+    def insert_input(self, node, bitmap_entries):
         parent = node.get_parent_id()
         node.set_level(self.get_node_by_id(parent).get_level() + 1 if parent else 0, write=False)
         node.set_performance(node.get_initial_performance(), write=False)
@@ -131,7 +165,8 @@ class InputQueue:
         node.set_fav_factor(self.scheduler.score_speed(node), write=True)
 
         self.id_to_node[node.get_id()] = node
-        self.update_best_input_for_bitmap_entry(node, bitmap)  # TODO improve performance!
+        self.update_best_input_for_bitmap_entry(node, bitmap_entries)
+        self.update_priority(node)
         self.maybe_pushback_to_cycle(node)
 
         self.statistics.event_node_new(node)
@@ -147,11 +182,10 @@ class InputQueue:
             return True, old_node
         return False, None
 
-    def update_best_input_for_bitmap_entry(self, new_node, bitmap):
+    # bitmap_entries: list of (index, value) for all non-zero bytes of the node's bitmap
+    def update_best_input_for_bitmap_entry(self, new_node, bitmap_entries):
         changed_nodes = set()
-        for (index, val) in enumerate(bitmap.cbuffer):
-            if val == 0x0:
-                continue
+        for (index, val) in bitmap_entries:
             overwrite, old_node = self.should_overwrite_old_entry(index, val, new_node)
             if overwrite:
                 self.bitmap_index_to_fav_node[index] = (new_node, val)
@@ -163,3 +197,4 @@ class InputQueue:
                     self.statistics.event_node_remove_fav_bit(old_node)
         for node in changed_nodes:
             node.write_metadata()
+            self.update_priority(node)
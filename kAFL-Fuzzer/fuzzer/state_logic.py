@@ -37,12 +37,13 @@ class FuzzingStateLogic:
     COLORIZATION_COUNT = 1
     COLORIZATION_STEPS = 1500
     COLORIZATION_TIMEOUT = 5
+    COLORIZATION_BATCH = 16
 
     def __init__(self, slave, config):
         self.slave = slave
         self.config = config
-        self.grimoire = GrimoireInference(config, self.validate_bytes)
-        havoc.init_havoc(config)
+        self.grimoire = GrimoireInference(config, self.validate_bytes, self.validate_bytes_batch)
+        havoc.init_havoc(config, self.slave.statistics)
         radamsa.init_radamsa(config, self.slave.slave_id)
 
         self.stage_info = {}
@@ -212,12 +213,11 @@ class FuzzingStateLogic:
 
         center_trim = False
 
-        new_payload = perform_trim(payload, metadata, self.execute,
-                                   self.slave.execution_exited_abnormally)
+        new_payload = perform_trim(payload, metadata, self.execute, self.exited_abnormally)
 
         if center_trim:
             new_payload = perform_center_trim(new_payload, metadata, self.execute,
-                                              self.slave.execution_exited_abnormally, trimming_bytes=2)
+                                              self.exited_abnormally, trimming_bytes=2)
         self.initial_time += time.time() - time_initial_start
         if new_payload == payload:
             return None
@@ -246,7 +246,7 @@ class FuzzingStateLogic:
 
         self.grimoire_inference_time = time.time() - start_time
         log_grimoire("generalization took {} seconds".format(self.grimoire_inference_time))
-        log_grimoire("number of unique generalized inputs: {}".format(len(list(self.grimoire.generalized_inputs.keys()))))
+        log_grimoire("number of unique generalized inputs: {}".format(len(self.grimoire.generalized_inputs)))
         return grimoire_info
 
     def __perform_grimoire(self, payload, metadata):
@@ -339,6 +339,12 @@ class FuzzingStateLogic:
         return self.slave.validate_bytes(payload, metadata, parent_info)
 
 
+    def validate_bytes_batch(self, payloads, metadata, extra_info=None):
+        # executed on demand, so callers can stop early without wasting execs
+        for payload in payloads:
+            yield self.validate_bytes(payload, metadata, extra_info)
+
+
     def execute(self, payload, label=None, extra_info=None, state=None):
 
         self.stage_info_execs += 1
@@ -352,10 +358,18 @@ class FuzzingStateLogic:
         return bitmap, is_new
 
 
+    def exited_abnormally(self):
+        return any(self.slave.execution_exited_abnormally())
+
+
     def execute_redqueen(self, payload):
         self.stage_info_execs += 1
         return self.slave.execute_redqueen(payload)
 
+    def execute_redqueen_batch(self, payloads, collect):
+        self.stage_info_execs += len(payloads)
+        return self.slave.execute_redqueen_batch(payloads, collect)
+
 
     def __get_bitmap_hash(self, payload):
         bitmap, _ = self.execute(payload)
@@ -363,21 +377,30 @@ class FuzzingStateLogic:
             return None
         return bitmap.hash()
 
+    # Batch-exec path: hash each candidate as soon as it returns, so that only
+    # a list of ints is kept around instead of bitmap copies.
+    def __get_bitmap_hashes(self, payloads):
+        return [self.__get_bitmap_hash(payload) for payload in payloads]
+
 
     def __get_bitmap_hash_robust(self, payload):
-        hashes = {self.__get_bitmap_hash(payload) for _ in range(3)}
-        if len(hashes) == 1:
-            return hashes.pop()
+        return self.__get_bitmap_hashes_robust([payload])[0]
+
+    def __get_bitmap_hashes_robust(self, payloads, rounds=3):
+        # interleave the candidates so that each round sees a different predecessor
+        results = [set() for _ in payloads]
+        for _ in range(rounds):
+            for hashes, new_hash in zip(results, self.__get_bitmap_hashes(payloads)):
+                hashes.add(new_hash)
         # log_slave("Hash Doesn't seem Stable", self.slave.slave_id)
-        return None
+        return [hashes.pop() if len(hashes) == 1 else None for hashes in results]
 
 
     def __perform_redqueen(self, payload, metadata):
         self.stage_update_label("redq_coloring")
 
-        orig_hash = self.__get_bitmap_hash_robust(payload)
         extension = bytes([207, 117, 130, 107, 183, 200, 143, 154])
-        appended_hash = self.__get_bitmap_hash_robust(payload + extension)
+        orig_hash, appended_hash = self.__get_bitmap_hashes_robust([payload, payload + extension])
 
         if orig_hash and orig_hash == appended_hash:
             log_slave("Redqueen: input can be extended", self.slave.slave_id)
@@ -397,9 +420,7 @@ class FuzzingStateLogic:
         rq_info = RedqueenInfoGatherer()
         rq_info.make_paths(RedqueenWorkdir(self.slave.slave_id, self.config))
         rq_info.verbose = False
-        for pld in colored_alternatives:
-            if self.execute_redqueen(pld):
-                rq_info.get_info(pld)
+        self.execute_redqueen_batch(colored_alternatives, rq_info.get_info)
 
         rq_info.get_proposals()
         self.stage_update_label("redq_mutate")
@@ -543,22 +564,35 @@ class FuzzingStateLogic:
             havoc.mutate_seq_havoc_array(payload_array, self.execute, havoc_amount // 2, state=metadata['state']['name'])
 
 
-    def __check_colorization(self, orig_hash, payload_array, min, max):
-        backup = payload_array[min:max]
-        for i in range(min, max):
-            payload_array[i] = rand.int(255)
-        new_hash = self.__get_bitmap_hash(payload_array)
-        if new_hash is not None and new_hash == orig_hash:
-            return True
-        else:
-            payload_array[min:max] = backup
-            return False
+    def __check_colorization_batch(self, orig_hash, payload_array, ranges):
+        candidates = []
+        for (min_i, max_i) in ranges:
+            candidate = bytearray(payload_array)
+            candidate[min_i:max_i] = rand.bytes(max_i - min_i)
+            candidates.append(candidate)
 
-    def __colorize_payload(self, orig_hash, payload_array):
-        def checker(min_i, max_i):
-            self.__check_colorization(orig_hash, payload_array, min_i, max_i)
+        results = [h is not None and h == orig_hash for h in self.__get_bitmap_hashes(candidates)]
+        if results.count(True) == 0:
+            return results
+
+        # Merge all colorable ranges and verify the combination once. If the
+        # ranges interact, keep only the first (largest) one and retry the others.
+        merged = bytearray(payload_array)
+        for (min_i, max_i), candidate, ok in zip(ranges, candidates, results):
+            if ok:
+                merged[min_i:max_i] = candidate[min_i:max_i]
 
-        c = ColorizerStrategy(len(payload_array), checker)
+        if results.count(True) > 1 and self.__get_bitmap_hash(merged) != orig_hash:
+            first = results.index(True)
+            results = [None if ok else False for ok in results]
+            results[first] = True
+            merged = candidates[first]
+
+        payload_array[:] = merged
+        return results
+
+    def __colorize_payload(self, orig_hash, payload_array):
+        c = ColorizerStrategy(len(payload_array), None)
         t = time.time()
         i = 0
         while True:
@@ -566,8 +600,15 @@ class FuzzingStateLogic:
                 break
             if len(c.unknown_ranges) == 0:
                 break
-            c.colorize_step()
-            i += 1
+            ranges = c.next_batch(FuzzingStateLogic.COLORIZATION_BATCH)
+            results = self.__check_colorization_batch(orig_hash, payload_array, ranges)
+            # None: colorable alone, but not on top of the others - probe again
+            for (min_i, max_i), ok in zip(ranges, results):
+                if ok is None:
+                    c.add_unknown_range(min_i, max_i)
+            done = [(r, ok) for r, ok in zip(ranges, results) if ok is not None]
+            c.apply_batch([r for r, _ in done], [ok for _, ok in done])
+            i += len(ranges)
 
 
     def __perform_coloring(self, payload_array):
@@ -10,7 +10,9 @@ Manage status outputs for Master and Slave instances
 import msgpack
 import time
 
-from common.util import atomic_write, read_binary_file
+from common.util import atomic_write
+import common.telemetry as telemetry
+from fuzzer.technique.havoc_scheduler import merge_stats
 
 class MasterStatistics:
     def __init__(self, config):
@@ -25,16 +27,21 @@ class MasterStatistics:
         self.cur_execs = dict()
         self.num_slaves = self.config.argument_values['p']
         self.work_dir = self.config.argument_values['work_dir']
+        # Master sets this to an AsyncWriter to keep disk I/O off the dispatch loop
+        self.writer = None
+        self.telemetry = dict()
         self.data = {
                 "total_execs": 0,
                 "paths_total": 0,
                 "paths_pending": 0,
+                "paths_cold": 0,
                 "favs_pending": 0,
                 "favs_total": 0,
                 "max_level": 0,
                 "cycles": 0,
                 "bytes_in_bitmap": 0,
                 "yield": {},
+                "havoc": {"ops": {}, "depths": []},
                 "findings": {
                     "regular": 0,
                     "crash": 0,
@@ -49,14 +56,12 @@ class MasterStatistics:
         # write once so that we have a valid stats file
         self.write_statistics()
 
-    def read_slave_stats(self, slave_id):
-        # one-shot attempt to read + parse file - this can fail!
-        filename = self.work_dir + "/slave_stats_%d" % slave_id
-        return msgpack.unpackb(read_binary_file(filename), raw=False, strict_map_key=False)
-
     def event_queue_cycle(self, queue):
         self.data["cycles"] += 1
 
+    def event_queue_distill(self, queue):
+        self.data["paths_cold"] = len(queue.cold)
+
     def event_node_new(self, node):
         self.update_yield(node)
 
@@ -81,11 +86,14 @@ class MasterStatistics:
             return
 
     def event_slave_poll(self):
-        # poll slave stats out of band - otherwise #execs are stalled by slow fuzz stages
+        # poll slave exec counters out of band - otherwise #execs are stalled by slow fuzz stages
         cur_execs = 0
         try:
             for slave_id in range(0, self.num_slaves):
-                cur_execs += self.read_slave_stats(slave_id).get("total_execs", 0)
+                if slave_id not in self.telemetry:
+                    self.telemetry[slave_id] = telemetry.TelemetryReader(
+                            telemetry.telemetry_filename(self.config, slave_id))
+                cur_execs += self.telemetry[slave_id].counter(telemetry.EXECS)
             self.data["total_execs"] = cur_execs
         except:
             pass
@@ -100,6 +108,9 @@ class MasterStatistics:
                     if is_fav:
                         self.data["favs_pending"] -= 1
 
+    def event_havoc_stats(self, stats):
+        merge_stats(self.data["havoc"], stats)
+
     def update_yield(self, node):
         method = node.node_struct["info"]["method"] # TODO: add node.get_method() API
         if method not in self.data["yield"]:
@@ -118,15 +129,18 @@ class MasterStatistics:
             self.write_plot()
 
     def write_statistics(self):
-        atomic_write(self.stats_file, msgpack.packb(self.data, use_bin_type=True))
+        data = msgpack.packb(self.data, use_bin_type=True)
+        if self.writer:
+            self.writer.write(self.stats_file, data)
+        else:
+            atomic_write(self.stats_file, data)
 
     def write_plot(self):
         cur_time = time.time()
         cur_execs = (self.data["total_execs"] - self.execs_last)/(cur_time-self.execs_time)
         self.execs_last = self.data["total_execs"]
         self.execs_time = cur_time
-        with open(self.plot_file, 'a') as fd:
-            fd.write("%06d;%d;%d;%d;%d;%d;%d;%d;%d;%d;%d;%d;%d\n" % (
+        line = "%06d;%d;%d;%d;%d;%d;%d;%d;%d;%d;%d;%d;%d\n" % (
                 cur_time-self.start_time,   # elapsed time
                 cur_execs,                     # execs/sec
                 self.data["paths_total"],      # paths total
@@ -140,13 +154,20 @@ class MasterStatistics:
                 self.data["favs_pending"],     # favs pending
                 self.data["total_execs"],      # current total execs
                 self.data["bytes_in_bitmap"],  # unique edges % p(col)
-                ))
+                )
+        if self.writer:
+            self.writer.append(self.plot_file, line)
+        else:
+            with open(self.plot_file, 'a') as fd:
+                fd.write(line)
 
 
 class SlaveStatistics:
     def __init__(self, slave_id, config):
         self.config = config
         self.filename = self.config.argument_values['work_dir'] + "/slave_stats_%d" % (slave_id)
+        # segment is created by the slave's qemu instance
+        self.telemetry = telemetry.TelemetryWriter(telemetry.telemetry_filename(config, slave_id))
         self.write_last = 0
         self.write_thres = 0.5
         self.execs_recent = 0
@@ -159,6 +180,7 @@ class SlaveStatistics:
             "execs/sec": 0,
             "num_reload": 0,
             "num_funky": 0,
+            "num_crash_dups": 0,
             "executions_redqueen": 0,
             "node_id": 0,
         }
@@ -176,16 +198,32 @@ class SlaveStatistics:
 
     def event_exec(self):
         self.data["total_execs"] += 1
+        self.telemetry.count(telemetry.EXECS)
         self.maybe_write_stats()
 
     def event_reload(self):
         self.data["num_reload"] += 1
+        self.telemetry.count(telemetry.RELOADS)
         self.maybe_write_stats()
 
+    def event_crash_dup(self):
+        self.data["num_crash_dups"] += 1
+        self.telemetry.count(telemetry.CRASH_DUPS)
+
     def event_funky(self):
         self.data["num_funky"] += 1
+        self.telemetry.count(telemetry.FUNKY)
         self.maybe_write_stats()
 
+    def event_bitmap_check(self, duration):
+        self.telemetry.record(telemetry.HIST_BITMAP, duration)
+
+    def event_havoc_names(self, names):
+        self.telemetry.set_havoc_names(names)
+
+    def event_havoc(self, counts):
+        self.telemetry.havoc(counts["ops"], counts["depths"])
+
     def event_exec_redqueen(self):
         self.data["executions_redqueen"] += 1
         self.maybe_write_stats()
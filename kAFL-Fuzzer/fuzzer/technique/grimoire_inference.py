@@ -7,20 +7,175 @@
 Grimoire grammar inference (inference stage)
 """
 
+import ctypes
+import inspect
+import os
 import re
-from collections import OrderedDict
 
 from common.debug import log_grimoire
 from six.moves import map
 
 
+native_so = ctypes.CDLL(
+    os.path.dirname(os.path.abspath(inspect.getfile(inspect.currentframe()))) + '/../native/grimoire.so')
+native_so.grimoire_cuts_fixed.restype = ctypes.c_size_t
+native_so.grimoire_cuts_split.restype = ctypes.c_size_t
+native_so.grimoire_closure.restype = ctypes.c_size_t
+native_so.grimoire_render.restype = ctypes.c_size_t
+native_so.grimoire_trim.restype = ctypes.c_size_t
+native_so.grimoire_store_new.restype = ctypes.c_void_p
+native_so.grimoire_store_free.argtypes = [ctypes.c_void_p]
+native_so.grimoire_store_add.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+native_so.grimoire_store_add.restype = ctypes.c_uint32
+native_so.grimoire_store_count.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t]
+native_so.grimoire_store_count.restype = ctypes.c_uint32
+native_so.grimoire_store_size.argtypes = [ctypes.c_void_p]
+native_so.grimoire_store_size.restype = ctypes.c_size_t
+native_so.grimoire_store_entry.argtypes = [ctypes.c_void_p, ctypes.c_size_t, ctypes.POINTER(ctypes.c_size_t)]
+native_so.grimoire_store_entry.restype = ctypes.POINTER(ctypes.c_uint16)
+native_so.grimoire_store_memory.argtypes = [ctypes.c_void_p]
+native_so.grimoire_store_memory.restype = ctypes.c_size_t
+
+GAP = 0x100
+
+
+def to_elems(generalized_input):
+    """ Native element array of a generalized input given as tuple of bytes """
+    return (ctypes.c_uint16 * len(generalized_input))(*[GAP if c == b'' else c[0] for c in generalized_input])
+
+
+class GeneralizedInput:
+    """
+    Input under generalization, backed by the native engine in native/grimoire.c.
+    Elements are byte values or GAP, cuts are (start, end) tuples of element indices.
+    """
+    NO_CUT = (0, 0)
+
+    def __init__(self, payload=None):
+        if payload is not None:
+            self.len = len(payload)
+            self.elems = (ctypes.c_uint16 * max(self.len, 1))(*payload)
+
+    def __len__(self):
+        return self.len
+
+    def copy(self):
+        other = GeneralizedInput()
+        other.len = self.len
+        other.elems = (ctypes.c_uint16 * len(self.elems)).from_buffer_copy(self.elems)
+        return other
+
+    def __cuts(self, num, starts, ends):
+        return list(zip(starts[:num], ends[:num]))
+
+    def cuts_fixed(self, step):
+        starts, ends = (ctypes.c_uint32 * self.len)(), (ctypes.c_uint32 * self.len)()
+        num = native_so.grimoire_cuts_fixed(self.elems, ctypes.c_size_t(self.len), ctypes.c_size_t(step),
+                                                 starts, ends)
+        return self.__cuts(num, starts, ends)
+
+    def cuts_split(self, split_char):
+        starts, ends = (ctypes.c_uint32 * self.len)(), (ctypes.c_uint32 * self.len)()
+        num = native_so.grimoire_cuts_split(self.elems, ctypes.c_size_t(self.len), ctypes.c_uint8(split_char),
+                                                 starts, ends)
+        return self.__cuts(num, starts, ends)
+
+    def closure(self, index, opening_char, closing_char):
+        start, endings = ctypes.c_uint32(), (ctypes.c_uint32 * self.len)()
+        num = native_so.grimoire_closure(self.elems, ctypes.c_size_t(self.len), ctypes.c_size_t(index),
+                                              ctypes.c_uint8(opening_char), ctypes.c_uint8(closing_char),
+                                              ctypes.byref(start), endings)
+        return start.value, endings[:num]
+
+    def render(self, cuts):
+        """ Payloads without gaps and without the given cut, one per cut """
+        num = len(cuts)
+        starts = (ctypes.c_uint32 * num)(*[cut[0] for cut in cuts])
+        ends = (ctypes.c_uint32 * num)(*[cut[1] for cut in cuts])
+        out = ctypes.create_string_buffer(max(num * self.len, 1))
+        out_lens = (ctypes.c_uint32 * num)()
+        native_so.grimoire_render(self.elems, ctypes.c_size_t(self.len), starts, ends, ctypes.c_size_t(num),
+                                       out, out_lens)
+        payloads = []
+        offset = 0
+        for length in out_lens:
+            payloads.append(out.raw[offset:offset + length])
+            offset += length
+        return payloads
+
+    def apply(self, cuts):
+        num = len(cuts)
+        if num == 0:
+            return
+        starts = (ctypes.c_uint32 * num)(*[cut[0] for cut in cuts])
+        ends = (ctypes.c_uint32 * num)(*[cut[1] for cut in cuts])
+        accepted = (ctypes.c_uint8 * num)(*([1] * num))
+        native_so.grimoire_apply(self.elems, starts, ends, accepted, ctypes.c_size_t(num))
+
+    def trim(self):
+        self.len = native_so.grimoire_trim(self.elems, ctypes.c_size_t(self.len))
+
+    def to_list(self):
+        return [b'' if e == GAP else bytes([e]) for e in self.elems[:self.len]]
+
+
+class GrimoireStore:
+    """
+    Deduplicated generalized inputs or tokens, interned in a native arena.
+    Entries are indexed in insertion order, so random selection is O(1).
+    """
+
+    def __init__(self):
+        self.store = native_so.grimoire_store_new()
+        if not self.store:
+            raise MemoryError("failed to allocate Grimoire store")
+
+    def __del__(self):
+        if self.store:
+            native_so.grimoire_store_free(self.store)
+            self.store = None
+
+    def add(self, generalized_input):
+        """ Add an entry, returns its number of occurrences so far """
+        count = native_so.grimoire_store_add(self.store, to_elems(generalized_input), len(generalized_input))
+        if not count:
+            raise MemoryError("failed to grow Grimoire store")
+        return count
+
+    def count(self, generalized_input):
+        return native_so.grimoire_store_count(self.store, to_elems(generalized_input), len(generalized_input))
+
+    def __contains__(self, generalized_input):
+        return self.count(generalized_input) > 0
+
+    def __len__(self):
+        return native_so.grimoire_store_size(self.store)
+
+    def __getitem__(self, index):
+        if not 0 <= index < len(self):
+            raise IndexError(index)
+        length = ctypes.c_size_t()
+        elems = native_so.grimoire_store_entry(self.store, index, ctypes.byref(length))
+        return tuple(b'' if e == GAP else bytes([e]) for e in elems[:length.value])
+
+    def memory(self):
+        """ Heap memory used by the store, in bytes """
+        return native_so.grimoire_store_memory(self.store)
+
+
 class GrimoireInference:
 
-    def __init__(self, config, verify_input):
+    # candidate cuts rendered and verified per batch
+    BATCH_SIZE = 64
+
+    def __init__(self, config, verify_input, verify_inputs=None):
         self.config = config
         self.verify_input = verify_input
-        self.generalized_inputs = OrderedDict({tuple([b'']): 0})
-        self.tokens = OrderedDict({tuple([b'']): 0})
+        self.verify_inputs = verify_inputs
+        self.generalized_inputs = GrimoireStore()
+        self.generalized_inputs.add(tuple([b'']))
+        self.tokens = GrimoireStore()
+        self.tokens.add(tuple([b'']))
         self.strings = []
         self.strings_regex = None
         self.load_strings()
@@ -44,7 +199,7 @@ class GrimoireInference:
                     s = (l.split("=\"")[1].split("\"\n")[0]).decode("string_escape")
                     if s == "":
                         continue
-                    self.tokens[tuple([c for c in s])] = 0
+                    self.tokens.add(tuple(bytes([c]) for c in s))
                     strings.append(s)
                 except:
                     pass
@@ -62,121 +217,76 @@ class GrimoireInference:
         #return payload
 
 
-    @staticmethod
-    def trim_generalized(generalized_input):
-        ret = []
-        before = b''
-        for char_class in generalized_input:
-            if char_class == before and char_class == b'':
-                pass
-            else:
-                ret.append(char_class)
-            before = char_class
-        return ret
-
-    def find_gaps(self, payload, old_node, find_next_index, split_char):
-        index = 0
-        while index < len(payload):
-            resume_index = find_next_index(payload, index, split_char)
-            test_payload = self.generalized_to_string(payload[0:index] + payload[resume_index:])
-
-            if self.verify_input(test_payload, old_node):
-                res = b''
-                payload[index:resume_index] = [res] * (resume_index - index)
-
-            index = resume_index
-
-        return self.trim_generalized(payload)
-
-    def find_gaps_in_closures(self, payload, old_node, find_closures, opening_char, closing_char):
-
+    def verify_batch(self, payloads, old_node):
+        """ Results in order of payloads, possibly produced lazily as they are consumed """
+        if self.verify_inputs:
+            return self.verify_inputs(payloads, old_node)
+        return (self.verify_input(payload, old_node) for payload in payloads)
+
+    def find_gaps(self, generalized, old_node, cuts):
+        # Probe a batch of cuts against the current input, then verify the
+        # accepted ones together once. If they interact, fall back to
+        # accepting them one by one on top of each other. A single accepted
+        # cut was already verified on the current input.
+        for batch_start in range(0, len(cuts), GrimoireInference.BATCH_SIZE):
+            batch = cuts[batch_start:batch_start + GrimoireInference.BATCH_SIZE]
+            results = self.verify_batch(generalized.render(batch), old_node)
+            accepted = [cut for cut, ok in zip(batch, results) if ok]
+
+            if len(accepted) > 1:
+                merged = generalized.copy()
+                merged.apply(accepted)
+                if not self.verify_input(merged.render([GeneralizedInput.NO_CUT])[0], old_node):
+                    generalized.apply(accepted[:1])
+                    for cut in accepted[1:]:
+                        if self.verify_input(generalized.render([cut])[0], old_node):
+                            generalized.apply([cut])
+                    continue
+            generalized.apply(accepted)
+
+        generalized.trim()
+
+    def find_gaps_in_closures(self, generalized, old_node, opening_char, closing_char):
         index = 0
-        while index < len(payload):
-            index, endings = find_closures(payload, index, opening_char, closing_char)
-
+        while index < len(generalized):
+            index, endings = generalized.closure(index, opening_char, closing_char)
             if len(endings) == 0:
-                return payload
-
-            ending = len(payload)
-            while endings:
-                ending = endings.pop(0)
-
-                test_payload = self.generalized_to_string(payload[0:index] + payload[ending:])
-
-                if self.verify_input(test_payload, old_node):
-                    res = b''
-
-                    payload[index:ending] = [res] * (ending - index)
-
+                return
+
+            # try the outermost closures first and stop at the first one accepted,
+            # results are consumed one by one so no exec is spent past it
+            ending = endings[-1]
+            for batch_start in range(0, len(endings), GrimoireInference.BATCH_SIZE):
+                batch = [(index, e) for e in endings[batch_start:batch_start + GrimoireInference.BATCH_SIZE]]
+                results = self.verify_batch(generalized.render(batch), old_node)
+                accepted = next((cut for cut, ok in zip(batch, results) if ok), None)
+                if accepted:
+                    generalized.apply([accepted])
+                    ending = accepted[1]
                     break
 
             index = ending
 
-        return self.trim_generalized(payload)
+        generalized.trim()
 
     def generalize_input(self, payload, old_node):
         if not self.verify_input(payload, old_node):
             return None
 
         log_grimoire("generalizing input {} with bytes {}".format(repr(payload), old_node["new_bytes"]))
-        generalized_input = [bytes([c]) for c in payload]
-
-        def increment_by_offset(_, index, offset):
-            return index + offset
-
-        def find_next_char(l, index, char):
-            while index < len(l):
-                if l[index] == char:
-                    return index + 1
+        generalized = GeneralizedInput(payload)
 
-                index += 1
+        for step in [256, 128, 64, 32, 1]:
+            self.find_gaps(generalized, old_node, generalized.cuts_fixed(step))
+        for split_char in b".;,\n\r# ":
+            self.find_gaps(generalized, old_node, generalized.cuts_split(split_char))
+        for opening_char, closing_char in [b"()", b"[]", b"{}", b"<>", b"''", b'""']:
+            self.find_gaps_in_closures(generalized, old_node, opening_char, closing_char)
 
-            return index
-
-        def find_closures(l, index, opening_char, closing_char):
-            endings = []
-
-            while index < len(l):
-                if l[index] == opening_char:
-                    break
-                index += 1
-
-            start_index = index
-            index_ending = len(l) - 1
-
-            while index_ending > start_index:
-                if l[index_ending] == closing_char:
-                    endings.append(index_ending + 1)
-                index_ending -= 1
-
-                index += 1
-            return start_index, endings
-
-        generalized_input = self.find_gaps(generalized_input, old_node, increment_by_offset, 256)
-        generalized_input = self.find_gaps(generalized_input, old_node, increment_by_offset, 128)
-        generalized_input = self.find_gaps(generalized_input, old_node, increment_by_offset, 64)
-        generalized_input = self.find_gaps(generalized_input, old_node, increment_by_offset, 32)
-        generalized_input = self.find_gaps(generalized_input, old_node, increment_by_offset, 1)
-        generalized_input = self.find_gaps(generalized_input, old_node, find_next_char, b".", )
-        generalized_input = self.find_gaps(generalized_input, old_node, find_next_char, b";")
-        generalized_input = self.find_gaps(generalized_input, old_node, find_next_char, b",")
-        generalized_input = self.find_gaps(generalized_input, old_node, find_next_char, b"\n")
-        generalized_input = self.find_gaps(generalized_input, old_node, find_next_char, b"\r")
-        generalized_input = self.find_gaps(generalized_input, old_node, find_next_char, b"#")
-        generalized_input = self.find_gaps(generalized_input, old_node, find_next_char, b" ")
-
-        generalized_input = self.find_gaps_in_closures(generalized_input, old_node, find_closures, b"(", b")")
-        generalized_input = self.find_gaps_in_closures(generalized_input, old_node, find_closures, b"[", b"]")
-        generalized_input = self.find_gaps_in_closures(generalized_input, old_node, find_closures, b"{", b"}")
-        generalized_input = self.find_gaps_in_closures(generalized_input, old_node, find_closures, b"<", b">")
-        generalized_input = self.find_gaps_in_closures(generalized_input, old_node, find_closures, b"'", b"'")
-        generalized_input = self.find_gaps_in_closures(generalized_input, old_node, find_closures, b'"', b'"')
-
-        generalized_input = self.finalize_generalized(generalized_input)
-
-        if len(generalized_input) > 8192:
+        if len(generalized) > 8192:
             return None
 
+        generalized_input = self.finalize_generalized(generalized.to_list())
         self.add_to_inputs(generalized_input)
         #printable_generalized = self.to_printable(generalized_input)
         #log_grimoire("final class learnt: {}".format(repr(printable_generalized)))
@@ -207,17 +317,11 @@ class GrimoireInference:
     def add_to_inputs(self, generalized_input):
         assert isinstance(generalized_input, tuple)
 
-        if generalized_input not in self.generalized_inputs:
-            self.generalized_inputs[generalized_input] = 0
-        self.generalized_inputs[generalized_input] += 1
-
-        if self.generalized_inputs[generalized_input] > 1:
+        if self.generalized_inputs.add(generalized_input) > 1:
             return
 
         for token in self.tokenize(generalized_input):
             if len(token) < 2:
                 continue
-            if token not in self.tokens:
+            if self.tokens.add(token) == 1:
                 log_grimoire("adding token {}".format(repr(token)))
-                self.tokens[token] = 0
-            self.tokens[token] += 1
@@ -7,15 +7,77 @@
 Grimoire grammar-based mutations (havoc stage)
 """
 
+import ctypes
+
 from common.debug import log_grimoire
-from fuzzer.technique.helper import rand
+from fuzzer.technique.grimoire_inference import native_so, to_elems
+from fuzzer.technique.helper import rand, KAFL_MAX_FILE
 
+# mirrored in native/grimoire.c
 CHOOSE_SUBINPUT = 50
 RECURSIVE_REPLACEMENT_DEPTH = [2, 4, 8, 16, 32, 64]
 
-
-def filter_gap_indices(generalized_input):
-    return [index for index in range(len(generalized_input)) if generalized_input[index] == b'']
+native_so.grimoire_mutator_new.argtypes = [ctypes.c_size_t]
+native_so.grimoire_mutator_new.restype = ctypes.c_void_p
+native_so.grimoire_mutator_free.argtypes = [ctypes.c_void_p]
+native_so.grimoire_mutator_seed.argtypes = [ctypes.c_void_p, ctypes.c_uint64]
+native_so.grimoire_mutator_out.argtypes = [ctypes.c_void_p]
+native_so.grimoire_mutator_out.restype = ctypes.c_void_p
+native_so.grimoire_random_payload.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p]
+native_so.grimoire_random_payload.restype = ctypes.c_size_t
+native_so.grimoire_recursive_replacement.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_void_p,
+                                                     ctypes.c_void_p, ctypes.c_size_t, ctypes.c_size_t]
+native_so.grimoire_recursive_replacement.restype = ctypes.c_size_t
+native_so.grimoire_replace.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_size_t,
+                                       ctypes.c_size_t, ctypes.c_char_p, ctypes.c_size_t, ctypes.c_int]
+native_so.grimoire_replace.restype = ctypes.c_size_t
+
+
+class GrimoireMutator:
+    """
+    Native Grimoire mutators working on buffers preallocated for payloads of
+    up to cap bytes. Longer results are cut short.
+    """
+
+    def __init__(self, cap=KAFL_MAX_FILE):
+        self.mutator = native_so.grimoire_mutator_new(cap)
+        if not self.mutator:
+            raise MemoryError("failed to allocate Grimoire mutator")
+        self.out = native_so.grimoire_mutator_out(self.mutator)
+
+    def __del__(self):
+        if self.mutator:
+            native_so.grimoire_mutator_free(self.mutator)
+            self.mutator = None
+
+    def seed(self):
+        native_so.grimoire_mutator_seed(self.mutator, rand.int(0xffffffff))
+
+    def random_payload(self, grimoire_inference):
+        """ Random generalized input, subinput or token as payload """
+        length = native_so.grimoire_random_payload(self.mutator, grimoire_inference.generalized_inputs.store,
+                                                   grimoire_inference.tokens.store)
+        return ctypes.string_at(self.out, length)
+
+    def recursive_replacement(self, elems, grimoire_inference, depth):
+        length = native_so.grimoire_recursive_replacement(self.mutator, grimoire_inference.generalized_inputs.store,
+                                                          grimoire_inference.tokens.store, elems, len(elems), depth)
+        return ctypes.string_at(self.out, length)
+
+    def replace(self, payload, start, end, replacement, replace_all):
+        length = native_so.grimoire_replace(self.mutator, payload, len(payload), start, end,
+                                            replacement, len(replacement), replace_all)
+        return ctypes.string_at(self.out, length)
+
+
+mutator = None
+
+
+def get_mutator():
+    global mutator
+    if mutator is None:
+        mutator = GrimoireMutator()
+    return mutator
 
 
 def find_string_matches(generalized_input, grimoire_inference):
@@ -39,78 +101,38 @@ def pad_generalized_input(generalized_input):
     return generalized_input
 
 
-def random_generalized(grimoire_inference):
-    rand_generalized = list(grimoire_inference.generalized_inputs.keys())[rand.int(len(grimoire_inference.generalized_inputs))]
-    rand_generalized = pad_generalized_input(rand_generalized)
-
-    if rand.int(100) > CHOOSE_SUBINPUT and len(rand_generalized) > 0:
-        if rand.int(100) < 50 and len(rand_generalized) > 0:
-            gap_indices = filter_gap_indices(rand_generalized)
-            min_index, max_index = rand.select(gap_indices), rand.select(gap_indices)
-            min_index, max_index = min(min_index, max_index), max(min_index, max_index)
-            rand_generalized = rand_generalized[min_index:max_index + 1]
-        else:
-            random_token = list(grimoire_inference.tokens.keys())[rand.int(len(grimoire_inference.tokens))]
-            rand_generalized = pad_generalized_input(random_token)
-
-        assert rand_generalized[0] == b'' and rand_generalized[-1] == b''
-    return rand_generalized
-
-
-def recursive_replacement(generalized_input, grimoire_inference, depth):
-    for _ in range(depth):
-
-        if len(generalized_input) >= 64 << 10:
-            return generalized_input
-
-        gap_indices = filter_gap_indices(generalized_input)
-
-        if len(gap_indices) == 0:
-            return generalized_input
-
-        random_index = rand.select(gap_indices)
-
-        generalized_input = generalized_input[0:random_index] + random_generalized(
-            grimoire_inference) + generalized_input[random_index + 1:]
-
-    return generalized_input
-
-
-def mutate_recursive_replacement(generalized_input, func, grimoire_inference):
+def mutate_recursive_replacement(elems, func, grimoire_inference):
 
     depth = rand.select(RECURSIVE_REPLACEMENT_DEPTH)
-    generalized_input = recursive_replacement(generalized_input, grimoire_inference, depth)
-    data = grimoire_inference.generalized_to_string(generalized_input)
+    data = get_mutator().recursive_replacement(elems, grimoire_inference, depth)
 
     func(data, label="grim_recursive")
 
 
-def mutate_input_extension(generalized_input, func, grimoire_inference):
+def mutate_input_extension(payload, func, grimoire_inference):
 
-    rand_generalized = random_generalized(grimoire_inference)
+    rand_payload = get_mutator().random_payload(grimoire_inference)
 
-    data = grimoire_inference.generalized_to_string(rand_generalized) + grimoire_inference.generalized_to_string(generalized_input)
+    data = rand_payload + payload
     func(data, label="grim_extension")
 
-    data = grimoire_inference.generalized_to_string(generalized_input) + grimoire_inference.generalized_to_string(rand_generalized)
+    data = payload + rand_payload
     func(data, label="grim_extension")
 
 
-def mutate_replace_strings(generalized_input, func, grimoire_inference, string_matches):
+def mutate_replace_strings(payload, func, grimoire_inference, string_matches):
     if len(string_matches) == 0:
         return
 
-    payload = grimoire_inference.generalized_to_string(generalized_input)
-
     match = rand.select(string_matches)
     rand_str = rand.select(grimoire_inference.strings)
 
     # replace single instance
-    data = payload[0:match.start()] + rand_str + payload[match.end():]
+    data = get_mutator().replace(payload, match.start(), match.end(), rand_str, False)
     func(data, label="grim_repl_str")
 
     # replace all instances
-    data = payload.replace(payload[match.start():match.end()], rand_str)
+    data = get_mutator().replace(payload, match.start(), match.end(), rand_str, True)
     func(data, label="grim_repl_str")
 
 
@@ -119,9 +141,12 @@ def havoc(generalized_input, func, grimoire_inference, max_iterations, generaliz
     assert generalized_input[0] == b'' and generalized_input[-1] == b''
 
     string_matches = find_string_matches(generalized_input, grimoire_inference)
+    payload = grimoire_inference.generalized_to_string(generalized_input)
+    elems = to_elems(generalized_input)
+    get_mutator().seed()
 
     for _ in range(max_iterations):
         if generalized:
-            mutate_input_extension(generalized_input, func, grimoire_inference)
-            mutate_recursive_replacement(generalized_input, func, grimoire_inference)
-        mutate_replace_strings(generalized_input, func, grimoire_inference, string_matches)
+            mutate_input_extension(payload, func, grimoire_inference)
+            mutate_recursive_replacement(elems, func, grimoire_inference)
+        mutate_replace_strings(payload, func, grimoire_inference, string_matches)
@@ -12,6 +12,7 @@ import time
 
 from common.config import FuzzerConfiguration
 from fuzzer.technique.havoc_handler import *
+from fuzzer.technique.havoc_scheduler import HavocScheduler
 
 from debug.log import debug_flow
 from kafl_conf import HAVOC_MAX_LEN
@@ -29,8 +30,12 @@ def load_dict(file_name):
     return dict_entries
 
 
-def init_havoc(config):
+scheduler = None
+
+
+def init_havoc(config, statistics=None):
     global location_corpus
+    global scheduler
     if config.argument_values["dict"]:
         set_dict(load_dict(FuzzerConfiguration().argument_values["dict"]))
     # AFL havoc adds these at runtime as soon as available dicts are non-empty
@@ -39,6 +44,14 @@ def init_havoc(config):
         append_handler(havoc_dict_replace)
 
     location_corpus = config.argument_values['work_dir'] + "/corpus/"
+    scheduler = HavocScheduler(havoc_handler, AFL_HAVOC_STACK_POW2, statistics)
+
+
+def get_scheduler():
+    global scheduler
+    if scheduler is None:
+        scheduler = HavocScheduler(havoc_handler, AFL_HAVOC_STACK_POW2)
+    return scheduler
 
 
 def havoc_range(perf_score):
@@ -60,12 +73,16 @@ def mutate_seq_havoc_array(data, func, max_iterations, resize=False, state=None,
     else:
         data = data
 
+    sched = get_scheduler()
+
     if not splice:
         for i in range(max_iterations):
-            stacking = rand.int(AFL_HAVOC_STACK_POW2)
+            stacking = sched.pick_stacking()
+            ops = []
 
             for j in range(1 << (1 + stacking)):
-                handler = rand.select(havoc_handler)
+                op, handler = sched.pick_handler()
+                ops.append(op)
                 data = handler(data)
                 if len(data) >= KAFL_MAX_FILE:
                     data = data[:KAFL_MAX_FILE]
@@ -76,7 +93,8 @@ def mutate_seq_havoc_array(data, func, max_iterations, resize=False, state=None,
             
             # Execute test logic for max_iterations times
             """ func(data, state=state) """
-            func(data, state=state)
+            _, is_new = func(data, state=state)
+            sched.record(ops, stacking, is_new)
     else:
         state = 'splice'
         
@@ -85,7 +103,7 @@ def mutate_seq_havoc_array(data, func, max_iterations, resize=False, state=None,
 
             # for j in range(1 << (1 + stacking)):
             for j in range(1):
-                handler = rand.select(havoc_handler)
+                op, handler = sched.pick_handler()
                 newdata = ''
                 while len(newdata) <= (len(data) // 2):
                     newdata = handler(data)
@@ -98,7 +116,8 @@ def mutate_seq_havoc_array(data, func, max_iterations, resize=False, state=None,
             
             # Execute test logic for max_iterations times
             """ func(data, state=state) """
-            func(newdata, state=state)
+            _, is_new = func(newdata, state=state)
+            sched.record([op], None, is_new)
 
 
 def mutate_seq_splice_array(data, func, max_iterations, resize=False, state=None):
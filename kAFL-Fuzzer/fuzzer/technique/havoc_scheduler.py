@@ -0,0 +1,153 @@
+# Copyright 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Adaptive havoc operator and stacking depth scheduling (MOpt-style bandit)
+
+Each havoc execution records which operators and which stacking depth were
+used, and whether the result was new coverage. Operators and depths are then
+picked with a probability proportional to their smoothed yield, plus a
+uniform share to keep exploring operators that have not paid off yet.
+
+Slaves periodically share their counts with the Master, which sums them up
+and hands the totals back with the next task. Selection is based on these
+totals plus the slave's own counts not shared yet.
+"""
+
+import bisect
+import time
+
+from fuzzer.technique.helper import rand
+
+# recompute selection weights every UPDATE_EXECS recorded executions
+UPDATE_EXECS = 500
+# share counts with the Master at most every SHARE_SECS
+SHARE_SECS = 10
+# share of picks spread uniformly across all choices
+EXPLORE = 0.1
+# smooth yields towards the overall mean, weighted like PRIOR_USES uses
+PRIOR_USES = 1000
+
+RAND_SCALE = 1 << 30
+
+
+class BanditArm:
+    """ Weighted choice among a fixed list of options by recorded yield """
+
+    def __init__(self, num):
+        self.num = num
+        self.uses = [0] * num
+        self.finds = [0] * num
+        self.global_uses = [0] * num
+        self.global_finds = [0] * num
+        self.cumulative = [i + 1 for i in range(num)]
+
+    def pick(self):
+        target = rand.int(RAND_SCALE) * self.cumulative[-1] / RAND_SCALE
+        return min(bisect.bisect_right(self.cumulative, target), self.num - 1)
+
+    def update_weights(self):
+        uses = [g + u for g, u in zip(self.global_uses, self.uses)]
+        finds = [g + f for g, f in zip(self.global_finds, self.finds)]
+        mean = (sum(finds) + 1) / (sum(uses) + 1)
+        yields = [(f + mean * PRIOR_USES) / (u + PRIOR_USES) for u, f in zip(uses, finds)]
+        total = sum(yields)
+
+        cumulative = 0
+        for i, y in enumerate(yields):
+            cumulative += (1 - EXPLORE) * y / total + EXPLORE / self.num
+            self.cumulative[i] = cumulative
+
+    def probabilities(self):
+        return [b - a for a, b in zip([0] + self.cumulative[:-1], self.cumulative)]
+
+    def take(self):
+        """ Counts since the last call, handed to the Master """
+        counts = [[u, f] for u, f in zip(self.uses, self.finds)]
+        self.uses = [0] * self.num
+        self.finds = [0] * self.num
+        return counts
+
+    def set_global(self, counts):
+        self.global_uses = [u for u, _ in counts]
+        self.global_finds = [f for _, f in counts]
+
+
+class HavocScheduler:
+
+    def __init__(self, handlers, max_stacking, statistics=None):
+        # duplicate handlers only served as static weights
+        self.handlers = list(dict.fromkeys(handlers))
+        self.names = [handler.__name__ for handler in self.handlers]
+        self.ops = BanditArm(len(self.handlers))
+        self.depths = BanditArm(max_stacking)
+        self.statistics = statistics
+        self.recorded = 0
+        self.share_last = time.time()
+        if self.statistics:
+            self.statistics.event_havoc_names(self.names)
+
+    def pick_handler(self):
+        index = self.ops.pick()
+        return index, self.handlers[index]
+
+    def pick_stacking(self):
+        return self.depths.pick()
+
+    def record(self, ops, stacking, is_new):
+        """ Feedback for one execution with the given operator indices and stacking """
+        for op in ops:
+            self.ops.uses[op] += 1
+            if is_new:
+                self.ops.finds[op] += 1
+        if stacking is not None:
+            self.depths.uses[stacking] += 1
+            if is_new:
+                self.depths.finds[stacking] += 1
+
+        self.recorded += 1
+        if self.recorded % UPDATE_EXECS == 0:
+            self.update()
+
+    def update(self):
+        self.ops.update_weights()
+        self.depths.update_weights()
+        if self.statistics:
+            self.statistics.event_havoc(self.counts())
+
+    def counts(self):
+        """ Global plus unshared counts as [[uses, finds], ...] for operators and depths """
+        result = dict()
+        for key, arm in (("ops", self.ops), ("depths", self.depths)):
+            result[key] = [[g + u, gf + f] for g, u, gf, f in
+                           zip(arm.global_uses, arm.uses, arm.global_finds, arm.finds)]
+        return result
+
+    def share(self, force=False):
+        """ Counts recorded since the last share, or None if not due yet """
+        if not force and time.time() - self.share_last < SHARE_SECS:
+            return None
+        self.share_last = time.time()
+        return {"ops": dict(zip(self.names, self.ops.take())), "depths": self.depths.take()}
+
+    def set_global(self, stats):
+        """ Apply campaign-wide counts as summed up by the Master """
+        self.ops.set_global([stats["ops"].get(name, [0, 0]) for name in self.names])
+        depths = stats["depths"][:self.depths.num]
+        self.depths.set_global(depths + [[0, 0]] * (self.depths.num - len(depths)))
+        self.update()
+
+
+def merge_stats(total, stats):
+    """ Add the counts shared by a slave to the Master's totals """
+    for name, (uses, finds) in stats["ops"].items():
+        entry = total["ops"].setdefault(name, [0, 0])
+        entry[0] += uses
+        entry[1] += finds
+    depths = total["depths"]
+    for i, (uses, finds) in enumerate(stats["depths"]):
+        if i >= len(depths):
+            depths.append([0, 0])
+        depths[i][0] += uses
+        depths[i][1] += finds
+    return total
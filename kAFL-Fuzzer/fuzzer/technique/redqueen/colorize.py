@@ -30,18 +30,23 @@ class ColorizerStrategy:
         self.checker = checker
 
     def is_range_colorable(self, min_, max_):
-        if self.checker(min_, max_):
+        colorable = bool(self.checker(min_, max_))
+        self.mark_range(min_, max_, colorable)
+        return colorable
+
+    def mark_range(self, min_, max_, colorable):
+        if colorable:
             for i in range(min_, max_):
                 self.color_info[i] = self.COLORABLE
-            return True
-        else:
-            if min_ + 1 == max_:
-                self.color_info[min_] = self.FIXED
-            return False
+        elif min_ + 1 == max_:
+            self.color_info[min_] = self.FIXED
 
     def bin_search(self, min_, max_):
         if self.is_range_colorable(min_, max_) or min_ + 1 == max_:
             return
+        self.split_range(min_, max_)
+
+    def split_range(self, min_, max_):
         center = int(min_ + (max_ - min_) / 2)
         self.add_unknown_range(min_, center)
         self.add_unknown_range(center, max_)
@@ -51,6 +56,22 @@ class ColorizerStrategy:
         self.unknown_ranges.remove((min_i, max_i))
         self.bin_search(min_i, max_i)
 
+    # Batch interface: take the N largest unknown ranges at once so that the
+    # caller can probe them back-to-back (or in parallel) and report results
+    # in bulk via apply_batch(). Ranges found not colorable are bisected.
+    def next_batch(self, batch_size):
+        ranges = sorted(self.unknown_ranges, key=lambda mi_ma: (mi_ma[0] - mi_ma[1], mi_ma[0]))[:batch_size]
+        for r in ranges:
+            self.unknown_ranges.remove(r)
+        return ranges
+
+    def apply_batch(self, ranges, results):
+        assert len(ranges) == len(results)
+        for (min_, max_), colorable in zip(ranges, results):
+            self.mark_range(min_, max_, colorable)
+            if not colorable and min_ + 1 != max_:
+                self.split_range(min_, max_)
+
     def add_unknown_range(self, min_, max_):
         assert (min_ < max_)
         self.unknown_ranges.add((min_, max_))
@@ -97,6 +118,20 @@ class TestColorizer(unittest.TestCase):
         self.check_fuzz_result(1, [0, 0, 1, 0])
         self.check_fuzz_result(0, [0, 1, 0, 0, 1, 1, 1, 1, 1, 1, 0, 0, 1, 0, 1])
 
+    def check_batch_fuzz_result(self, testcase, batch_size):
+        c = ColorizerStrategy(len(testcase), None)
+        while len(c.unknown_ranges) > 0:
+            ranges = c.next_batch(batch_size)
+            c.apply_batch(ranges, [check(min_, max_, testcase) for (min_, max_) in ranges])
+        self.assertEqual([(0 if x == 1 else 1) for x in c.color_info], testcase)
+
+    def test_colorize_batch(self):
+        for i in range(0, 200):
+            random.seed(i)
+            testcase = [random.randint(0, 1) for _ in range(random.randint(1, 40))]
+            for batch_size in [1, 4, 32]:
+                self.check_batch_fuzz_result(testcase, batch_size)
+
     def test_fuzz_colorize_step(self):
         for i in range(0, 1000):
             random.seed(i)
@@ -10,6 +10,7 @@ AFL-style trim algorithms (init stage)
 from fuzzer.bitmap import GlobalBitmap
 
 MAX_EXECS = 16
+CENTER_MAX_EXECS = 256
 MAX_ROUNDS = 32
 MIN_SIZE = 32
 APPEND_VALUE = 0.1
@@ -26,81 +27,149 @@ def get_pow2_value(value):
     return 1
 
 
-def check_trim_still_valid(old_node, old_bitmap, new_bitmap):
+def expected_bits(old_node):
+    old_bits = old_node["new_bytes"].copy()
+    old_bits.update(old_node["new_bits"])
+    return GlobalBitmap.expected_bits(old_bits)
+
+
+def check_trim_still_valid(expected, new_bitmap):
     # non-det input
     if not new_bitmap:
         return False
     if not new_bitmap.is_lut_applied():
         new_bitmap.apply_lut()
-    trim_simple = False
-    if trim_simple:
-        assert False  # todo fixme wrt to bitmaps, == doesnt work on bitmap_wrapper
-        return old_bitmap == new_bitmap
-    else:
-        old_bits = old_node["new_bytes"].copy()
-        old_bits.update(old_node["new_bits"])
-        return GlobalBitmap.all_new_bits_still_set(old_bits, new_bitmap)
-
-
-def perform_center_trim(payload, old_node, send_handler, error_handler, trimming_bytes):
-    index = 0
-    old_bitmap, _ = send_handler(payload, label="center_trim_funky")
-
+    return GlobalBitmap.all_expected_bits_set(expected, new_bitmap)
+
+
+def sequential_batch(send_handler, error_handler):
+    """
+    Batch handler on top of single execs, the default for slaves as they have a
+    single Qemu instance. Candidates are executed lazily, so stopping at the
+    first valid candidate saves the remaining execs. Bitmaps are only valid
+    until the next result is requested.
+    """
+    def send_batch(payloads, label):
+        for payload in payloads:
+            new_bitmap, _ = send_handler(payload, label=label)
+            yield new_bitmap, error_handler()
+    return send_batch
+
+
+def check_batch(send_batch, candidates, expected, label, first_only=False):
+    """
+    Execute candidates and check them as they complete. Bitmaps are only valid
+    until the next result is requested. Returns (list of valid indices, number
+    of execs), or (None, execs) on a crash or timeout.
+    """
+    valid = []
+    execs = 0
+    for index, (new_bitmap, abnormal) in enumerate(send_batch(candidates, label)):
+        execs += 1
+        if abnormal:
+            return None, execs
+        if check_trim_still_valid(expected, new_bitmap):
+            valid.append(index)
+            if first_only:
+                break
+    return valid, execs
+
+
+def remove_chunks(payload, starts, chunk_size):
+    parts = []
+    last = 0
+    for start in starts:
+        parts.append(payload[last:start])
+        last = start + chunk_size
+    parts.append(payload[last:])
+    return b''.join(parts)
+
+
+def perform_center_trim(payload, old_node, send_handler, error_handler, trimming_bytes, send_batch=None):
+    # Bisect from large chunks down to trimming_bytes. The chunk removals of
+    # one size are probed as a batch, from the current position to the end,
+    # and the valid ones are committed together. If they interact, only the
+    # first one is committed and probing continues right after it, on the
+    # shorter payload. Each chunk size is thus one pass over the payload.
+    send_batch = send_batch or sequential_batch(send_handler, error_handler)
+
+    send_handler(payload, label="center_trim_funky")
     if error_handler():
         return payload
 
-    while index < len(payload):
-        test_payload = payload[0: index] + payload[index + trimming_bytes:]
-
-        new_bitmap, _ = send_handler(test_payload, label="center_trim")
-
-        # if error_handler():
-        #     return payload
+    expected = expected_bits(old_node)
+    chunk_size = max(get_pow2_value(len(payload) // 2), trimming_bytes)
+    position = 0
+    execs = 0
 
-        if check_trim_still_valid(old_node, old_bitmap, new_bitmap):
-            payload = test_payload[:]
-        else:
-            index += trimming_bytes
+    while execs < CENTER_MAX_EXECS:
+        if position >= len(payload):
+            if chunk_size <= trimming_bytes:
+                break
+            chunk_size = max(chunk_size // 2, trimming_bytes)
+            position = 0
+            continue
+
+        starts = list(range(position, len(payload), chunk_size))[:CENTER_MAX_EXECS - execs]
+        candidates = [payload[:start] + payload[start + chunk_size:] for start in starts]
+        valid, used = check_batch(send_batch, candidates, expected, "center_trim")
+        execs += used
+        if valid is None:
+            return payload
+
+        if not valid:
+            position = starts[-1] + chunk_size
+            continue
+
+        if len(valid) > 1:
+            merged = remove_chunks(payload, [starts[i] for i in valid], chunk_size)
+            merged_valid, used = check_batch(send_batch, [merged], expected, "center_trim")
+            execs += used
+            if merged_valid is None:
+                return payload
+            if merged_valid:
+                payload = merged
+                position = starts[-1] + chunk_size - len(valid) * chunk_size
+                continue
+        payload = candidates[valid[0]]
+        position = starts[valid[0]]
 
     return payload
 
 
-def perform_trim(payload, old_node, send_handler, error_handler):
+def perform_trim(payload, old_node, send_handler, error_handler, send_batch=None):
+    # Each round probes the tail removals of all power-of-two sizes that fit,
+    # largest first, and commits the largest valid one. Without batch
+    # execution, probing stops at the first valid candidate.
     global MAX_ROUNDS, MAX_EXECS, MIN_SIZE, APPEND_BYTES
     if len(payload) <= MIN_SIZE:
         return payload
 
-    old_bitmap, _ = send_handler(payload, label="trim_funky")
+    send_batch = send_batch or sequential_batch(send_handler, error_handler)
+
+    send_handler(payload, label="trim_funky")
     if error_handler():
         return payload
+
+    expected = expected_bits(old_node)
     execs = 0
     new_size = len(payload)
 
     for _ in range(MAX_ROUNDS):
-        abort = True
-        for i in reversed(range(0, pow2_values.index(get_pow2_value(new_size)) + 1)):
-            if pow2_values[i] < new_size:
-
-                execs += 1
-                if execs == MAX_EXECS:
-                    abort = True
-                    break
-
-                new_bitmap, _ = send_handler(payload[0:new_size - pow2_values[i]], label="trim")
-
-                if error_handler():
-                    return payload[0:new_size]
-
-                if check_trim_still_valid(old_node, old_bitmap, new_bitmap):
-                    new_size -= pow2_values[i]
-                    abort = False
-                    break
-
-                if new_size <= MIN_SIZE:
-                    break
+        sizes = [size for size in reversed(pow2_values[:pow2_values.index(get_pow2_value(new_size)) + 1])
+                 if size < new_size]
+        sizes = sizes[:MAX_EXECS - 1 - execs]
+        if not sizes or new_size <= MIN_SIZE:
+            break
 
-        if abort:
+        valid, used = check_batch(send_batch, [payload[0:new_size - size] for size in sizes], expected,
+                                  "trim", first_only=True)
+        execs += used
+        if valid is None:
+            return payload[0:new_size]
+        if not valid:
             break
+        new_size -= sizes[valid[0]]
 
     new_size_backup = new_size
     if new_size < MIN_SIZE:
@@ -111,7 +180,7 @@ def perform_trim(payload, old_node, send_handler, error_handler):
     new_size += APPEND_BYTES
 
     new_bitmap, _ = send_handler(payload[0:new_size], label="trim")
-    if not check_trim_still_valid(old_node, old_bitmap, new_bitmap):
+    if not check_trim_still_valid(expected, new_bitmap):
         return payload[0:min(new_size_backup, len(payload))]
 
     return payload[0:min(new_size, len(payload))]
@@ -10,6 +10,11 @@ Given a AFL or kAFL workdir, process the contained corpus in
 kAFL Qemu/KVM to obtain PT traces of individual inputs.
 
 The individual traces are saved to $workdir/traces/.
+
+Inputs are traced by a pool of -p Qemu instances. Finished inputs are
+recorded in traces/manifest.jsonl, so an interrupted run resumes with the
+remaining inputs. Coverage is merged in input order as traces come in and
+written to traces/coverage.csv and traces/edges_uniq.lst.
 """
 
 import os
@@ -20,6 +25,8 @@ import glob
 import shutil
 import msgpack
 import lz4.frame as lz4
+import multiprocessing
+import queue
 import re
 
 from common.config import DebugConfiguration
@@ -37,6 +44,34 @@ import csv
 # debug
 from debug.log import debug
 
+TRACE_TOKEN = re.compile(rb"\{.(\w+).: \[?(\d+),?(\d+)?\]? \}")
+MANIFEST = "manifest.jsonl"
+
+
+def parse_trace(data):
+    gaps = set()
+    bbs = set()
+    edges = set()
+    #for line in data.splitlines():
+    #    info = (json.loads(line.decode()))
+    #    if 'trace_enable' in info:
+    #        gaps.add(info['trace_enable'])
+    #    if 'edge' in info:
+    #        edges.add("%s_%s" % (info['edge'][0], info['edge'][1]))
+    #        bbs.add(info['edge'][0])
+    #        bbs.add(info['edge'][1])
+    # slightly faster than above line-wise json parsing
+    for m in TRACE_TOKEN.finditer(data):
+        if m.group(1) == b"trace_enable":
+            gaps.add(int(m.group(2)))
+        if m.group(1) == b"edge":
+            src, dst = int(m.group(2)), int(m.group(3))
+            edges.add((src, dst))
+            bbs.add(src)
+            bbs.add(dst)
+    return {'bbs': bbs, 'edges': edges, 'gaps': gaps}
+
+
 class TraceParser:
     def __init__(self):
         self.known_bbs = set()
@@ -47,35 +82,15 @@ class TraceParser:
             print_note("Could not find trace file %s, skipping.." % trace_file)
             return None
 
-        gaps = set()
-        bbs = set()
-        edges = set()
         with lz4.LZ4FrameFile(trace_file, 'rb') as f:
-            #for line in f.readlines():
-            #    info = (json.loads(line.decode()))
-            #    if 'trace_enable' in info:
-            #        gaps.add(info['trace_enable'])
-            #    if 'edge' in info:
-            #        edges.add("%s_%s" % (info['edge'][0], info['edge'][1]))
-            #        bbs.add(info['edge'][0])
-            #        bbs.add(info['edge'][1])
-            # slightly faster than above line-wise json parsing
-            for m in re.finditer("\{.(\w+).: \[?(\d+),?(\d+)?\]? \}", f.read().decode()):
-                if m.group(1) == "trace_enable":
-                    gaps.add(m.group(2))
-                if m.group(1) == "edge":
-                    edges.add("%s_%s" % (m.group(2), m.group(3)))
-                    bbs.add(m.group(2))
-                    bbs.add(m.group(3))
-        return {'bbs': bbs, 'edges': edges, 'gaps': gaps}
+            return parse_trace(f.read())
 
-    def get_cov_by_trace(self, trace_file, trace_id):
-        # note the return new BB count depends on the order in which traces are parsed
-        findings = self.parse_trace_file(trace_file, trace_id)
+    def get_cov_by_findings(self, findings, trace_id):
+        # note the return new BB count depends on the order in which traces are merged
         if not findings:
             return 0, 0
         if len(findings['gaps']) > 1:
-            print_note("Got multiple gaps in trace %s" % trace_file)
+            print_note("Got multiple gaps in trace %s" % trace_id)
 
         num_new_bbs = len(findings['bbs'] - self.known_bbs)
         num_new_edges = len(findings['edges'] - self.known_edges)
@@ -83,6 +98,57 @@ class TraceParser:
         self.known_edges.update(findings['edges'])
         return num_new_bbs, num_new_edges
 
+    def get_cov_by_trace(self, trace_file, trace_id):
+        return self.get_cov_by_findings(self.parse_trace_file(trace_file, trace_id), trace_id)
+
+
+class CoverageMerger:
+    """
+    Merge per-input findings into the total coverage, strictly in input
+    order so that the plot matches a sequential run. Findings arriving
+    early are held back until all earlier inputs are merged.
+    """
+
+    def __init__(self, trace_dir, input_list):
+        self.trace_dir = trace_dir
+        self.input_list = input_list
+        self.cursor = 0
+        self.findings = dict()
+        self.total_bbs = 0
+        self.total_edges = 0
+        self.trace_parser = TraceParser()
+
+        self.plot_file = trace_dir + "coverage.csv"
+        self.plot = open(self.plot_file, 'w')
+
+    def add(self, input_path, findings):
+        self.findings[input_path] = findings
+        while self.cursor < len(self.input_list):
+            input_path, nid, timestamp = self.input_list[self.cursor]
+            if input_path not in self.findings:
+                break
+            new_bbs, new_edges = self.trace_parser.get_cov_by_findings(self.findings.pop(input_path), nid)
+            self.total_bbs += new_bbs
+            self.total_edges += new_edges
+            self.plot.write("%d;%d;%d\n" % (timestamp, self.total_bbs, self.total_edges))
+            self.cursor += 1
+
+    def add_from_trace(self, input_path):
+        filename = self.trace_dir + os.path.basename(input_path) + ".lz4"
+        self.add(input_path, self.trace_parser.parse_trace_file(filename, input_path))
+
+    def close(self):
+        self.plot.close()
+        print(" Writing coverage data to %s..." % self.plot_file)
+
+        edges_file = self.trace_dir + "edges_uniq.lst"
+        with open(edges_file, 'w') as f:
+            for src, dst in sorted(self.trace_parser.known_edges):
+                f.write("%d,%d\n" % (src, dst))
+        print(" Writing unique edges to %s..." % edges_file)
+
+        print(" Processed %d traces with a total of %d BBs (%d edges)." % (self.cursor, self.total_bbs, self.total_edges))
+
 
 def afl_workdir_iterator(work_dir):
     id_to_time = dict()
@@ -162,49 +228,25 @@ def get_inputs_by_time(data_dir):
     input_data.sort(key=itemgetter(2))
 
     # debug
-    debug(input_data)
+    debug("Found %d inputs" % len(input_data))
 
     return input_data
 
 
-def generate_traces(config, input_list):
-
-    is_purge = config.argument_values['purge']
+def trace_worker(config, qemu_id, trace_dir, jobs, results):
     work_dir = config.argument_values['work_dir']
-    data_dir = config.argument_values["input"]
-    trace_dir = data_dir + "/traces/"
-
-    if data_dir == work_dir:
-        print_note("Workdir must be separate from input/data dir. Aborting.")
-        return None
-
-    prepare_working_dir(config.argument_values['work_dir'], is_purge)
+    trace_file = work_dir + "/redqueen_workdir_%d/pt_trace_results.txt" % qemu_id
 
-    if os.path.exists(trace_dir):
-        print_note("Input data_dir already has a traces/ subdir. Skipping trace generation..\n")
-        return trace_dir
-
-    # real deal. delete trace dir if it exists and (re-)create traces
-    shutil.rmtree(trace_dir, ignore_errors=True)
-    os.makedirs(trace_dir)
-
-    # TODO What is the effect of not defining a trace region? will it trace?
-    if not config.argument_values['ip0']:
-        print_warning("No trace region configured!")
-
-    if os.path.exists(work_dir + "redqueen_workdir_1337"):
-        print_fail("Leftover files from 1337 instance. This should not happen.")
-        return None
-
-    q = qemu(1337, config, debug_mode=False)
+    q = qemu(qemu_id, config, debug_mode=False)
     if not q.start():
-        print_fail("Could not start Qemu. Exit.")
-        return None
-
-    start = time.time()
+        print_fail("Could not start Qemu %d." % qemu_id)
+        return
 
     try:
-        for input_path, nid, timestamp in input_list:
+        while True:
+            input_path = jobs.get()
+            if input_path is None:
+                break
             print("Processing: %s" % input_path)
 
             q.set_payload(read_binary_file(input_path))
@@ -213,54 +255,128 @@ def generate_traces(config, input_list):
             if not exec_res:
                 print_note("Failed to execute input %s. Continuing anyway..." % input_path)
                 q.restart()
+                results.put((qemu_id, input_path, None))
                 continue
 
             # TODO: reboot by default, persistent by option
             if exec_res.is_crash():
                 q.restart()
 
-            with open(work_dir + "/redqueen_workdir_1337/pt_trace_results.txt", 'rb') as f_in:
-                with lz4.LZ4FrameFile(trace_dir + os.path.basename(input_path) + ".lz4", 'wb', compression_level=lz4.COMPRESSIONLEVEL_MINHC) as f_out:
-                        shutil.copyfileobj(f_in, f_out)
-
-    except:
-        raise
+            data = read_binary_file(trace_file)
+            with lz4.LZ4FrameFile(trace_dir + os.path.basename(input_path) + ".lz4", 'wb', compression_level=lz4.COMPRESSIONLEVEL_MINHC) as f_out:
+                f_out.write(data)
+            results.put((qemu_id, input_path, parse_trace(data)))
     finally:
         q.async_exit()
 
-    end = time.time()
-    print("Time taken: %.2fs" % (end - start))
-    return trace_dir
 
+def read_manifest(manifest_file):
+    """ Inputs traced successfully by an earlier run, failed ones are retried """
+    done = set()
+    if not os.path.exists(manifest_file):
+        return done
+    with open(manifest_file, 'r') as f:
+        for line in f:
+            try:
+                entry = json.loads(line)
+            except ValueError:
+                # last line of an interrupted run
+                continue
+            if entry.get("ok"):
+                done.add(entry["input"])
+    return done
 
-def plot_bbs_from_traces(trace_dir, input_list):
 
-    input_to_new_bbs = list()
-    trace_parser = TraceParser()
+def generate_traces(config, input_list):
 
-    for input_path, nid, timestamp in input_list:
-        filename = os.path.basename(input_path) + ".lz4"
-        new_bbs, new_edges = trace_parser.get_cov_by_trace(trace_dir + filename, nid)
-        input_to_new_bbs.append([timestamp, new_bbs, new_edges])
+    is_purge = config.argument_values['purge']
+    work_dir = config.argument_values['work_dir']
+    data_dir = config.argument_values["input"]
+    num_workers = max(1, config.argument_values['p'])
+    trace_dir = data_dir + "/traces/"
+    manifest_file = trace_dir + MANIFEST
 
-    total_bbs = 0
-    total_edges = 0
+    if data_dir == work_dir:
+        print_note("Workdir must be separate from input/data dir. Aborting.")
+        return None
 
-    # should be already sorted b/c get_cov_by_trace() expects sorted inputs
-    input_to_new_bbs.sort(key=itemgetter(0))
+    prepare_working_dir(config.argument_values['work_dir'], is_purge)
 
-    # write output to .csv
-    plot_file = trace_dir + "coverage.csv"
-    print(" Writing coverage data to %s..." % plot_file)
-    with open(plot_file, 'w') as f:
-        for item in input_to_new_bbs:
-            total_bbs += item[1]
-            total_edges += item[2]
-            plot_data = "%d;%d;%d\n" % (item[0], total_bbs, total_edges)
-            f.write(plot_data)
+    if os.path.exists(trace_dir) and not os.path.exists(manifest_file):
+        print_note("Input data_dir already has a traces/ subdir. Skipping trace generation..\n")
+        merger = CoverageMerger(trace_dir, input_list)
+        for input_path, nid, timestamp in input_list:
+            merger.add_from_trace(input_path)
+        merger.close()
+        return trace_dir
 
-    print(" Processed %d traces with a total of %d BBs (%d edges)." % (len(input_to_new_bbs), total_bbs, total_edges))
+    os.makedirs(trace_dir, exist_ok=True)
+    done = read_manifest(manifest_file)
+    if done:
+        print_note("Resuming trace generation, %d of %d inputs already done." % (len(done), len(input_list)))
 
+    # TODO What is the effect of not defining a trace region? will it trace?
+    if not config.argument_values['ip0']:
+        print_warning("No trace region configured!")
+
+    qemu_ids = [1337 + i for i in range(num_workers)]
+    for qemu_id in qemu_ids:
+        if os.path.exists(work_dir + "/redqueen_workdir_%d" % qemu_id):
+            print_fail("Leftover files from %d instance. This should not happen." % qemu_id)
+            return None
+
+    merger = CoverageMerger(trace_dir, input_list)
+    timestamps = {input_path: timestamp for input_path, nid, timestamp in input_list}
+    jobs = multiprocessing.Queue()
+    results = multiprocessing.Queue()
+    pending = 0
+    for input_path, nid, timestamp in input_list:
+        if input_path in done:
+            continue
+        jobs.put(input_path)
+        pending += 1
+    for _ in qemu_ids:
+        jobs.put(None)
+
+    workers = [multiprocessing.Process(name="Trace %d" % qemu_id, target=trace_worker,
+                                       args=(config, qemu_id, trace_dir, jobs, results))
+               for qemu_id in qemu_ids]
+    for worker in workers:
+        worker.start()
+
+    start = time.time()
+    try:
+        with open(manifest_file, 'a') as manifest:
+            for input_path, nid, timestamp in input_list:
+                if input_path in done:
+                    merger.add_from_trace(input_path)
+
+            while pending:
+                try:
+                    qemu_id, input_path, findings = results.get(timeout=1)
+                except queue.Empty:
+                    if not any(worker.is_alive() for worker in workers):
+                        break
+                    continue
+                manifest.write(json.dumps({"input": input_path, "ok": findings is not None,
+                                           "time": timestamps[input_path]}) + "\n")
+                manifest.flush()
+                merger.add(input_path, findings)
+                pending -= 1
+    finally:
+        # on Ctrl-C, workers get SIGINT as well and shut down their Qemu
+        for worker in workers:
+            worker.join(timeout=10)
+            if worker.is_alive():
+                worker.terminate()
+        merger.close()
+
+    end = time.time()
+    print("Time taken: %.2fs" % (end - start))
+    if pending:
+        print_fail("%d inputs left, all Qemu instances have exited. Rerun to resume." % pending)
+        return None
+    return trace_dir
 
 
 def main():
@@ -291,8 +407,6 @@ def main():
     if not trace_dir:
         return -1
 
-    plot_bbs_from_traces(trace_dir, input_list)
-
 
 if __name__ == "__main__":
     main()
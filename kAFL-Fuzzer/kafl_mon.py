@@ -8,6 +8,7 @@ import inotify.adapters
 from threading import Thread, Lock
 
 from common.util import read_binary_file
+from common import telemetry
 from kafl_fuzz import PAYQ
 
 WORKDIR = ''
@@ -176,8 +177,19 @@ class MonitorInterface:
         self.stdscr.addstr(self.y, 37, '─'*42 + '┤', DIM)
         self.y += 1
 
-    def print_bottom_line(self):
-        self.stdscr.addstr(self.y, 0, '└' + '─'*78 + '┘', DIM)
+    def print_phases(self):
+        self.stdscr.addstr(self.y, 0, '├─', DIM)
+        self.stdscr.addstr(self.y, 2, ' qemu phases ', color(CYAN))
+        self.stdscr.addstr(self.y, 15, '─'*21 + '┬─', DIM)
+        self.stdscr.addstr(self.y, 38, ' usec recent/avg ', color(CYAN))
+        self.stdscr.addstr(self.y, 55, '─'*24 + '┤', DIM)
+        self.y += 1
+
+    def print_bottom_line(self, split=False):
+        if split:
+            self.stdscr.addstr(self.y, 0, '└' + '─'*35 + '┴' + '─'*42 + '┘', DIM)
+        else:
+            self.stdscr.addstr(self.y, 0, '└' + '─'*78 + '┘', DIM)
 
     def print_info_line(self, pairs, sep=" │ ", end="│", prefix="", dynaidx=None):
         x = 0
@@ -212,6 +224,7 @@ class MonitorData:
         self.workdir = workdir
         self.exec_avg = 0
         self.slave_stats = []
+        self.telemetry = {}
         self.load_initial()
 
     def load_initial(self):
@@ -311,6 +324,22 @@ class MonitorData:
             return None
         return self.starttime + self.runtime() - time_stamp
 
+    def load_telemetry(self):
+        self.telemetry = telemetry.read_all(self.workdir)
+
+    def phase_breakdown(self):
+        """ [(phase, recent_us, mean_us, regression)] averaged over all Qemu instances """
+        per_slave = [x["qemu"]["phases"] for x in self.telemetry.values() if "phases" in x.get("qemu", {})]
+        if not per_slave:
+            return []
+        breakdown = []
+        for name in telemetry.PHASE_NAMES:
+            recent = sum([x[name]["recent_us"] for x in per_slave]) / len(per_slave)
+            mean = sum([x[name]["mean_us"] for x in per_slave]) / len(per_slave)
+            regression = any([x[name]["regression"] for x in per_slave])
+            breakdown.append((name, recent, mean, regression))
+        return breakdown
+
     def bitmap_size(self):
         return 64 * 1024
 
@@ -427,6 +456,7 @@ class MonitorDrawer:
                 self.data.mem = mem_info
                 self.data.cpu = cpu_info
                 self.data.swap = swap_info
+                self.data.load_telemetry()
                 self.draw()
             finally:
                 self.inf_mutex.release()
@@ -491,7 +521,18 @@ class MonitorDrawer:
             (72, "         size", pbyte(payload_len) + " bytes")])
         self.inf.print_info_line([
             (72, "      payload", PAYLOAD[:20])])
-        self.inf.print_bottom_line()
+
+        # per-phase breakdown of the Qemu exec cycle, '!' marks a regression
+        phases = d.phase_breakdown()
+        if phases:
+            self.inf.print_phases()
+            for i in range(0, len(phases), 2):
+                pairs = []
+                for name, recent, mean, regression in phases[i:i+2]:
+                    pairs.append((29 if not pairs else 34, name.rjust(12),
+                                  "%s/%s%s" % (pfloat(recent), pfloat(mean), " !" if regression else "")))
+                self.inf.print_info_line(pairs)
+        self.inf.print_bottom_line(split=bool(phases))
 
         # refresh screen buffer
         self.inf.refresh()
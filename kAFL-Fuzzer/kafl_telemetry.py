@@ -0,0 +1,45 @@
+#!/usr/bin/env python3.8
+#
+# Copyright (C) 2020 Intel Corporation
+#
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Snapshot the shared-memory telemetry of a running kAFL campaign.
+
+Prints per-slave and per-Qemu counters and latency percentiles as CSV or JSON.
+Use -i <sec> to keep sampling, e.g. for plotting.
+"""
+
+import argparse
+import sys
+import time
+
+from common.telemetry import read_all, to_csv, to_json
+
+
+def main():
+    parser = argparse.ArgumentParser(description="kAFL telemetry snapshot exporter")
+    parser.add_argument("work_dir", help="kAFL workdir of the campaign")
+    parser.add_argument("-f", "--format", choices=["csv", "json"], default="csv", help="output format")
+    parser.add_argument("-i", "--interval", type=float, default=0, help="repeat every n seconds")
+    args = parser.parse_args()
+
+    while True:
+        snapshots = read_all(args.work_dir)
+        if not snapshots:
+            print("No telemetry found for %s" % args.work_dir, file=sys.stderr)
+            return 1
+
+        if args.format == "json":
+            print(to_json({"time": time.time(), "slaves": snapshots}))
+        else:
+            print(to_csv(snapshots), end="")
+
+        if not args.interval:
+            return 0
+        time.sleep(args.interval)
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -218,6 +218,7 @@ def compile(config):
         if len(config.argument_values["file"]) != 0:
             argv_template += "uint8_t stdin_mode = 0;\n"
             argv_template += "char* output_filename = \"" + config.argument_values["file"] + "\";\n"
+            argv_template += "uint8_t memfd_mode = " + str(int(config.argument_values["memfd"])) + ";\n"
         else:
             argv_template += "char* output_filename = \"\";\n"
             argv_template += "uint8_t stdin_mode = 1;\n"
@@ -232,6 +233,7 @@ def compile(config):
             argv_template += "uint8_t asan_enabled = 0;\n"
 
         argv_template += "uint32_t memlimit = " + str(config.argument_values["m"]) + ";\n"
+        argv_template += "uint32_t persistent_iterations = " + str(config.argument_values["persistent"]) + ";\n"
 
         f = open(tmp_folder + "argv.c", "w")
         f.write(argv_template)
@@ -0,0 +1,64 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test slave-side crash signatures and deduplication budget
+"""
+
+import ctypes
+import struct
+
+import common.telemetry as telemetry
+from fuzzer.bitmap import GlobalBitmap
+from fuzzer.crash_index import CrashIndex
+
+
+def edge_signature(baseline, crash):
+    size = len(baseline)
+    return GlobalBitmap.bitmap_native_so.crash_edge_signature((ctypes.c_uint8 * size)(*baseline),
+                                                              (ctypes.c_uint8 * size)(*crash),
+                                                              ctypes.c_uint64(size))
+
+
+def test_crash_budget():
+    index = CrashIndex(budget=2, max_signatures=3)
+    assert [index.submit(("crash", 0x1000)) for _ in range(4)] == [True, True, False, False]
+    assert index.submit(("kasan", 0x1000))
+    assert index.submit(("crash", 0x2000))
+
+    # full index sends unknown signatures but no longer tracks them
+    assert index.submit(("crash", 0x3000))
+    assert index.submit(("crash", 0x3000))
+    assert len(index) == 3
+
+
+def test_edge_signature():
+    baseline = [0] * 256
+    for i in range(0, 128):
+        baseline[i] = 1
+
+    crash_a = baseline[:64] + [0] * 192
+    crash_a[200] = crash_a[210] = 1
+    # other baseline coverage and hit counts, same crash-only edges
+    crash_b = [0] * 64 + baseline[64:]
+    crash_b[200] = 4
+    crash_b[210] = 1
+    crash_c = list(crash_a)
+    crash_c[220] = 1
+
+    assert edge_signature(baseline, crash_a) == edge_signature(baseline, crash_b)
+    assert edge_signature(baseline, crash_a) != edge_signature(baseline, crash_c)
+
+
+def test_crash_ip(tmp_path):
+    filename = str(tmp_path / "telemetry")
+    telemetry.create_segment(filename)
+    writer = telemetry.TelemetryWriter(filename)
+    assert writer.crash_ip() == 0
+    assert "crash_ip" not in telemetry.TelemetryReader(filename).snapshot()["qemu"]
+
+    # as written by Qemu on a kernel PANIC/KASAN report
+    block = telemetry.HEADER_SIZE + telemetry.BLOCK_QEMU * telemetry.BLOCK_SIZE
+    struct.pack_into("<Q", writer.mm, block + 8 * telemetry.W_CRASH_IP, 0xffffffff81000000)
+    assert writer.crash_ip() == 0xffffffff81000000
+    assert telemetry.TelemetryReader(filename).snapshot()["qemu"]["crash_ip"] == 0xffffffff81000000
@@ -0,0 +1,74 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test corpus min-set computation used for distillation
+"""
+
+import random
+from fuzzer.distill import MinSet
+
+BITMAP_SIZE = 1024
+
+
+def bitmap(entries):
+    data = bytearray(BITMAP_SIZE)
+    for index, value in entries.items():
+        data[index] = value
+    return bytes(data)
+
+
+def features(data):
+    return {(i, v) for i, v in enumerate(data) if v}
+
+
+def test_minset_weights():
+    minset = MinSet(BITMAP_SIZE)
+    minset.add(1, bitmap({1: 1, 2: 1, 3: 1, 4: 1}), 10.0)
+    minset.add(2, bitmap({1: 1, 2: 1}), 1.0)
+    minset.add(3, bitmap({3: 1, 4: 1}), 1.0)
+    minset.add(4, bitmap({1: 1}), 0.1)
+    # same index, other hit count bucket
+    minset.add(5, bitmap({2: 4}), 100.0)
+    assert len(minset) == 5
+    assert minset.compute() == [2, 3, 4, 5]
+
+    # cheaper now than 2 and 3 together
+    minset.set_weight(1, 1.5)
+    assert minset.compute() == [1, 4, 5]
+
+    # re-adding replaces the node's coverage
+    minset.add(5, bitmap({}), 100.0)
+    assert len(minset) == 4
+    assert minset.compute() == [1, 4]
+
+
+def test_minset_readd():
+    minset = MinSet(BITMAP_SIZE)
+    minset.add(1, bitmap({i: 1 for i in range(0, 64)}), 1.0)
+    minset.add(2, bitmap({64: 1}), 1.0)
+    memory = minset.memory()
+    # features of replaced nodes are reused, not accumulated
+    for n in range(1000):
+        minset.add(1, bitmap({i: 1 for i in range(n % 64, 64 + n % 64)}), 1.0)
+        minset.add(2, bitmap({i: 2 for i in range(64, 66 + n % 2)}), 1.0)
+    assert minset.memory() <= 2 * memory
+    assert len(minset) == 2
+    assert minset.compute() == [1, 2]
+
+
+def test_minset_coverage():
+    random.seed(0)
+    minset = MinSet(BITMAP_SIZE)
+    bitmaps = dict()
+    for nid in range(1, 2000):
+        entries = {random.randrange(256): 1 << random.randrange(2) for _ in range(random.randint(1, 16))}
+        bitmaps[nid] = bitmap(entries)
+        minset.add(nid, bitmaps[nid], random.random())
+
+    kept = minset.compute()
+    total = set().union(*[features(data) for data in bitmaps.values()])
+    covered = set().union(*[features(bitmaps[nid]) for nid in kept])
+    assert covered == total
+    # 512 distinct features, each kept node added at least one of them
+    assert len(kept) <= len(total) < len(bitmaps) // 2
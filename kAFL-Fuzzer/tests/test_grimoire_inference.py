@@ -0,0 +1,82 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test native Grimoire generalization with batched probes
+"""
+
+from fuzzer.technique.grimoire_inference import GeneralizedInput, GrimoireInference
+
+
+class Config:
+    argument_values = {"dict": None}
+
+
+def make_inference(oracle, batches=None, execs=None):
+    def verify_input(payload, old_node):
+        if execs is not None:
+            execs.append(payload)
+        return oracle(payload)
+
+    def verify_inputs(payloads, old_node):
+        if batches is not None:
+            batches.append(len(payloads))
+        for payload in payloads:
+            yield verify_input(payload, old_node)
+    return GrimoireInference(Config(), verify_input, verify_inputs)
+
+
+def test_generalized_input():
+    g = GeneralizedInput(b"a(b)c)d.e")
+    assert g.closure(0, ord("("), ord(")")) == (1, [6, 4])
+    assert g.closure(2, ord("("), ord(")")) == (9, [])
+    assert g.cuts_split(ord(".")) == [(0, 8), (8, 9)]
+    assert g.cuts_fixed(4) == [(0, 4), (4, 8), (8, 9)]
+    assert g.render([(1, 4), GeneralizedInput.NO_CUT, (8, 9)]) == [b"ac)d.e", b"a(b)c)d.e", b"a(b)c)d."]
+
+    g.apply([(1, 3), (3, 5)])
+    assert g.cuts_fixed(2) == [(0, 2), (4, 6), (6, 8), (8, 9)]
+    g.trim()
+    assert len(g) == 6
+    assert g.to_list() == [b"a", b"", b")", b"d", b".", b"e"]
+
+
+def test_generalize_input():
+    batches = []
+    inference = make_inference(lambda payload: b"needle" in payload, batches)
+    result = inference.generalize_input(b"foo bar.baz needle; qux (x)", {"new_bytes": {}})
+    assert result == (b"",) + tuple(bytes([c]) for c in b"needle") + (b"",)
+    assert max(batches) > 1
+    assert inference.generalized_to_string(result) == b"needle"
+    assert (b"n", b"e", b"e", b"d", b"l", b"e") in inference.tokens
+
+
+def test_generalize_interacting_cuts():
+    # each 'x' can be removed alone, but not both
+    inference = make_inference(lambda payload: payload.count(b"x") >= 1 and payload.startswith(b"a"))
+    result = inference.generalize_input(b"axxb", {"new_bytes": {}})
+    assert inference.generalized_to_string(result) == b"ax"
+
+
+def test_generalize_closures():
+    inference = make_inference(lambda payload: payload.startswith(b"f(") and payload.endswith(b")"))
+    result = inference.generalize_input(b"f(1, [2, 3])", {"new_bytes": {}})
+    assert inference.generalized_to_string(result) == b"f()"
+
+
+def test_closures_stop_at_first_accepted():
+    execs = []
+    inference = make_inference(lambda payload: True, execs=execs)
+    generalized = GeneralizedInput(b"(a)b)c)d")
+    inference.find_gaps_in_closures(generalized, {"new_bytes": {}}, ord("("), ord(")"))
+    # the outermost closure is accepted, the inner ones are never executed
+    assert execs == [b"d"]
+    assert generalized.render([GeneralizedInput.NO_CUT]) == [b"d"]
+
+
+def test_single_accepted_cut_not_verified_again():
+    execs = []
+    inference = make_inference(lambda payload: payload.startswith(b"ab"), execs=execs)
+    generalized = GeneralizedInput(b"abc")
+    inference.find_gaps(generalized, {"new_bytes": {}}, generalized.cuts_fixed(1))
+    assert execs == [b"bc", b"ac", b"ab"]
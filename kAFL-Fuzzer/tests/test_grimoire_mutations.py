@@ -0,0 +1,112 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test native Grimoire input/token store and havoc mutators
+"""
+
+import sys
+
+import fuzzer.technique.grimoire_mutations as grimoire
+from fuzzer.technique.grimoire_inference import GrimoireInference, GrimoireStore, to_elems
+from fuzzer.technique.grimoire_mutations import GrimoireMutator
+
+
+def generalize(s):
+    """ 'a_b' -> (b'a', b'', b'b') """
+    return tuple(b'' if c == '_' else c.encode() for c in s)
+
+
+class Inference:
+    def __init__(self, inputs, tokens):
+        self.generalized_inputs = GrimoireStore()
+        self.tokens = GrimoireStore()
+        for i in inputs:
+            self.generalized_inputs.add(generalize(i))
+        for t in tokens:
+            self.tokens.add(generalize(t))
+
+
+def test_store():
+    store = GrimoireStore()
+    assert len(store) == 0
+    assert store.add(generalize("_ab_")) == 1
+    assert store.add(generalize("ab")) == 1
+    assert store.add(generalize("_ab_")) == 2
+    assert store.add(()) == 1
+    assert len(store) == 3
+    assert store.count(generalize("_ab_")) == 2
+    assert generalize("ab") in store
+    assert generalize("a_b") not in store
+    assert [store[i] for i in range(len(store))] == [generalize("_ab_"), generalize("ab"), ()]
+
+    for i in range(10000):
+        store.add(generalize("token%d" % i))
+    assert len(store) == 10003
+    assert store[3] == generalize("token0")
+    as_dict = {generalize("token%d" % i): 0 for i in range(10000)}
+    python_size = sys.getsizeof(as_dict) + sum(sys.getsizeof(t) for t in as_dict)
+    assert store.memory() < python_size / 2
+
+
+def test_random_payload():
+    inference = Inference(["_a_b_", "cd"], ["xy"])
+    allowed = {b"ab", b"cd", b"xy", b"a", b"b", b""}
+    seen = set()
+    mutator = GrimoireMutator()
+    mutator.seed()
+    for _ in range(1000):
+        payload = mutator.random_payload(inference)
+        assert payload in allowed
+        seen.add(payload)
+    assert seen == allowed
+
+
+def test_recursive_replacement():
+    mutator = GrimoireMutator()
+    mutator.seed()
+    elems = to_elems(generalize("_foo_bar_"))
+
+    inference = Inference(["_"], ["_"])
+    assert mutator.recursive_replacement(elems, inference, 8) == b"foobar"
+
+    inference = Inference(["_x_"], ["_"])
+    grown = False
+    for _ in range(100):
+        data = mutator.recursive_replacement(elems, inference, 8)
+        assert data.replace(b"x", b"") == b"foobar"
+        grown |= len(data) > len(b"foobar")
+    assert grown
+
+    # results are cut short at the buffer size
+    small = GrimoireMutator(cap=16)
+    small.seed()
+    for _ in range(100):
+        assert len(small.recursive_replacement(elems, inference, 64)) <= 16
+
+
+def test_replace():
+    mutator = GrimoireMutator()
+    payload = b"if (a) { b = a; }"
+    for start, end in [(4, 5), (0, 2), (16, 17)]:
+        needle = payload[start:end]
+        assert mutator.replace(payload, start, end, b"XYZ", False) == payload[:start] + b"XYZ" + payload[end:]
+        assert mutator.replace(payload, start, end, b"XYZ", True) == payload.replace(needle, b"XYZ")
+    assert mutator.replace(b"aaaa", 0, 2, b"b", True) == b"bb"
+
+    assert GrimoireMutator(cap=8).replace(payload, 4, 5, b"XYZ", True) == b"if (XYZ)"
+
+
+def test_havoc():
+    class Config:
+        argument_values = {"dict": None}
+
+    inference = GrimoireInference(Config(), None)
+    inference.add_to_inputs(generalize("_(_)_"))
+    inference.add_to_inputs(generalize("_1_+_2_"))
+
+    results = []
+    grimoire.havoc(generalize("f(_)"), lambda data, label: results.append((label, data)), inference, 10, True)
+    assert len(results) == 30
+    assert {label for label, _ in results} == {"grim_extension", "grim_recursive"}
+    assert all(b"f(" in data for _, data in results)
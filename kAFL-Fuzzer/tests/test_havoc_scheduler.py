@@ -0,0 +1,91 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test adaptive havoc operator scheduling and sharing of its statistics
+"""
+
+import common.telemetry as telemetry
+import fuzzer.technique.havoc as havoc
+import fuzzer.technique.havoc_scheduler as havoc_scheduler
+from fuzzer.technique.havoc_handler import havoc_handler
+from fuzzer.technique.havoc_scheduler import HavocScheduler, merge_stats
+
+
+def op_a(data):
+    return data
+
+
+def op_b(data):
+    return data
+
+
+def op_c(data):
+    return data
+
+
+def test_bias_towards_yield():
+    sched = HavocScheduler([op_a, op_b, op_c, op_b], 4)
+    assert sched.names == ["op_a", "op_b", "op_c"]
+    assert sched.ops.probabilities() == [1, 1, 1]
+
+    for i in range(20 * havoc_scheduler.UPDATE_EXECS):
+        op, _ = sched.pick_handler()
+        stacking = sched.pick_stacking()
+        sched.record([op], stacking, op == 2 and stacking == 1 and i % 10 == 0)
+
+    ops = sched.ops.probabilities()
+    depths = sched.depths.probabilities()
+    assert abs(sum(ops) - 1) < 1e-9
+    assert ops[2] > 0.5 and depths[1] > 0.4
+    assert min(ops) >= havoc_scheduler.EXPLORE / 3 - 1e-9
+    assert min(depths) >= havoc_scheduler.EXPLORE / 4 - 1e-9
+
+
+def test_share_with_master():
+    slaves = [HavocScheduler([op_a, op_b], 2) for _ in range(2)]
+    slaves[0].record([0, 0], 0, True)
+    slaves[1].record([1], 1, False)
+
+    total = {"ops": {}, "depths": []}
+    for sched in slaves:
+        merge_stats(total, sched.share(force=True))
+    assert total == {"ops": {"op_a": [2, 2], "op_b": [1, 0]}, "depths": [[1, 1], [1, 0]]}
+    assert slaves[0].share() is None
+
+    # counts are not lost between sharing and receiving the totals
+    slaves[1].record([1], 1, True)
+    slaves[1].set_global(total)
+    assert slaves[1].counts() == {"ops": [[2, 2], [2, 1]], "depths": [[1, 1], [2, 1]]}
+
+
+def test_havoc_feedback():
+    havoc.scheduler = HavocScheduler(havoc_handler, havoc.AFL_HAVOC_STACK_POW2)
+    execs = []
+
+    def execute(data, state=None):
+        execs.append(data)
+        return None, len(execs) % 2 == 0
+
+    havoc.mutate_seq_havoc_array(b"ABCDEFGH" * 4, execute, 50)
+    assert len(execs) == 50
+    depths = havoc.scheduler.counts()["depths"]
+    assert sum(uses for uses, _ in depths) == 50
+    assert sum(finds for _, finds in depths) == 25
+    assert sum(uses for uses, _ in havoc.scheduler.counts()["ops"]) >= 100
+    havoc.scheduler = None
+
+
+def test_telemetry(tmp_path):
+    filename = str(tmp_path / "telemetry")
+    telemetry.create_segment(filename)
+    writer = telemetry.TelemetryWriter(filename)
+    assert "havoc" not in telemetry.TelemetryReader(filename).snapshot()["slave"]
+
+    writer.set_havoc_names(["op_a", "op_b"])
+    writer.havoc([[100, 1], [0, 0], [10, 5]], [[50, 3]])
+    summary = telemetry.TelemetryReader(filename).snapshot()["slave"]["havoc"]
+    assert summary["ops"] == {"op_a": {"uses": 100, "finds": 1, "yield": 0.01},
+                              "op_2": {"uses": 10, "finds": 5, "yield": 0.5}}
+    assert summary["depths"] == {"stack_2": {"uses": 50, "finds": 3, "yield": 0.06}}
+    assert "havoc_op_a_yield" in telemetry.to_csv({"0": telemetry.TelemetryReader(filename).snapshot()})
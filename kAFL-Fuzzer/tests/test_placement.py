@@ -0,0 +1,69 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test CPU pair / NUMA placement of slaves on synthetic sysfs topologies
+"""
+
+import os
+
+from common.placement import CpuTopology, Placement, parse_cpulist
+
+
+def make_sysfs(root, nodes, smt):
+    """ nodes: list of CPU lists per node; SMT siblings are cpu and cpu + num_cpus // smt """
+    cpus = sorted(cpu for node in nodes for cpu in node)
+    stride = len(cpus) // smt
+    os.makedirs(str(root / "cpu"))
+    (root / "cpu" / "online").write_text("0-%d\n" % (len(cpus) - 1))
+    for node, node_cpus in enumerate(nodes):
+        path = root / "node" / ("node%d" % node)
+        os.makedirs(str(path))
+        (path / "cpulist").write_text(",".join(str(c) for c in node_cpus) + "\n")
+    for cpu in cpus:
+        path = root / "cpu" / ("cpu%d" % cpu) / "topology"
+        os.makedirs(str(path))
+        (path / "physical_package_id").write_text("%d\n" % [n for n, c in enumerate(nodes) if cpu in c][0])
+        (path / "core_id").write_text("%d\n" % (cpu % stride))
+    return str(root)
+
+
+def test_parse_cpulist():
+    assert parse_cpulist("0-3,8,10-11\n") == {0, 1, 2, 3, 8, 10, 11}
+    assert parse_cpulist("") == set()
+
+
+def test_smt_pairs(tmp_path):
+    # 4 cores with 2 threads each, siblings are n and n+4
+    topology = CpuTopology(make_sysfs(tmp_path, [list(range(8))], smt=2))
+    placement = Placement(topology, 3)
+    assert [(s.slave_cpu, s.qemu_cpu) for s in placement.slots] == [(0, 4), (1, 5), (2, 6)]
+    assert placement.master_cpus == {3, 7}
+
+
+def test_numa_interleave(tmp_path):
+    # 2 nodes with 4 cores each, no SMT
+    topology = CpuTopology(make_sysfs(tmp_path, [[0, 1, 2, 3], [4, 5, 6, 7]], smt=1))
+    placement = Placement(topology, 4)
+    assert placement.slots[0] == (0, 1, 0)
+    assert placement.slots[1] == (4, 5, 1)
+    assert placement.slots[2] == (2, 3, 0)
+    assert placement.slots[3] == (6, 7, 1)
+    # no CPU left, Master shares all of them
+    assert placement.master_cpus == set(range(8))
+
+
+def test_limits(tmp_path):
+    topology = CpuTopology(make_sysfs(tmp_path, [list(range(8))], smt=2))
+
+    # first n CPUs only, cores 0 and 1 lose their siblings and pair up
+    placement = Placement(topology, 1, num_cpus=4)
+    assert placement.cpus == {0, 1, 2, 3}
+    assert placement.slots[0] == (0, 1, 0)
+    assert placement.master_cpus == {2, 3}
+
+    # more slaves than pairs share them
+    placement = Placement(topology, 6, allowed={0, 4, 1, 5})
+    assert [s[:2] for s in placement.slots] == [(0, 4), (1, 5)] * 3
+    assert placement.slot(5) == placement.slots[5]
+    assert placement.slot(1337) is None
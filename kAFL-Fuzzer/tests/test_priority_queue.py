@@ -0,0 +1,51 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test indexed max-heap used for queue scheduling
+"""
+
+import random
+from fuzzer.priority_queue import IndexedMaxHeap
+
+
+def check_top(heap, keys, k):
+    expected = sorted(keys, key=lambda item: keys[item], reverse=True)[:k]
+    assert [keys[item] for item in heap.top(k)] == [keys[item] for item in expected]
+
+
+def test_heap_update():
+    random.seed(0)
+    heap = IndexedMaxHeap()
+    keys = dict()
+
+    for item in range(2000):
+        keys[item] = (random.randint(0, 8), random.random(), item)
+        heap.update(item, keys[item])
+    check_top(heap, keys, 64)
+
+    # re-key random entries up and down
+    for _ in range(5000):
+        item = random.randrange(2000)
+        keys[item] = (random.randint(0, 8), random.random(), item)
+        heap.update(item, keys[item])
+    check_top(heap, keys, 64)
+    check_top(heap, keys, len(keys))
+
+    for item in random.sample(list(keys), 500):
+        heap.remove(item)
+        keys.pop(item)
+    assert len(heap) == len(keys)
+    check_top(heap, keys, 100)
+
+
+def test_heap_small():
+    heap = IndexedMaxHeap()
+    assert heap.top(4) == []
+    heap.update("a", (1, 0))
+    heap.update("b", (2, 0))
+    assert heap.top(4) == ["b", "a"]
+    heap.update("b", (0, 0))
+    assert heap.top(1) == ["a"]
+    heap.remove("a")
+    assert heap.top(4) == ["b"]
@@ -0,0 +1,100 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test sizing and hand-over of the standby Qemu pool with fake instances
+"""
+
+import time
+
+import common.standby as standby
+
+
+class FakeQemu:
+
+    def __init__(self, index):
+        self.index = index
+        self.alive = False
+        self.boots = 0
+        self.closed = False
+
+    def start(self):
+        self.boots += 1
+        self.alive = True
+        return True
+
+    def is_alive(self):
+        return self.alive
+
+    def shutdown(self):
+        self.alive = False
+
+    def async_exit(self):
+        self.closed = True
+        self.alive = False
+
+
+def wait_ready(pool, n, timeout=5.0):
+    deadline = time.time() + timeout
+    while len(pool.ready) < n and time.time() < deadline:
+        time.sleep(0.01)
+    return len(pool.ready)
+
+
+def test_target_size():
+    pool = standby.StandbyPool("0", FakeQemu, 4)
+    try:
+        now = time.time()
+        assert pool.target_size(now) == 0
+
+        # no boot time measured yet
+        pool.restarts.append(now)
+        assert pool.target_size(now) == 1
+
+        # 30 restarts/min with 10s boots: 5 restarts per boot, plus headroom
+        pool.boot_time = 10.0
+        pool.restarts.extend([now] * 29)
+        assert pool.target_size(now) == 4
+        pool.boot_time = 2.0
+        assert pool.target_size(now) == 2
+
+        # restarts age out of the window
+        assert pool.target_size(now + standby.RATE_WINDOW + 1) == 0
+    finally:
+        pool.close()
+
+
+def test_take_and_give_back():
+    pool = standby.StandbyPool("0", FakeQemu, 2)
+    try:
+        # nothing is booted before the first restart
+        time.sleep(0.05)
+        assert pool.take() is None
+        assert wait_ready(pool, 1) == 1
+
+        instance = pool.take()
+        assert instance.is_alive()
+        assert pool.adopted == 1
+
+        # the slave hands back its dead instance, which is booted again
+        instance.shutdown()
+        pool.give_back(instance)
+        assert wait_ready(pool, 1) == 1
+        assert instance.boots + pool.ready[0].boots >= 2
+        ready = list(pool.ready)
+    finally:
+        pool.close()
+    # standbys are torn down with the slave
+    assert all(q.closed for q in ready)
+
+
+def test_dead_standby_skipped():
+    pool = standby.StandbyPool("0", FakeQemu, 1)
+    try:
+        pool.restarts.append(time.time())
+        pool.wakeup.set()
+        assert wait_ready(pool, 1) == 1
+        pool.ready[0].alive = False
+        assert pool.take() is None
+    finally:
+        pool.close()
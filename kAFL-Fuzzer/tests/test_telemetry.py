@@ -0,0 +1,100 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test shared-memory telemetry writer/reader and histogram buckets
+"""
+
+import struct
+
+import common.telemetry as telemetry
+from common.placement import Slot
+
+
+def test_hist_buckets():
+    prev = 0
+    for value in list(range(64)) + [int(1.1**i) for i in range(64, 300)]:
+        idx = telemetry.hist_bucket(value)
+        assert idx >= prev
+        assert 0 <= idx < telemetry.HIST_BUCKETS
+        if idx < telemetry.HIST_BUCKETS - 1:
+            assert telemetry.hist_bucket_value(idx) <= value < telemetry.hist_bucket_value(idx + 1)
+        prev = idx
+
+
+def test_writer_reader(tmp_path):
+    filename = str(tmp_path / "telemetry")
+    telemetry.create_segment(filename)
+    writer = telemetry.TelemetryWriter(filename)
+    for i in range(1000):
+        writer.count(telemetry.EXECS)
+        writer.record(telemetry.HIST_EXEC, (i + 1) / 1e6)
+    writer.count(telemetry.TIMEOUTS, 3)
+
+    snapshot = telemetry.TelemetryReader(filename).snapshot()
+    slave = snapshot["slave"]
+    assert slave["counters"]["execs"] == 1000
+    assert slave["counters"]["timeouts"] == 3
+    assert snapshot["qemu"]["counters"]["execs"] == 0
+
+    hist = slave["hists"]["exec"]
+    assert hist["count"] == 1000
+    assert hist["max"] == 1000000
+    # bucket precision is 1/8 of a power of two
+    assert 0.85 * 500000 <= hist["p50"] <= 500000
+    assert 0.85 * 990000 <= hist["p99"] <= 990000
+
+
+def test_reset_mapped(tmp_path):
+    filename = str(tmp_path / "telemetry")
+    telemetry.create_segment(filename)
+    writer = telemetry.TelemetryWriter(filename)
+    reader = telemetry.TelemetryReader(filename)
+    writer.count(telemetry.EXECS, 5)
+
+    # a restarted slave resets the segment while the Master still has it mapped
+    telemetry.create_segment(filename)
+    assert reader.snapshot()["slave"]["counters"]["execs"] == 0
+    writer.count(telemetry.EXECS)
+    assert reader.snapshot()["slave"]["counters"]["execs"] == 1
+
+
+def test_phase_summary(tmp_path):
+    filename = str(tmp_path / "telemetry")
+    telemetry.create_segment(filename)
+    assert "phases" not in telemetry.TelemetryReader(filename).snapshot()["qemu"]
+
+    # fill the Qemu block as written by a build with TELEMETRY_PHASE_SPANS
+    mm = telemetry.map_segment(filename, writable=True)
+    block = telemetry.HEADER_SIZE + telemetry.BLOCK_SIZE
+    runs = 2000
+    struct.pack_into("<2Q", mm, block + 8 * telemetry.W_TSC_HZ, 1000000000, runs)
+    for phase, mean, ema in ((telemetry.PHASE_DECODE, 5000, 5100), (telemetry.PHASE_PT_SYNC, 2000, 4000)):
+        offset = block + 8 * (telemetry.W_PHASES + phase * telemetry.PHASE_WORDS)
+        struct.pack_into("<4Q", mm, offset, mean * runs, 3 * mean, ema, ema)
+
+    phases = telemetry.TelemetryReader(filename).snapshot()["qemu"]["phases"]
+    assert set(phases) == set(telemetry.PHASE_NAMES)
+    assert phases["decode"]["mean_us"] == 5.0
+    assert phases["decode"]["max_us"] == 15.0
+    assert not phases["decode"]["regression"]
+    assert phases["pt_sync"]["recent_us"] == 4.0
+    assert phases["pt_sync"]["regression"]
+    assert phases["release"]["mean_us"] == 0
+
+
+def test_placement(tmp_path):
+    filename = str(tmp_path / "telemetry")
+    telemetry.create_segment(filename)
+    writer = telemetry.TelemetryWriter(filename)
+    assert "placement" not in telemetry.TelemetryReader(filename).snapshot()["slave"]
+
+    writer.placement(Slot(slave_cpu=0, qemu_cpu=4, node=0), 2, 7)
+    placement = telemetry.TelemetryReader(filename).snapshot()["slave"]["placement"]
+    assert placement == {"slave_cpu": 0, "qemu_cpu": 4, "node": 0,
+                         "slave_migrations": 2, "vcpu_migrations": 7}
+
+    # unpinned slaves still report migrations
+    writer.placement(None, 5, 0)
+    placement = telemetry.TelemetryReader(filename).snapshot()["slave"]["placement"]
+    assert placement["slave_cpu"] is None and placement["slave_migrations"] == 5
@@ -0,0 +1,52 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test guest RAM template sharing stats from /proc/<pid>/smaps and their telemetry
+"""
+
+import common.telemetry as telemetry
+from common.template import Sharing, parse_smaps
+
+RAM = "/dev/shm/kafl_test_template_ram"
+
+SMAPS = """\
+55d4c8a00000-55d4c8e3c000 r-xp 00000000 fd:01 1234                       /usr/bin/qemu-system-x86_64
+Rss:                2048 kB
+Shared_Clean:       2048 kB
+Private_Dirty:         0 kB
+7f1200000000-7f1210000000 rw-p 00000000 00:1a 5678                       %s
+Size:             262144 kB
+Rss:               65536 kB
+Shared_Clean:      61440 kB
+Shared_Dirty:          0 kB
+Private_Clean:       512 kB
+Private_Dirty:      3584 kB
+VmFlags: rd wr mr mw me ac sd
+7f1210000000-7f1210001000 rw-p 00000000 00:1a 5678                       %s
+Rss:                   4 kB
+Shared_Clean:          0 kB
+Private_Dirty:         4 kB
+7f1220000000-7f1220021000 rw-p 00000000 00:00 0
+Rss:                 132 kB
+Private_Dirty:       132 kB
+""" % (RAM, RAM)
+
+
+def test_parse_smaps():
+    # all mappings of the file are summed up, other mappings are ignored
+    assert parse_smaps(SMAPS, RAM) == Sharing(rss=65540, shared=61440, private_dirty=3588)
+    assert parse_smaps(SMAPS, RAM + "_other") is None
+    assert parse_smaps("", RAM) is None
+
+
+def test_telemetry(tmp_path):
+    filename = str(tmp_path / "telemetry")
+    telemetry.create_segment(filename)
+    writer = telemetry.TelemetryWriter(filename)
+    assert "template" not in telemetry.TelemetryReader(filename).snapshot()["slave"]
+
+    writer.template(parse_smaps(SMAPS, RAM))
+    snapshot = telemetry.TelemetryReader(filename).snapshot()
+    assert snapshot["slave"]["template"] == {"rss_kb": 65540, "shared_kb": 61440, "cow_kb": 3588}
+    assert "0,slave,template_cow_kb,3588" in telemetry.to_csv({"0": snapshot})
@@ -0,0 +1,83 @@
+# Copyright (C) 2020 Intel Corporation
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Test batched trimming and the native bitmap equivalence check
+"""
+
+import random
+
+from common.execution_result import ExecutionResult
+from fuzzer.bitmap import GlobalBitmap
+from fuzzer.technique import trim
+
+NODE = {"new_bytes": {0: 1, 1: 1}, "new_bits": {}}
+
+
+class Target:
+    """ Edge 0 is hit by inputs starting with HEAD, edge 1 by inputs containing MAGIC """
+
+    def __init__(self):
+        self.execs = []
+
+    def send(self, payload, label=None):
+        self.execs.append(payload)
+        bitmap = bytearray(16)
+        bitmap[0] = payload.startswith(b"HEAD")
+        bitmap[1] = b"MAGIC" in payload
+        return ExecutionResult.bitmap_from_bytearray(bitmap, "regular", 0), False
+
+    def error(self):
+        return False
+
+
+def test_native_equivalence():
+    for _ in range(100):
+        bitmap = bytes(random.choice([0, 1, 2, 4, 128]) for _ in range(256))
+        old_bits = {i: random.choice([1, 2, 4]) for i in random.sample(range(256), 8)}
+        exec_result = ExecutionResult.bitmap_from_bytearray(bitmap, "regular", 0)
+        exec_result.lut_applied = True
+        expected = all(bitmap[i] == v for i, v in old_bits.items())
+        assert GlobalBitmap.all_new_bits_still_set(old_bits, exec_result) == expected
+    assert GlobalBitmap.all_new_bits_still_set({}, exec_result)
+
+
+def test_tail_trim():
+    target = Target()
+    payload = b"HEAD" + b"x" * 1000 + b"MAGIC" + b"y" * 3000
+    result = trim.perform_trim(payload, NODE, target.send, target.error)
+    assert result.startswith(payload[:1009])
+    assert len(result) < 1200
+    assert len(target.execs) <= trim.MAX_EXECS + 1
+
+
+def test_center_trim():
+    target = Target()
+    payload = b"HEAD" + b"x" * 1000 + b"MAGIC" + b"y" * 300
+    result = trim.perform_center_trim(payload, NODE, target.send, target.error, trimming_bytes=1)
+    assert result == b"HEADMAGIC"
+    # sequential bisection needs far fewer execs than one per trimmed byte
+    assert len(target.execs) < 300
+
+
+def test_batch_dispatch():
+    target = Target()
+    batches = []
+
+    def send_batch(payloads, label):
+        batches.append(len(payloads))
+        results = [target.send(payload)[0] for payload in payloads]
+        for result in results:
+            yield result, False
+
+    payload = b"HEAD" + b"x" * 1000 + b"MAGIC" + b"y" * 3000
+    assert trim.perform_trim(payload, NODE, target.send, target.error, send_batch) == \
+        trim.perform_trim(payload, NODE, Target().send, target.error)
+    assert max(batches) > 1
+
+
+def test_abort_on_error():
+    target = Target()
+    payload = b"HEAD" + b"x" * 1000 + b"MAGIC"
+    assert trim.perform_trim(payload, NODE, target.send, lambda: len(target.execs) > 1) == payload
+    assert len(target.execs) == 2
@@ -51,6 +51,7 @@
 #include "pt.h"
 #include "pt/hypercall.h"
 #include "pt/synchronization.h"
+#include "pt/telemetry.h"
 #endif
 
 
@@ -2339,6 +2340,7 @@ int kvm_cpu_exec(CPUState *cpu)
         MemTxAttrs attrs;
 
 		synchronization_check_reload_pending(cpu);
+		synchronization_check_timeout(cpu);
 
         if (cpu->vcpu_dirty) {
             kvm_arch_put_registers(cpu, KVM_PUT_RUNTIME_STATE);
@@ -2436,10 +2438,13 @@ int kvm_cpu_exec(CPUState *cpu)
             ret = kvm_handle_internal_error(cpu, run);
             break;
 #ifdef CONFIG_PROCESSOR_TRACE
-        case KVM_EXIT_KAFL_ACQUIRE:
+        case KVM_EXIT_KAFL_ACQUIRE: {
+            TELEMETRY_SPAN_BEGIN(span);
             handle_hypercall_kafl_acquire(run, cpu);
+            TELEMETRY_SPAN_END(TELEMETRY_PHASE_ACQUIRE, span);
             ret = 0;
             break;
+        }
         case KVM_EXIT_KAFL_GET_PAYLOAD:
             handle_hypercall_get_payload(run, cpu);
             ret = 0;
@@ -2448,10 +2453,13 @@ int kvm_cpu_exec(CPUState *cpu)
             handle_hypercall_get_program(run, cpu);
             ret = 0;
             break;
-        case KVM_EXIT_KAFL_RELEASE:
+        case KVM_EXIT_KAFL_RELEASE: {
+            TELEMETRY_SPAN_BEGIN(span);
             handle_hypercall_kafl_release(run, cpu);
+            TELEMETRY_SPAN_END(TELEMETRY_PHASE_RELEASE, span);
             ret = 0;
             break;
+        }
         case KVM_EXIT_KAFL_SUBMIT_CR3:
             handle_hypercall_kafl_cr3(run, cpu);
             ret = 0;
@@ -2484,10 +2492,13 @@ int kvm_cpu_exec(CPUState *cpu)
             handle_hypercall_kafl_info(run, cpu);
             ret = 0;
             break;
-        case KVM_EXIT_KAFL_NEXT_PAYLOAD:
+        case KVM_EXIT_KAFL_NEXT_PAYLOAD: {
+            TELEMETRY_SPAN_BEGIN(span);
             handle_hypercall_kafl_next_payload(run, cpu);
+            TELEMETRY_SPAN_END(TELEMETRY_PHASE_NEXT_PAYLOAD, span);
             ret = 0;
             break;
+        }
         case KVM_EXIT_KAFL_PRINTF:
             handle_hypercall_kafl_printf(run, cpu);
             ret = 0;
@@ -2510,17 +2521,25 @@ int kvm_cpu_exec(CPUState *cpu)
             handle_hypercall_kafl_user_submit_mode(run, cpu);
             ret = 0;
             break;
-        case KVM_EXIT_KAFL_USER_FAST_ACQUIRE:
+        case KVM_EXIT_KAFL_USER_FAST_ACQUIRE: {
+            TELEMETRY_SPAN_BEGIN(span);
             if(handle_hypercall_kafl_next_payload(run, cpu)){
+                TELEMETRY_SPAN_END(TELEMETRY_PHASE_NEXT_PAYLOAD, span);
+                TELEMETRY_SPAN_BEGIN(acquire_span);
                 handle_hypercall_kafl_cr3(run, cpu);
                 handle_hypercall_kafl_acquire(run, cpu);
+                TELEMETRY_SPAN_END(TELEMETRY_PHASE_ACQUIRE, acquire_span);
             }
             ret = 0;
             break;
-        case KVM_EXIT_KAFL_TOPA_MAIN_FULL:
+        }
+        case KVM_EXIT_KAFL_TOPA_MAIN_FULL: {
+            TELEMETRY_SPAN_BEGIN(span);
             pt_handle_overflow(cpu);
+            TELEMETRY_SPAN_END(TELEMETRY_PHASE_OVERFLOW, span);
             ret = 0;
             break;
+        }
         case KVM_EXIT_KAFL_USER_ABORT:
             handle_hypercall_kafl_user_abort(run, cpu);
             ret = 0;
@@ -13,6 +13,7 @@
 #include <sys/ioctl.h>
 #include <sys/mman.h>
 #include "qemu-common.h"
+#include "qemu/atomic.h"
 #include "cpu.h"
 #include "pt.h"
 #include "pt/decoder.h"
@@ -25,6 +26,8 @@
 #include "pt/memory_access.h"
 #include "pt/interface.h"
 #include "pt/debug.h"
+#include "pt/trace_dump.h"
+#include "pt/telemetry.h"
 #ifdef CONFIG_REDQUEEN
 #include "pt/redqueen.h"
 #include "pt/redqueen_patch.h"
@@ -35,9 +38,20 @@ extern uint32_t kafl_bitmap_size;
 uint8_t* bitmap = NULL;
 uint64_t last_ip = 0ULL;
 
+/* bumped each time a finished run's bitmap is handed to the frontend */
+static uint64_t* bitmap_generation = NULL;
+
+/*
+ * The bitmap is a shared mapping of memory-backed files, so the frontend sees
+ * all stores without msync(). Order them before the generation bump; the
+ * control message sent afterwards tells the frontend to read the bitmap.
+ */
 void pt_sync(void){
 	if(bitmap){
-		msync(bitmap, kafl_bitmap_size, MS_SYNC);
+		TELEMETRY_SPAN_BEGIN(span);
+		smp_wmb();
+		atomic_set(bitmap_generation, *bitmap_generation + 1);
+		TELEMETRY_SPAN_END(TELEMETRY_PHASE_PT_SYNC, span);
 	}
 }
 
@@ -73,6 +87,7 @@ static inline int pt_ioctl(int fd, unsigned long request, unsigned long arg){
 
 void pt_setup_bitmap(void* ptr){
 	bitmap = (uint8_t*)ptr;
+	bitmap_generation = (uint64_t*)(bitmap + kafl_bitmap_size);
 }
 
 void pt_reset_bitmap(void){
@@ -110,7 +125,11 @@ void pt_bitmap(uint64_t addr){
 	last_ip = addr; 
 }
 
+/* decoder time spent in the current exec */
+static uint64_t decode_ns = 0;
+
 void pt_dump(CPUState *cpu, int bytes){
+	uint64_t start = telemetry_now();
 
 #ifdef SAMPLE_RAW
 	sample_raw(cpu->pt_mmap, bytes);
@@ -118,6 +137,9 @@ void pt_dump(CPUState *cpu, int bytes){
 #ifdef SAMPLE_RAW_SINGLE
 	sample_raw_single(cpu->pt_mmap, bytes);
 #endif
+	if (pt_trace_dump_enabled()){
+		pt_trace_dump_write(cpu->pt_mmap, bytes);
+	}
 	for(uint8_t i = 0; i < INTEL_PT_MAX_RANGES; i++){
 		if(cpu->pt_ip_filter_enabled[i]){
 #ifdef CONFIG_REDQUEEN	
@@ -128,9 +150,12 @@ void pt_dump(CPUState *cpu, int bytes){
 				fwrite(cpu->pt_mmap, sizeof(char), bytes, cpu->pt_target_file);
 			}
 			if (!cpu->intel_pt_run_trashed){
+				TELEMETRY_SPAN_BEGIN(span);
 				if(!decode_buffer(cpu->pt_decoder_state[i], cpu->pt_mmap, bytes)){
 					cpu->intel_pt_run_trashed = true;
+					telemetry_count(TELEMETRY_PT_TRASHED, 1);
 				}
+				TELEMETRY_SPAN_END(TELEMETRY_PHASE_DECODE, span);
 			}
 #ifdef CONFIG_REDQUEEN			
 			}
@@ -138,6 +163,7 @@ void pt_dump(CPUState *cpu, int bytes){
 		}
 	}
 	cpu->trace_size += bytes;
+	decode_ns += telemetry_now() - start;
 }
 
 
@@ -159,6 +185,7 @@ int pt_enable(CPUState *cpu, bool hmp_mode){
 }
 	
 int pt_disable(CPUState *cpu, bool hmp_mode){
+	TELEMETRY_SPAN_BEGIN(span);
 	int r = pt_cmd(cpu, KVM_VMX_PT_DISABLE, hmp_mode);
 
 	for(uint8_t i = 0; i < INTEL_PT_MAX_RANGES; i++){
@@ -167,6 +194,16 @@ int pt_disable(CPUState *cpu, bool hmp_mode){
 		}
 	}
 
+	if (decode_ns){
+		telemetry_record(TELEMETRY_HIST_DECODE, decode_ns);
+		decode_ns = 0;
+	}
+
+	if (pt_trace_dump_enabled()){
+		pt_trace_dump_commit();
+	}
+
+	TELEMETRY_SPAN_END(TELEMETRY_PHASE_PT_DISABLE, span);
 	return r;
 }
 
@@ -456,6 +493,7 @@ void pt_handle_overflow(CPUState *cpu){
 		#endif
 
 		cpu->overflow_counter++;
+		telemetry_count(TELEMETRY_PT_OVERFLOWS, 1);
 		pt_dump(cpu, overflow);
 	}  
 
@@ -0,0 +1,341 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Binary ring-buffer logger - see binlog.h.
+ *
+ * Every logging thread gets its own single-producer/single-consumer ring,
+ * so the fast path is a handful of stores and one release barrier. When a
+ * ring is full, records are dropped and counted instead of blocking.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include <pthread.h>
+
+#include "pt/binlog.h"
+#include "pt/debug.h"
+
+#define BINLOG_PREFIX	"Binlog: "
+#define RING_MASK		(BINLOG_RING_SIZE - 1)
+#define ALIGN8(x)		(((x) + 7) & ~7UL)
+
+typedef struct binlog_ring_s {
+	uint8_t* data;
+	uint64_t head;			/* written by producer */
+	uint64_t tail;			/* written by drain thread */
+	uint64_t dropped;		/* written by producer */
+	uint64_t dropped_reported;
+} binlog_ring_t;
+
+typedef struct binlog_format_s {
+	const char* format;
+	uint32_t string_mask;	/* bit n set: argument n is a %s */
+} binlog_format_t;
+
+bool binlog_active = false;
+
+static binlog_ring_t rings[BINLOG_MAX_RINGS];
+static uint32_t rings_used = 0;
+static __thread binlog_ring_t* thread_ring = NULL;
+static __thread bool thread_ring_failed = false;
+
+static binlog_format_t formats[BINLOG_MAX_FORMATS];
+static uint32_t formats_used = BINLOG_ID_DROPPED + 1;
+static uint32_t formats_written = BINLOG_ID_DROPPED + 1;
+static pthread_mutex_t formats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static FILE* binlog_file = NULL;
+static pthread_t drain_thread;
+static bool drain_stop = false;
+
+static inline uint64_t binlog_tsc(void){
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+#endif
+}
+
+static uint64_t realtime_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_REALTIME, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t estimate_tsc_hz(void){
+#if defined(__x86_64__) || defined(__i386__)
+	struct timespec ts_a, ts_b;
+	uint64_t tsc_a, tsc_b, ns;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts_a);
+	tsc_a = binlog_tsc();
+	usleep(10000);
+	clock_gettime(CLOCK_MONOTONIC, &ts_b);
+	tsc_b = binlog_tsc();
+
+	ns = (ts_b.tv_sec - ts_a.tv_sec) * 1000000000ULL + ts_b.tv_nsec - ts_a.tv_nsec;
+	return (tsc_b - tsc_a) * 1000000000ULL / ns;
+#else
+	return 1000000000ULL;
+#endif
+}
+
+static uint32_t parse_string_mask(const char* format){
+	uint32_t mask = 0;
+	int arg = 0;
+
+	for (const char* p = format; *p; p++){
+		if (*p != '%'){
+			continue;
+		}
+		p++;
+		if (*p == '%'){
+			continue;
+		}
+		/* skip flags, width, precision and length modifiers */
+		while (*p && strchr("-+ #0123456789.hlqjzt", *p)){
+			p++;
+		}
+		if (!*p){
+			break;
+		}
+		if (*p == 's' && arg < 32){
+			mask |= 1U << arg;
+		}
+		arg++;
+	}
+	return mask;
+}
+
+uint16_t binlog_register(const char* format){
+	uint16_t id = 0;
+
+	pthread_mutex_lock(&formats_lock);
+	/* same call site raced from two threads - or just a re-used literal */
+	for (uint32_t i = BINLOG_ID_DROPPED + 1; i < formats_used; i++){
+		if (formats[i].format == format){
+			id = i;
+			goto out;
+		}
+	}
+	if (formats_used < BINLOG_MAX_FORMATS){
+		id = formats_used;
+		formats[id].format = format;
+		formats[id].string_mask = parse_string_mask(format);
+		atomic_store_release(&formats_used, formats_used + 1);
+	}
+out:
+	pthread_mutex_unlock(&formats_lock);
+	return id;
+}
+
+static binlog_ring_t* claim_ring(void){
+	uint32_t slot = atomic_fetch_inc(&rings_used);
+	if (slot >= BINLOG_MAX_RINGS){
+		return NULL;
+	}
+	return &rings[slot];
+}
+
+static inline void ring_copy_in(binlog_ring_t* ring, uint64_t pos, const void* src, size_t len){
+	size_t offset = pos & RING_MASK;
+	size_t first = MIN(len, BINLOG_RING_SIZE - offset);
+	memcpy(ring->data + offset, src, first);
+	memcpy(ring->data, (const uint8_t*)src + first, len - first);
+}
+
+void binlog_write(uint16_t fmt_id, uint8_t nargs, const uint64_t* args){
+	binlog_ring_t* ring = thread_ring;
+	uint64_t words[BINLOG_MAX_ARGS];
+	uint32_t string_mask;
+	binlog_record_t rec;
+	uint64_t head, pos;
+	size_t size;
+
+	if (!binlog_active || !fmt_id){
+		return;
+	}
+	if (!ring){
+		if (thread_ring_failed){
+			return;
+		}
+		ring = thread_ring = claim_ring();
+		if (!ring){
+			thread_ring_failed = true;
+			return;
+		}
+	}
+
+	if (nargs > BINLOG_MAX_ARGS){
+		nargs = BINLOG_MAX_ARGS;
+	}
+	string_mask = formats[fmt_id].string_mask;
+
+	size = sizeof(binlog_record_t) + nargs * sizeof(uint64_t);
+	for (int i = 0; i < nargs; i++){
+		words[i] = args[i];
+		if (string_mask & (1U << i)){
+			words[i] = args[i] ? strnlen((const char*)args[i], BINLOG_MAX_STRING) : 0;
+			size += words[i];
+		}
+	}
+	size = ALIGN8(size);
+
+	head = ring->head;
+	if (size > BINLOG_RING_SIZE - (head - atomic_load_acquire(&ring->tail))){
+		ring->dropped++;
+		return;
+	}
+
+	rec.tsc = binlog_tsc();
+	rec.fmt_id = fmt_id;
+	rec.nargs = nargs;
+	rec.ring = ring - rings;
+	rec.size = size;
+
+	pos = head;
+	ring_copy_in(ring, pos, &rec, sizeof(rec));
+	pos += sizeof(rec);
+	ring_copy_in(ring, pos, words, nargs * sizeof(uint64_t));
+	pos += nargs * sizeof(uint64_t);
+	for (int i = 0; i < nargs; i++){
+		if (string_mask & (1U << i)){
+			ring_copy_in(ring, pos, (const void*)args[i], words[i]);
+			pos += words[i];
+		}
+	}
+
+	atomic_store_release(&ring->head, head + size);
+}
+
+static void write_record(uint16_t fmt_id, uint8_t ring, const uint64_t* args, uint8_t nargs, const char* str, size_t len){
+	static const uint8_t pad[8] = { 0 };
+	binlog_record_t rec;
+	size_t size = sizeof(rec) + nargs * sizeof(uint64_t) + len;
+
+	rec.tsc = binlog_tsc();
+	rec.fmt_id = fmt_id;
+	rec.nargs = nargs;
+	rec.ring = ring;
+	rec.size = ALIGN8(size);
+
+	fwrite(&rec, sizeof(rec), 1, binlog_file);
+	fwrite(args, sizeof(uint64_t), nargs, binlog_file);
+	fwrite(str, 1, len, binlog_file);
+	fwrite(pad, 1, rec.size - size, binlog_file);
+}
+
+static void drain_formats(void){
+	uint32_t used = atomic_load_acquire(&formats_used);
+
+	for (; formats_written < used; formats_written++){
+		uint64_t id = formats_written;
+		const char* format = formats[id].format;
+		uint64_t args[2] = { id, strlen(format) };
+		write_record(BINLOG_ID_FORMAT, 0, args, 2, format, args[1]);
+	}
+}
+
+static size_t drain_rings(void){
+	uint32_t used = MIN(atomic_read(&rings_used), BINLOG_MAX_RINGS);
+	size_t total = 0;
+
+	for (uint32_t i = 0; i < used; i++){
+		binlog_ring_t* ring = &rings[i];
+		uint64_t tail = ring->tail;
+		uint64_t head = atomic_load_acquire(&ring->head);
+		uint64_t dropped = atomic_read(&ring->dropped);
+
+		if (head != tail){
+			size_t offset = tail & RING_MASK;
+			size_t len = head - tail;
+			size_t first = MIN(len, BINLOG_RING_SIZE - offset);
+			fwrite(ring->data + offset, 1, first, binlog_file);
+			fwrite(ring->data, 1, len - first, binlog_file);
+			atomic_store_release(&ring->tail, head);
+			total += len;
+		}
+
+		if (dropped != ring->dropped_reported){
+			uint64_t lost = dropped - ring->dropped_reported;
+			write_record(BINLOG_ID_DROPPED, i, &lost, 1, NULL, 0);
+			ring->dropped_reported = dropped;
+		}
+	}
+	return total;
+}
+
+static void* binlog_drain_thread(void* arg){
+	while (!atomic_read(&drain_stop)){
+		size_t drained;
+
+		drain_formats();
+		drained = drain_rings();
+		fflush(binlog_file);
+
+		/* keep going while there is a backlog */
+		if (drained < BINLOG_RING_SIZE / 4){
+			usleep(BINLOG_DRAIN_INTERVAL);
+		}
+	}
+	drain_formats();
+	drain_rings();
+	fflush(binlog_file);
+	return NULL;
+}
+
+bool binlog_init(const char* filename){
+	binlog_file_header_t header;
+
+	assert(!binlog_file);
+
+	binlog_file = fopen(filename, "wb");
+	if (!binlog_file){
+		QEMU_PT_ERROR(BINLOG_PREFIX, "Could not open %s: %s", filename, strerror(errno));
+		return false;
+	}
+	setvbuf(binlog_file, NULL, _IOFBF, 1 << 20);
+
+	for (int i = 0; i < BINLOG_MAX_RINGS; i++){
+		rings[i].data = malloc(BINLOG_RING_SIZE);
+		assert(rings[i].data);
+		rings[i].head = rings[i].tail = 0;
+		rings[i].dropped = rings[i].dropped_reported = 0;
+	}
+
+	header.magic = BINLOG_MAGIC;
+	header.version = BINLOG_VERSION;
+	header.tsc_hz = estimate_tsc_hz();
+	header.tsc_start = binlog_tsc();
+	header.time_start = realtime_ns();
+	fwrite(&header, sizeof(header), 1, binlog_file);
+
+	drain_stop = false;
+	if (pthread_create(&drain_thread, NULL, binlog_drain_thread, NULL)){
+		QEMU_PT_ERROR(BINLOG_PREFIX, "Could not start drain thread");
+		fclose(binlog_file);
+		binlog_file = NULL;
+		return false;
+	}
+
+	binlog_active = true;
+	atexit(binlog_destroy);
+	return true;
+}
+
+void binlog_destroy(void){
+	if (!binlog_file){
+		return;
+	}
+
+	binlog_active = false;
+	atomic_set(&drain_stop, true);
+	pthread_join(drain_thread, NULL);
+
+	fclose(binlog_file);
+	binlog_file = NULL;
+}
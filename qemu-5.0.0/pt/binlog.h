@@ -0,0 +1,93 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Binary ring-buffer logger. Log calls store a format ID, a TSC timestamp
+ * and the raw arguments in a per-thread lock-free ring. A background
+ * thread drains the rings to disk; tools/binlog_decode.py formats the
+ * records offline.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BINLOG_MAGIC			0x474c424b	/* "KBLG" */
+#define BINLOG_VERSION			1
+#define BINLOG_RING_SIZE		(1 << 20)	/* per logging thread, power of 2 */
+#define BINLOG_MAX_RINGS		8
+#define BINLOG_MAX_ARGS			8
+#define BINLOG_MAX_FORMATS		4096
+#define BINLOG_MAX_STRING		1024
+#define BINLOG_DRAIN_INTERVAL	10000		/* usec */
+
+/* reserved format IDs */
+#define BINLOG_ID_FORMAT		0			/* format table entry: payload is id + string */
+#define BINLOG_ID_DROPPED		1			/* ring overflow: args[0] = records lost */
+
+/*
+ * On-disk layout: binlog_file_header_t followed by records. Each record
+ * starts with binlog_record_t, followed by nargs 64-bit words. For %s
+ * arguments the word holds the string length and the string bytes follow
+ * the argument words. Records are padded to 8 bytes.
+ */
+typedef struct binlog_file_header_s {
+	uint32_t magic;
+	uint32_t version;
+	uint64_t tsc_hz;		/* estimated at startup */
+	uint64_t tsc_start;
+	uint64_t time_start;	/* CLOCK_REALTIME at tsc_start, in ns */
+} __attribute__((packed)) binlog_file_header_t;
+
+typedef struct binlog_record_s {
+	uint64_t tsc;
+	uint16_t fmt_id;
+	uint8_t nargs;
+	uint8_t ring;
+	uint32_t size;			/* total record size incl. header and padding */
+} __attribute__((packed)) binlog_record_t;
+
+bool binlog_init(const char* filename);
+void binlog_destroy(void);
+uint16_t binlog_register(const char* format);
+void binlog_write(uint16_t fmt_id, uint8_t nargs, const uint64_t* args);
+
+extern bool binlog_active;
+
+static inline bool binlog_enabled(void){
+	return binlog_active;
+}
+
+/* argument marshalling - everything is passed as a 64-bit word */
+#define BINLOG_ARG(x)			((uint64_t)(uintptr_t)(x))
+#define BINLOG_CAT_(a, b)		a##b
+#define BINLOG_CAT(a, b)		BINLOG_CAT_(a, b)
+#define BINLOG_NARGS_(_0, _1, _2, _3, _4, _5, _6, _7, _8, N, ...) N
+#define BINLOG_NARGS(...)		BINLOG_NARGS_(0, ##__VA_ARGS__, 8, 7, 6, 5, 4, 3, 2, 1, 0)
+#define BINLOG_MAP_0()
+#define BINLOG_MAP_1(a)						BINLOG_ARG(a)
+#define BINLOG_MAP_2(a, b)					BINLOG_MAP_1(a), BINLOG_ARG(b)
+#define BINLOG_MAP_3(a, b, c)				BINLOG_MAP_2(a, b), BINLOG_ARG(c)
+#define BINLOG_MAP_4(a, b, c, d)			BINLOG_MAP_3(a, b, c), BINLOG_ARG(d)
+#define BINLOG_MAP_5(a, b, c, d, e)			BINLOG_MAP_4(a, b, c, d), BINLOG_ARG(e)
+#define BINLOG_MAP_6(a, b, c, d, e, f)		BINLOG_MAP_5(a, b, c, d, e), BINLOG_ARG(f)
+#define BINLOG_MAP_7(a, b, c, d, e, f, g)	BINLOG_MAP_6(a, b, c, d, e, f), BINLOG_ARG(g)
+#define BINLOG_MAP_8(a, b, c, d, e, f, g, h)	BINLOG_MAP_7(a, b, c, d, e, f, g), BINLOG_ARG(h)
+#define BINLOG_MAP(...)			BINLOG_CAT(BINLOG_MAP_, BINLOG_NARGS(__VA_ARGS__))(__VA_ARGS__)
+
+/* format must be a string literal - it is registered once per call site */
+#define BINLOG(format, ...) do { \
+		static uint16_t _binlog_id = 0; \
+		if (binlog_enabled()){ \
+			uint64_t _binlog_args[] = { 0, BINLOG_MAP(__VA_ARGS__) }; \
+			if (!_binlog_id){ \
+				_binlog_id = binlog_register(format); \
+			} \
+			binlog_write(_binlog_id, BINLOG_NARGS(__VA_ARGS__), _binlog_args + 1); \
+		} \
+	} while (0)
+
+#endif
@@ -14,6 +14,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "qemu/log.h"
+#include "pt/binlog.h"
 
 #define QEMU_PT_PREFIX		    "[QEMU-PT] "
 #define CORE_PREFIX			    "Core:  "
@@ -23,6 +24,7 @@
 #define INTERFACE_PREFIX	    "Iface: "
 #define REDQUEEN_PREFIX		    "Redq.: "
 #define DISASM_PREFIX		    "Diasm: "
+#define TRACE_DUMP_PREFIX	    "Trace: "
 
 #define COLOR	                "\033[1;35m"
 #define ENDC	                "\033[0m"
@@ -54,7 +56,18 @@
 /* _PRINTF is the standard logging enabled with -D */
 /* _DEBUG is activated with -d kafl cmdline */
 /* _ERROR is printed to stdout (or logged if logging is enabled) */
-#define QEMU_PT_PRINTF(PREFIX, format, ...) qemu_log(QEMU_PT_PREFIX PREFIX format "\n", ##__VA_ARGS__)
-#define QEMU_PT_DEBUG(PREFIX, format, ...)  qemu_log_mask(LOG_KAFL, QEMU_PT_PREFIX PREFIX format "\n", ##__VA_ARGS__)
+/* _PRINTF and _DEBUG go to the binary log instead if it is enabled (binlog=<file>) */
+#define QEMU_PT_PRINTF(PREFIX, format, ...) do { \
+		if (binlog_enabled()) \
+			BINLOG(QEMU_PT_PREFIX PREFIX format "\n", ##__VA_ARGS__); \
+		else \
+			qemu_log(QEMU_PT_PREFIX PREFIX format "\n", ##__VA_ARGS__); \
+	} while (0)
+#define QEMU_PT_DEBUG(PREFIX, format, ...) do { \
+		if (binlog_enabled()) \
+			BINLOG(QEMU_PT_PREFIX PREFIX format "\n", ##__VA_ARGS__); \
+		else \
+			qemu_log_mask(LOG_KAFL, QEMU_PT_PREFIX PREFIX format "\n", ##__VA_ARGS__); \
+	} while (0)
 //#define QEMU_PT_DEBUG(PREFIX, format, ...) qemu_log_mask(LOG_KAFL, PREFIX "(%s#:%d)\t"format, __BASE_FILE__, __LINE__, ##__VA_ARGS__)
 #define QEMU_PT_ERROR(PREFIX, format, ...)  printf(QEMU_PT_PREFIX PREFIX format "\n", ##__VA_ARGS__)
\ No newline at end of file
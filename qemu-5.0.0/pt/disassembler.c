@@ -12,6 +12,7 @@
 #include "pt/disassembler.h"
 #include "qemu/log.h"
 #include "pt/memory_access.h"
+#include "pt/page_cache.h"
 #ifdef CONFIG_REDQUEEN
 #include "pt/redqueen.h"
 #endif
@@ -388,10 +389,10 @@ static cofi_list* analyse_assembly(disassembler_t* self, uint64_t base_address,
 	cofi_type type;
 	//cofi_header* tmp = NULL;
 	uint64_t tmp_list_element = 0;
-	bool last_nop = false, no_munmap = true;
+	bool last_nop = false;
 	uint64_t total = 0;
 	uint64_t cofi = 0;
-	const uint8_t* code = mmap_virtual_memory(base_address, self->cpu);
+	const uint8_t* code = page_cache_fetch(base_address, self->cpu);
 	uint8_t tmp_code[x86_64_PAGE_SIZE*2];
 	size_t code_size = x86_64_PAGE_SIZE - (base_address & ~x86_64_PAGE_MASK);;
 	uint64_t address = base_address;
@@ -420,12 +421,10 @@ static cofi_list* analyse_assembly(disassembler_t* self, uint64_t base_address,
 		 * We must parse instructions in two consecutive pages.
 		 * */
 		code_size = x86_64_PAGE_SIZE*2 - (address & ~x86_64_PAGE_MASK);
-		if (!read_virtual_memory(address, tmp_code, code_size, self->cpu)) {
+		if (!page_cache_read(address, tmp_code, code_size, self->cpu)) {
 			printf("Fatal error 2 in analyse_assembly.\n");
 			asm("int $3\r\n");
 		}
-		munmap_virtual_memory((void *)code, self->cpu);
-		no_munmap = false;
 		code = tmp_code;
 	}
 
@@ -508,9 +507,6 @@ static cofi_list* analyse_assembly(disassembler_t* self, uint64_t base_address,
 	
 	cs_free(insn, 1);
 	cs_close(&handle);
-	if (no_munmap) {
-		munmap_virtual_memory((void *)code, self->cpu);
-	}
 	return first;
 }
 #ifdef CONFIG_REDQUEEN
@@ -34,6 +34,10 @@ void _parse_addresses_in_file(FILE* fp, size_t num_addrs, uint64_t* addrs);
 
 void write_debug_result(char* buf){
   int unused __attribute__((unused));
+  if(binlog_enabled()){
+    BINLOG("%s", buf);
+    return;
+  }
 	int fd = open("/tmp/qemu_debug.txt", O_WRONLY | O_CREAT | O_APPEND, S_IRWXU);
   assert(fd > 0);
 	unused = write(fd, buf, strlen(buf));
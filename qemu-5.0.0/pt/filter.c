@@ -24,81 +24,118 @@ static inline uint64_t mix_tuple(uint64_t curent_addr, uint64_t prev_addr){
   return mix_bits((curent_addr<<32) + (prev_addr&0xFFFFFFFF));
 }
 
-static bool filter_get_bitmap(filter_t* self, uint8_t* bitmap, uint64_t offset){
-  assert(offset <= self->size);
-  return (bitmap[offset/8] & (1<< offset%8));
-}
-
-static void filter_set_bitmap(filter_t* self, uint8_t* bitmap, uint64_t offset){
-  assert(offset <= self->size);
-  bitmap[offset/8] |= (1<< offset%8);
-}
+#define FILTER_ENTRIES_INITIAL 0x1000
+#define FILTER_ENTRY_EMPTY     ((uint64_t)-1)
 
 static bool filter_get_bitmap_sync(filter_t* self, uint8_t* bitmap, uint64_t offset){
-  assert(offset <= self->size);
+  assert(offset < self->size);
   return bitmap[offset];
 }
 
 static void filter_set_bitmap_sync(filter_t* self, uint8_t* bitmap, uint64_t offset){
-  assert(offset <= self->size);
+  assert(offset < self->size);
   if(!bitmap[offset]){
     bitmap[offset] = 1;  
     self->blacklist_count++;
   }
 }
 
+static void filter_reset_entries(filter_t* self){
+  for(size_t i = 0; i < self->entries_capacity; i++){
+    self->entries[i].offset = FILTER_ENTRY_EMPTY;
+  }
+  self->entries_used = 0;
+}
+
+static filter_entry_t* filter_lookup_entry(filter_entry_t* entries, size_t capacity, uint64_t offset){
+  size_t mask = capacity-1;
+  size_t i = mix_bits(offset) & mask;
+  while(entries[i].offset != FILTER_ENTRY_EMPTY && entries[i].offset != offset){
+    i = (i+1) & mask;
+  }
+  return &entries[i];
+}
+
+static void filter_grow_entries(filter_t* self){
+  size_t old_capacity = self->entries_capacity;
+  filter_entry_t* old_entries = self->entries;
+
+  self->entries_capacity = old_capacity*2;
+  self->entries = malloc(self->entries_capacity*sizeof(filter_entry_t));
+  assert(self->entries);
+  filter_reset_entries(self);
+
+  for(size_t i = 0; i < old_capacity; i++){
+    if(old_entries[i].offset != FILTER_ENTRY_EMPTY){
+      *filter_lookup_entry(self->entries, self->entries_capacity, old_entries[i].offset) = old_entries[i];
+      self->entries_used++;
+    }
+  }
+  free(old_entries);
+}
+
 /* default: 128MB */
 filter_t* new_filter(uint64_t from, uint64_t to, uint8_t *filter_bitmap){
   filter_t* res = malloc(sizeof(filter_t));
   assert(from < to);
   res->size = to-from;
   res->execs = 0;
-  res->counters = malloc(res->size*2);
+  res->entries_capacity = FILTER_ENTRIES_INITIAL;
+  res->entries = malloc(res->entries_capacity*sizeof(filter_entry_t));
+  assert(res->entries);
   res->from_addr = from;
   res->to_addr = to;
-  res->hit_bitmap = malloc(res->size/8);
   res->filter_bitmap = filter_bitmap;
   res->prev_addr = 0x0;
   res->blacklist_count = 0;
+  filter_reset_entries(res);
   return res;
 }
 
 void filter_init_determinism_run(filter_t* self){
   self->execs = 0;
-  memset(self->counters, 0, self->size*2);
+  filter_reset_entries(self);
 }
 
 void filter_init_new_exec(filter_t* self){
-  memset(self->hit_bitmap, 0, self->size/8);
+  /* nothing to clear: entries hit during this exec are tagged with execs+1 */
 }
 
 void filter_add_address(filter_t* self, uint64_t addr){
-  if(self->from_addr <= addr && addr <= self->to_addr){
-    filter_set_bitmap(self,self->hit_bitmap,addr-self->from_addr);
+  if(self->from_addr <= addr && addr < self->to_addr){
+    uint32_t exec_id = self->execs+1;
+    filter_entry_t* e = filter_lookup_entry(self->entries, self->entries_capacity, addr-self->from_addr);
+    if(e->offset == FILTER_ENTRY_EMPTY){
+      e->offset = addr-self->from_addr;
+      e->exec_id = exec_id;
+      e->count = 1;
+      if(++self->entries_used*2 > self->entries_capacity){
+        filter_grow_entries(self);
+      }
+    }
+    else if(e->exec_id != exec_id){
+      e->exec_id = exec_id;
+      e->count++;
+    }
   }
 }
 
 void filter_finalize_exec(filter_t* self){
   self->execs ++;
-  for(uint64_t a = self->from_addr; a < self->to_addr; a++){
-    if(filter_get_bitmap(self, self->hit_bitmap,a - self->from_addr)){
-      self->counters[a - self->from_addr] += 1;
-    }
-  }
 }
 
 
 void filter_finalize_determinism_run(filter_t* self){
-  for(uint64_t a = self->from_addr; a < self->to_addr; a++){
-    uint64_t o = a-self->from_addr;
-    if(self->counters[o] != self->execs && self->counters[o]){
-      filter_set_bitmap_sync(self, self->filter_bitmap, o);
+  for(size_t i = 0; i < self->entries_capacity; i++){
+    filter_entry_t* e = &self->entries[i];
+    if(e->offset != FILTER_ENTRY_EMPTY && e->count != self->execs){
+      filter_set_bitmap_sync(self, self->filter_bitmap, e->offset);
     }
   }
 }
 
 bool filter_is_address_nondeterministic(filter_t* self, uint64_t addr){
-  if(self->from_addr <= addr && addr <= self->to_addr){
+  if(self->from_addr <= addr && addr < self->to_addr){
     return filter_get_bitmap_sync(self, self->filter_bitmap,addr-self->from_addr);
   }
   return false;
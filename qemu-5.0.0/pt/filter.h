@@ -18,11 +18,24 @@
 #include <stdbool.h>
 #include <assert.h>
 
+/*
+ * Sampling state is kept sparse: only addresses actually visited during a
+ * determinism run get an entry in an open-addressing hash table. exec_id
+ * tags the last sampling exec that hit an entry, so an address is counted
+ * at most once per exec without clearing anything between execs.
+ */
+typedef struct filter_entry_s {
+  uint64_t offset;
+  uint32_t exec_id;
+  uint16_t count;
+} filter_entry_t;
+
 typedef struct filter_s {
   size_t size;
   uint16_t execs;
-  uint16_t *counters;
-  uint8_t *hit_bitmap;
+  filter_entry_t *entries;
+  size_t entries_capacity;
+  size_t entries_used;
   uint8_t *filter_bitmap;
   uint64_t prev_addr;
   uint64_t from_addr;
@@ -27,6 +27,8 @@
 #include "pt/memory_access.h"
 #include "pt/interface.h"
 #include "pt/printk.h"
+#include "pt/telemetry.h"
+#include "pt/template.h"
 #include "pt/debug.h"
 #include "pt/synchronization.h"
 
@@ -110,24 +112,32 @@ void pt_setup_ip_filters(uint8_t filter_id, uint64_t start, uint64_t end, void*
 	}
 }
 
+/* det_tfilter is shared by all ranges - init/finalize it once per exec */
 static inline void init_det_filter(void){
-	int i;
-	for(i = 0; i < INTEL_PT_MAX_RANGES; i++){
+	bool any_enabled = false;
+	for(int i = 0; i < INTEL_PT_MAX_RANGES; i++){
 		if (det_filter_enabled[i]){
 			filter_init_new_exec(det_filter[i]);
-			filter_init_new_exec(det_tfilter);
+			any_enabled = true;
 		}	
 	}
+	if (any_enabled){
+		filter_init_new_exec(det_tfilter);
+	}
 }
 
 static inline void fin_det_filter(void){
+	bool any_enabled = false;
 	//printf("%s \n", __func__);
 	for(int i = 0; i < INTEL_PT_MAX_RANGES; i++){
 		if (det_filter_enabled[i]){
 			filter_finalize_exec(det_filter[i]);
-			filter_finalize_exec(det_tfilter);
+			any_enabled = true;
 		}
 	}
+	if (any_enabled){
+		filter_finalize_exec(det_tfilter);
+	}
 }
 
 void hypercall_submit_address(uint64_t address){
@@ -191,7 +201,9 @@ void hypercall_enable_filter(void){
 			//printf("%s (%d)\n", __func__, i);
 			det_filter_enabled[i] = true;
 			filter_init_determinism_run(det_filter[i]);
-			filter_init_determinism_run(det_tfilter);
+			if(det_tfilter){
+				filter_init_determinism_run(det_tfilter);
+			}
 		}
 	}
 }
@@ -252,7 +264,11 @@ bool handle_hypercall_kafl_next_payload(struct kvm_run *run, CPUState *cpu){
 			}
 			else{
 				synchronization_lock(cpu);
+				uint64_t start = telemetry_now();
+				TELEMETRY_SPAN_BEGIN(span);
 				write_virtual_memory((uint64_t)payload_buffer_guest, payload_buffer, PAYLOAD_SIZE, cpu);
+				TELEMETRY_SPAN_END(TELEMETRY_PHASE_PAYLOAD, span);
+				telemetry_record(TELEMETRY_HIST_PAYLOAD, telemetry_now() - start);
 				return true;
 			}
 		}
@@ -344,6 +360,26 @@ void handle_hypercall_kafl_submit_kasan(struct kvm_run *run, CPUState *cpu){
 	}
 }
 
+/*
+ * Kernel reports enter through the handler patched into panic()/kasan_report(),
+ * so the caller's return address is on top of the stack. It is passed to the
+ * frontend as part of the crash signature. User mode reports come from the
+ * agent and carry no address.
+ */
+static void report_crash_ip(struct kvm_run *run, CPUState *cpu){
+	X86CPU *x86_cpu = X86_CPU(cpu);
+	CPUX86State *env = &x86_cpu->env;
+	uint64_t ip = 0;
+
+	if(!run->hypercall.args[0]){
+		kvm_cpu_synchronize_state(cpu);
+		if(!read_virtual_memory(env->regs[R_ESP], (uint8_t*)&ip, run->hypercall.longmode ? 8 : 4, cpu)){
+			ip = 0;
+		}
+	}
+	telemetry_crash_ip(ip);
+}
+
 void handle_hypercall_kafl_panic(struct kvm_run *run, CPUState *cpu){
 	if(hypercall_enabled){
 		if(run->hypercall.args[0]){
@@ -351,6 +387,9 @@ void handle_hypercall_kafl_panic(struct kvm_run *run, CPUState *cpu){
 		} else{
 			QEMU_PT_DEBUG(CORE_PREFIX, "Panic in kernel mode!");
 		}
+		report_crash_ip(run, cpu);
+		synchronization_cancel_timeout();
+		telemetry_count(TELEMETRY_CRASHES, 1);
 		hypercall_snd_char(KAFL_PROTO_CRASH);
 	}
 }
@@ -358,6 +397,8 @@ void handle_hypercall_kafl_panic(struct kvm_run *run, CPUState *cpu){
 void handle_hypercall_kafl_timeout(struct kvm_run *run, CPUState *cpu){
 	if(hypercall_enabled){
 		QEMU_PT_DEBUG(CORE_PREFIX, "Timeout detected!");
+		synchronization_cancel_timeout();
+		telemetry_count(TELEMETRY_TIMEOUTS, 1);
 		hypercall_snd_char(KAFL_PROTO_TIMEOUT);
 	}
 }
@@ -369,6 +410,9 @@ void handle_hypercall_kafl_kasan(struct kvm_run *run, CPUState *cpu){
 		} else{
 			QEMU_PT_DEBUG(CORE_PREFIX, "ASan notification in kernel mode!");
 		}
+		report_crash_ip(run, cpu);
+		synchronization_cancel_timeout();
+		telemetry_count(TELEMETRY_KASAN, 1);
 		hypercall_snd_char(KAFL_PROTO_KASAN);
 	}
 }
@@ -389,6 +433,10 @@ void handle_hypercall_kafl_lock(struct kvm_run *run, CPUState *cpu){
 		qemu_system_shutdown_request(SHUTDOWN_CAUSE_HOST_SIGNAL);
 	}
 	*/
+	if(template_enabled()){
+		template_export();
+		return;
+	}
 	printf("kAFL: VM PAUSED - CREATE SNAPSHOT NOW!\n");
 	vm_stop(RUN_STATE_PAUSED);
 }
@@ -419,6 +467,10 @@ void enable_reload_mode(void){
 
 void hprintf(char* msg){
 	char file_name[256];
+	if(binlog_enabled() && hprintf_enabled){
+		/* the ring keeps every message, live output below still stops at HPRINTF_LIMIT */
+		BINLOG("[HPRINTF] %s", msg);
+	}
 	if(!(hprintf_counter >= HPRINTF_LIMIT) && hprintf_enabled){
 		if(hypercall_enabled){
 			snprintf(file_name, 256, "%s.%d", HPRINTF_FILE, hprintf_counter);
@@ -438,7 +490,7 @@ void hprintf(char* msg){
 
 void handle_hypercall_kafl_printf(struct kvm_run *run, CPUState *cpu){
 	//printf("%s\n", __func__);
-	if(!(hprintf_counter >= HPRINTF_LIMIT) && hprintf_enabled){
+	if((binlog_enabled() || !(hprintf_counter >= HPRINTF_LIMIT)) && hprintf_enabled){
 		read_virtual_memory((uint64_t)run->hypercall.args[0], (uint8_t*)hprintf_buffer, HPRINTF_SIZE, cpu);
 		hprintf(hprintf_buffer);
 	}
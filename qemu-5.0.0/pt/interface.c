@@ -35,6 +35,10 @@
 #include "pt/debug.h"
 #include "pt/synchronization.h"
 #include "pt/asm_decoder.h"
+#include "pt/trace_dump.h"
+#include "pt/telemetry.h"
+#include "pt/page_cache.h"
+#include "pt/template.h"
 
 #include <time.h>
 
@@ -63,6 +67,11 @@ typedef struct kafl_mem_state {
 	char* data_bar_fd_1;
 	char* data_bar_fd_2;
 	char* bitmap_file;
+	char* dump_pt_trace;
+	char* binlog;
+	char* telemetry;
+	char* page_cache;
+	char* template;		/* export the device state here, see pt/template.h */
 
 	char* filter_bitmap[4];
 	char* ip_filter[4][2];
@@ -75,6 +84,8 @@ typedef struct kafl_mem_state {
 	bool reload_mode;
 	bool disable_snapshot;
 	bool lazy_vAPIC_reset;
+	bool standby;		/* pre-booted spare of a slave, see KAFL_PROTO_ADOPT */
+	bool hugepages;		/* frontend asked for huge pages, hint regular page shm as well */
 
 #ifdef CONFIG_REDQUEEN
 	bool redqueen;
@@ -99,8 +110,20 @@ static int kafl_guest_can_receive(void * opaque){
 
 static void kafl_guest_receive(void *opaque, const uint8_t * buf, int size){
 	kafl_mem_state *s = opaque;
+	/* argument bytes of a pending KAFL_PROTO_SET_TIMEOUT, may span several reads */
+	static uint32_t timeout_arg = 0;
+	static int timeout_arg_bytes = -1;
 	int i;				
 	for(i = 0; i < size; i++){
+		if(timeout_arg_bytes >= 0){
+			timeout_arg |= (uint32_t)buf[i] << (8 * timeout_arg_bytes);
+			if(++timeout_arg_bytes == sizeof(timeout_arg)){
+				synchronization_set_timeout(timeout_arg);
+				timeout_arg_bytes = -1;
+			}
+			continue;
+		}
+
 		switch(buf[i]){
 			case KAFL_PROTO_RELEASE:
 				synchronization_unlock();
@@ -131,6 +154,24 @@ static void kafl_guest_receive(void *opaque, const uint8_t * buf, int size){
 				synchronization_disable_pt(qemu_get_cpu(0));
 				send_char('F', s);
 				break;
+
+			/* exec time budget, enforced by a host timer armed on RELEASE */
+			case KAFL_PROTO_SET_TIMEOUT:
+				timeout_arg = 0;
+				timeout_arg_bytes = 0;
+				break;
+
+			/* standby instance taken over by a slave, the vCPU is parked after the handshake */
+			case KAFL_PROTO_ADOPT:
+				telemetry_attach();
+				send_char(KAFL_PROTO_ADOPT, s);
+				break;
+
+			/* write out all archived PT traces, the vCPU is parked between execs */
+			case KAFL_PROTO_FLUSH_TRACE:
+				pt_trace_dump_flush();
+				send_char(KAFL_PROTO_FLUSH_TRACE, s);
+				break;
 #ifdef CONFIG_REDQUEEN
 				
 			/* enable redqueen intercept mode */
@@ -211,16 +252,22 @@ static int kafl_guest_create_memory_bar(kafl_mem_state *s, int region_num, uint6
 	struct stat st;
 	
 	fd = open(file, O_CREAT|O_RDWR, S_IRWXU|S_IRWXG|S_IRWXO);
-	assert(ftruncate(fd, bar_size) == 0);
-	stat(file, &st);
+	fstat(fd, &st);
+	/* hugetlb backed regions come pre-sized by the frontend, rounded up to the huge page size */
+	if (st.st_size < bar_size){
+		assert(ftruncate(fd, bar_size) == 0);
+		st.st_size = bar_size;
+	}
 	QEMU_PT_DEBUG(INTERFACE_PREFIX, "new shm file: (max size: %lx) %lx", bar_size, st.st_size);
 	
-	assert(bar_size >= st.st_size);
-	ptr = mmap(0, bar_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	ptr = mmap(0, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
 	if (ptr == MAP_FAILED) {
 		error_setg_errno(errp, errno, "Failed to mmap memory");
 		return -1;
 	}
+	if (s->hugepages){
+		qemu_madvise(ptr, st.st_size, QEMU_MADV_HUGEPAGE);
+	}
 
 	switch(region_num){
 		case 1:	pt_setup_program((void*)ptr);
@@ -240,14 +287,19 @@ static int kafl_guest_setup_bitmap(kafl_mem_state *s, uint32_t bitmap_size, Erro
 	struct stat st;
 	
 	fd = open(s->bitmap_file, O_CREAT|O_RDWR, S_IRWXU|S_IRWXG|S_IRWXO);
-	assert(ftruncate(fd, bitmap_size) == 0);
-	stat(s->bitmap_file, &st);
-	assert(bitmap_size == st.st_size);
-	ptr = mmap(0, bitmap_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
+	fstat(fd, &st);
+	if (st.st_size < bitmap_size + KAFL_BITMAP_TRAILER_SIZE){
+		assert(ftruncate(fd, bitmap_size + KAFL_BITMAP_TRAILER_SIZE) == 0);
+		st.st_size = bitmap_size + KAFL_BITMAP_TRAILER_SIZE;
+	}
+	ptr = mmap(0, st.st_size, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
 	if (ptr == MAP_FAILED) {
 		error_setg_errno(errp, errno, "Failed to mmap memory");
 		return -1;
 	}
+	if (s->hugepages){
+		qemu_madvise(ptr, st.st_size, QEMU_MADV_HUGEPAGE);
+	}
 	pt_setup_bitmap((void*)ptr);
 
 	return 0;
@@ -314,6 +366,24 @@ static void pci_kafl_guest_realize(DeviceState *dev, Error **errp){
 	if(s->irq_filter){
 	}
 
+	if(s->binlog){
+		binlog_init(s->binlog);
+	}
+
+	if(s->telemetry){
+		telemetry_init(s->telemetry, s->standby);
+	}
+
+	if(s->dump_pt_trace){
+		pt_trace_dump_init(s->dump_pt_trace);
+	}
+
+	page_cache_init(s->page_cache);
+
+	if(s->template){
+		template_init(s->template);
+	}
+
 	if(s->debug_mode){
 		enable_hprintf();
 	}
@@ -345,6 +415,11 @@ static Property kafl_guest_properties[] = {
 	DEFINE_PROP_STRING("shm0", kafl_mem_state, data_bar_fd_0),
 	DEFINE_PROP_STRING("shm1", kafl_mem_state, data_bar_fd_1),
 	DEFINE_PROP_STRING("bitmap", kafl_mem_state, bitmap_file),
+	DEFINE_PROP_STRING("dump_pt_trace", kafl_mem_state, dump_pt_trace),
+	DEFINE_PROP_STRING("binlog", kafl_mem_state, binlog),
+	DEFINE_PROP_STRING("telemetry", kafl_mem_state, telemetry),
+	DEFINE_PROP_STRING("page_cache", kafl_mem_state, page_cache),
+	DEFINE_PROP_STRING("template", kafl_mem_state, template),
 	DEFINE_PROP_STRING("filter0", kafl_mem_state, filter_bitmap[0]),
 	DEFINE_PROP_STRING("filter1", kafl_mem_state, filter_bitmap[1]),
 	DEFINE_PROP_STRING("filter2", kafl_mem_state, filter_bitmap[2]),
@@ -368,6 +443,8 @@ static Property kafl_guest_properties[] = {
 	DEFINE_PROP_BOOL("reload_mode", kafl_mem_state, reload_mode, true),
 	DEFINE_PROP_BOOL("disable_snapshot", kafl_mem_state, disable_snapshot, false),
 	DEFINE_PROP_BOOL("lazy_vAPIC_reset", kafl_mem_state, lazy_vAPIC_reset, false),
+	DEFINE_PROP_BOOL("standby", kafl_mem_state, standby, false),
+	DEFINE_PROP_BOOL("hugepages", kafl_mem_state, hugepages, false),
 
 	DEFINE_PROP_END_OF_LIST(),
 };
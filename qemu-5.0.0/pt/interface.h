@@ -15,6 +15,8 @@
 
 #define DEFAULT_KAFL_BITMAP_SIZE	0x10000
 #define DEFAULT_EDGE_FILTER_SIZE	0x1000000
+/* page after the bitmap, holds the uint64_t publication generation (see pt_sync) */
+#define KAFL_BITMAP_TRAILER_SIZE	0x1000
 
 #define PROGRAM_SIZE				(128 << 20) /* 128MB Application Data */
 #define PAYLOAD_SIZE				(128 << 10)	/* 128KB Payload Data */
@@ -34,6 +36,9 @@
 #define KAFL_PROTO_DISABLE_SAMPLING	'O'
 #define KAFL_PROTO_COMMIT_FILTER	'T'
 #define KAFL_PROTO_FINALIZE			'F'
+#define KAFL_PROTO_SET_TIMEOUT		'J'	/* followed by the exec budget in usec (uint32_t, LE), 0 disables */
+#define KAFL_PROTO_ADOPT			'Y'	/* standby instance taken over by a slave, acknowledged */
+#define KAFL_PROTO_FLUSH_TRACE		'f'	/* PT trace archive written to disk, acknowledged */
 
 #ifdef CONFIG_REDQUEEN
 #define KAFL_PROTO_ENABLE_RQI_MODE	'A'
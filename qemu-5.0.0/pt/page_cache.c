@@ -0,0 +1,324 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Cache of guest code pages for the disassembler - see page_cache.h.
+ *
+ * Cached pages are never modified, so a pointer returned by
+ * page_cache_fetch() stays valid until the next fetch or invalidation.
+ * Pages overwritten by the patcher are remembered and not written to the
+ * backing file, a restarted Qemu does not have the patches applied.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "cpu.h"
+#include "exec/cpu-common.h"
+#include "sysemu/kvm.h"
+#include "sysemu/runstate.h"
+
+#include "pt/page_cache.h"
+#include "pt/memory_access.h"
+#include "pt/khash.h"
+#include "pt/debug.h"
+
+#define PAGE_CACHE_PREFIX	"PgCache: "
+
+typedef struct page_cache_entry_s {
+	uint64_t frame;
+	uint64_t vpage;
+	bool patched;
+	struct page_cache_entry_s* next;	/* same virtual page, other frames */
+	uint8_t data[x86_64_PAGE_SIZE];
+} page_cache_entry_t;
+
+KHASH_MAP_INIT_INT64(PAGES, page_cache_entry_t*)
+KHASH_SET_INIT_INT64(PATCHED)
+
+static khash_t(PAGES)* pages = NULL;
+static khash_t(PATCHED)* patched = NULL;
+static size_t num_pages = 0;
+static size_t dirty = 0;
+static char* cache_filename = NULL;
+
+static void page_cache_setup(void){
+	if (!pages){
+		pages = kh_init(PAGES);
+		patched = kh_init(PATCHED);
+	}
+}
+
+static void page_cache_free_list(page_cache_entry_t* entry){
+	while (entry){
+		page_cache_entry_t* next = entry->next;
+		free(entry);
+		num_pages--;
+		entry = next;
+	}
+}
+
+static void page_cache_drop_all(void){
+	khiter_t k;
+
+	for (k = kh_begin(pages); k != kh_end(pages); k++){
+		if (kh_exist(pages, k)){
+			page_cache_free_list(kh_value(pages, k));
+		}
+	}
+	kh_clear(PAGES, pages);
+	assert(num_pages == 0);
+}
+
+static void page_cache_insert(page_cache_entry_t* entry){
+	khiter_t k;
+	int ret;
+
+	k = kh_put(PAGES, pages, entry->vpage, &ret);
+	entry->next = ret ? NULL : kh_value(pages, k);
+	kh_value(pages, k) = entry;
+	num_pages++;
+}
+
+static hwaddr page_cache_translate(uint64_t vpage, CPUState *cpu){
+	hwaddr phys_addr;
+
+	kvm_cpu_synchronize_state(cpu);
+	phys_addr = cpu_get_phys_page_debug(cpu, vpage);
+	if (phys_addr == -1){
+		QEMU_PT_PRINTF(PAGE_CACHE_PREFIX, "cpu_get_phys_page_debug failed for %lx", vpage);
+	}
+	return phys_addr;
+}
+
+const uint8_t* page_cache_fetch(uint64_t address, CPUState *cpu){
+	uint64_t vpage = address & x86_64_PAGE_MASK;
+	uint64_t frame = 0;
+	page_cache_entry_t* entry;
+	hwaddr phys_addr = -1;
+	khiter_t k;
+
+	page_cache_setup();
+
+	/* kernel mappings are the same in all address spaces */
+	if (!(address >> 63)){
+		phys_addr = page_cache_translate(vpage, cpu);
+		if (phys_addr == -1){
+			return NULL;
+		}
+		frame = phys_addr;
+	}
+
+	k = kh_get(PAGES, pages, vpage);
+	if (k != kh_end(pages)){
+		for (entry = kh_value(pages, k); entry; entry = entry->next){
+			if (entry->frame == frame){
+				return entry->data + (address & ~x86_64_PAGE_MASK);
+			}
+		}
+	}
+
+	if (phys_addr == -1){
+		phys_addr = page_cache_translate(vpage, cpu);
+		if (phys_addr == -1){
+			return NULL;
+		}
+	}
+
+	if (num_pages >= PAGE_CACHE_MAX_PAGES){
+		page_cache_drop_all();
+	}
+
+	entry = malloc(sizeof(page_cache_entry_t));
+	if (!entry){
+		QEMU_PT_ERROR(PAGE_CACHE_PREFIX, "Out of memory");
+		return NULL;
+	}
+	entry->frame = frame;
+	entry->vpage = vpage;
+	entry->patched = kh_get(PATCHED, patched, vpage) != kh_end(patched);
+	cpu_physical_memory_read(phys_addr, entry->data, x86_64_PAGE_SIZE);
+	page_cache_insert(entry);
+
+	/* the whole file is rewritten, so save less often as the cache grows */
+	if (!entry->patched && ++dirty >= PAGE_CACHE_SAVE_BATCH && dirty >= num_pages / 4){
+		page_cache_save();
+	}
+	return entry->data + (address & ~x86_64_PAGE_MASK);
+}
+
+bool page_cache_read(uint64_t address, uint8_t* data, size_t size, CPUState *cpu){
+	while (size){
+		const uint8_t* code = page_cache_fetch(address, cpu);
+		size_t len = x86_64_PAGE_SIZE - (address & ~x86_64_PAGE_MASK);
+
+		if (!code){
+			return false;
+		}
+		if (len > size){
+			len = size;
+		}
+		memcpy(data, code, len);
+		data += len;
+		address += len;
+		size -= len;
+	}
+	return true;
+}
+
+void page_cache_invalidate(void){
+	page_cache_setup();
+	page_cache_drop_all();
+	/* the backing file is stale as well */
+	dirty = 1;
+	page_cache_save();
+}
+
+void page_cache_invalidate_range(uint64_t address, size_t size){
+	uint64_t vpage;
+	khiter_t k;
+	int ret;
+
+	page_cache_setup();
+	if (!size){
+		return;
+	}
+
+	for (vpage = address & x86_64_PAGE_MASK; vpage <= ((address + size - 1) & x86_64_PAGE_MASK); vpage += x86_64_PAGE_SIZE){
+		k = kh_get(PAGES, pages, vpage);
+		if (k != kh_end(pages)){
+			page_cache_free_list(kh_value(pages, k));
+			kh_del(PAGES, pages, k);
+		}
+		kh_put(PATCHED, patched, vpage, &ret);
+	}
+}
+
+static bool page_cache_load(void){
+	page_cache_file_header_t header;
+	page_cache_file_page_t record;
+	page_cache_entry_t* entry;
+	FILE* f;
+	uint32_t i;
+
+	f = fopen(cache_filename, "rb");
+	if (!f){
+		/* nothing recorded yet */
+		return errno == ENOENT;
+	}
+
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != PAGE_CACHE_MAGIC ||
+		header.version != PAGE_CACHE_VERSION || header.page_size != x86_64_PAGE_SIZE){
+		QEMU_PT_ERROR(PAGE_CACHE_PREFIX, "%s: layout mismatch, not loaded", cache_filename);
+		fclose(f);
+		return false;
+	}
+
+	for (i = 0; i < header.num_pages && num_pages < PAGE_CACHE_MAX_PAGES; i++){
+		entry = malloc(sizeof(page_cache_entry_t));
+		if (!entry){
+			QEMU_PT_ERROR(PAGE_CACHE_PREFIX, "%s: out of memory after %u pages", cache_filename, i);
+			break;
+		}
+		if (fread(&record, sizeof(record), 1, f) != 1 || fread(entry->data, x86_64_PAGE_SIZE, 1, f) != 1){
+			QEMU_PT_ERROR(PAGE_CACHE_PREFIX, "%s: truncated after %u pages", cache_filename, i);
+			free(entry);
+			break;
+		}
+		entry->frame = record.frame;
+		entry->vpage = record.vpage;
+		entry->patched = false;
+		page_cache_insert(entry);
+	}
+	fclose(f);
+
+	QEMU_PT_PRINTF(PAGE_CACHE_PREFIX, "Loaded %zu pages from %s", num_pages, cache_filename);
+	return true;
+}
+
+bool page_cache_save(void){
+	page_cache_file_header_t header;
+	page_cache_file_page_t record;
+	page_cache_entry_t* entry;
+	char* tmp_filename;
+	FILE* f;
+	khiter_t k;
+	bool ok = true;
+
+	if (!cache_filename || !dirty){
+		return false;
+	}
+
+	header.magic = PAGE_CACHE_MAGIC;
+	header.version = PAGE_CACHE_VERSION;
+	header.page_size = x86_64_PAGE_SIZE;
+	header.num_pages = 0;
+	for (k = kh_begin(pages); k != kh_end(pages); k++){
+		if (kh_exist(pages, k)){
+			for (entry = kh_value(pages, k); entry; entry = entry->next){
+				header.num_pages += !entry->patched;
+			}
+		}
+	}
+
+	/* write to a temporary file first, a reader never sees a partial cache -
+	 * standby instances of the same slave may be saving at the same time */
+	if (asprintf(&tmp_filename, "%s.%d.tmp", cache_filename, getpid()) == -1){
+		return false;
+	}
+	f = fopen(tmp_filename, "wb");
+	if (!f){
+		QEMU_PT_ERROR(PAGE_CACHE_PREFIX, "Could not open %s: %s", tmp_filename, strerror(errno));
+		free(tmp_filename);
+		return false;
+	}
+
+	ok &= fwrite(&header, sizeof(header), 1, f) == 1;
+	for (k = kh_begin(pages); ok && k != kh_end(pages); k++){
+		if (kh_exist(pages, k)){
+			for (entry = kh_value(pages, k); ok && entry; entry = entry->next){
+				if (entry->patched){
+					continue;
+				}
+				record.frame = entry->frame;
+				record.vpage = entry->vpage;
+				ok &= fwrite(&record, sizeof(record), 1, f) == 1;
+				ok &= fwrite(entry->data, x86_64_PAGE_SIZE, 1, f) == 1;
+			}
+		}
+	}
+	ok &= fclose(f) == 0;
+
+	if (ok && rename(tmp_filename, cache_filename) == 0){
+		dirty = 0;
+	} else {
+		QEMU_PT_ERROR(PAGE_CACHE_PREFIX, "Could not write %s", cache_filename);
+		unlink(tmp_filename);
+		ok = false;
+	}
+	free(tmp_filename);
+	return ok;
+}
+
+static void page_cache_atexit(void){
+	page_cache_save();
+}
+
+/* loadvm stops the VM for the restore, guest code may differ afterwards */
+static void page_cache_vm_state(void *opaque, int running, RunState state){
+	if (!running && state == RUN_STATE_RESTORE_VM){
+		page_cache_invalidate();
+	}
+}
+
+bool page_cache_init(const char* filename){
+	assert(!pages);
+
+	page_cache_setup();
+	qemu_add_vm_change_state_handler(page_cache_vm_state, NULL);
+	if (!filename){
+		return true;
+	}
+	cache_filename = strdup(filename);
+	atexit(page_cache_atexit);
+	return page_cache_load();
+}
@@ -0,0 +1,61 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Cache of guest code pages for the disassembler.
+ *
+ * Pages are copied out of guest memory once. User pages are keyed by virtual
+ * page + guest-physical frame, so that forked address spaces sharing their
+ * code hit the same entries. Kernel pages are shared by all address spaces
+ * and keyed by address only. The cache is invalidated on snapshot restore,
+ * and per page when the patcher rewrites instructions.
+ *
+ * With a backing file, the cache is loaded on startup and written back as
+ * it grows and on exit, so that a restarted Qemu starts with a warm cache.
+ * The file is only valid for the snapshot it was recorded with.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef PAGE_CACHE_H
+#define PAGE_CACHE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "qemu/osdep.h"
+#include "qemu-common.h"
+
+#define PAGE_CACHE_MAGIC			0x4347504b	/* "KPGC" */
+#define PAGE_CACHE_VERSION			2
+
+/* start over once the cache grows beyond this (64 MB) */
+#define PAGE_CACHE_MAX_PAGES		16384
+/* write back to the backing file after this many new pages */
+#define PAGE_CACHE_SAVE_BATCH		64
+
+typedef struct page_cache_file_header_s {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t page_size;
+	uint32_t num_pages;		/* records following the header */
+} __attribute__((packed)) page_cache_file_header_t;
+
+/* record header, followed by the page data */
+typedef struct page_cache_file_page_s {
+	uint64_t frame;			/* guest-physical page, 0 for kernel pages */
+	uint64_t vpage;
+} __attribute__((packed)) page_cache_file_page_t;
+
+/* filename may be NULL, the cache is not persisted then */
+bool page_cache_init(const char* filename);
+
+/* host pointer to the guest code at address, valid up to the end of its page */
+const uint8_t* page_cache_fetch(uint64_t address, CPUState *cpu);
+bool page_cache_read(uint64_t address, uint8_t* data, size_t size, CPUState *cpu);
+
+void page_cache_invalidate(void);
+void page_cache_invalidate_range(uint64_t address, size_t size);
+
+bool page_cache_save(void);
+
+#endif
@@ -10,6 +10,7 @@
 #include "patcher.h"
 #include "pt/memory_access.h"
 #include "pt/disassembler.h"
+#include "pt/page_cache.h"
 #include "debug.h"
 
 uint8_t cmp_patch_data[] = { 0x38, 0xC0, [2 ... MAX_INSTRUCTION_SIZE]=0x90 }; // CMP AL,AL; NOP, NOP ...
@@ -134,11 +135,13 @@ bool patcher_validate_patches(patcher_t *self){
 static void _patcher_apply_patch(patcher_t *self, size_t index) {
   patch_info_t *info = &self->patches[index];
 	write_virtual_shadow_memory(info->addr, (uint8_t*)cmp_patch, info->size, self->cpu);
+	page_cache_invalidate_range(info->addr, info->size);
 }
 
 static void _patcher_restore_patch(patcher_t *self, size_t index){
   patch_info_t *info = &self->patches[index];
 	write_virtual_shadow_memory(info->addr, (uint8_t*)&info->orig_bytes[0], info->size, self->cpu);
+	page_cache_invalidate_range(info->addr, info->size);
 }
 
 static void _patcher_save_patch(patcher_t *self, size_t index, uint8_t* data, size_t instruction_size, uint64_t addr) {
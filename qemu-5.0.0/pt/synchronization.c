@@ -16,7 +16,10 @@
 #include "sysemu/sysemu.h"
 #include "sysemu/runstate.h"
 #include "sysemu/kvm.h"
+#include "qemu/timer.h"
+#include "qemu/atomic.h"
 #include "pt.h"
+#include "pt/telemetry.h"
 
 /* debug */
 #include "debug.h"
@@ -28,6 +31,83 @@ pthread_mutex_t synchronization_disable_pt_mutex = PTHREAD_MUTEX_INITIALIZER;
 volatile bool synchronization_reload_pending = false;
 volatile bool synchronization_kvm_loop_waiting = false;
 
+/*
+ * Exec time budget (usec) set by the fuzzer frontend. The timer is armed on
+ * RELEASE and disarmed once the guest asks for the next payload or reports a
+ * crash. On expiry the vCPU is kicked out of KVM_RUN and parked in
+ * synchronization_check_timeout(), which reports KAFL_PROTO_TIMEOUT.
+ */
+static QEMUTimer *exec_timer = NULL;
+static uint32_t exec_timeout_us = 0;
+static bool exec_timer_armed = false;
+static bool synchronization_timeout_pending = false;
+
+/* RELEASE timestamp, exec latency is accounted when the guest asks for the next payload */
+static uint64_t exec_start_ns = 0;
+
+static void synchronization_exec_timer_expired(void *opaque){
+	CPUState *cpu = qemu_get_cpu(0);
+
+	pthread_mutex_lock(&synchronization_lock_mutex);
+	if(exec_timer_armed && !synchronization_kvm_loop_waiting){
+		exec_timer_armed = false;
+		atomic_set(&synchronization_timeout_pending, true);
+		qemu_cpu_kick(cpu);
+	}
+	pthread_mutex_unlock(&synchronization_lock_mutex);
+}
+
+void synchronization_set_timeout(uint32_t usec){
+	if(!exec_timer){
+		exec_timer = timer_new_us(QEMU_CLOCK_REALTIME, synchronization_exec_timer_expired, NULL);
+	}
+	QEMU_PT_DEBUG(CORE_PREFIX, "Exec timeout set to %u us", usec);
+	exec_timeout_us = usec;
+}
+
+/* caller holds synchronization_lock_mutex */
+static void synchronization_exec_timer_arm(void){
+	if(exec_timeout_us){
+		exec_timer_armed = true;
+		timer_mod(exec_timer, qemu_clock_get_us(QEMU_CLOCK_REALTIME) + exec_timeout_us);
+	}
+}
+
+/* caller holds synchronization_lock_mutex */
+static void synchronization_exec_timer_disarm(void){
+	if(exec_timer_armed){
+		exec_timer_armed = false;
+		timer_del(exec_timer);
+	}
+}
+
+void synchronization_cancel_timeout(void){
+	pthread_mutex_lock(&synchronization_lock_mutex);
+	synchronization_exec_timer_disarm();
+	pthread_mutex_unlock(&synchronization_lock_mutex);
+}
+
+void synchronization_check_timeout(CPUState *cpu){
+	if(likely(!atomic_read(&synchronization_timeout_pending))){
+		return;
+	}
+
+	pthread_mutex_lock(&synchronization_lock_mutex);
+	atomic_set(&synchronization_timeout_pending, false);
+	QEMU_PT_DEBUG(CORE_PREFIX, "Exec budget of %u us exceeded!", exec_timeout_us);
+	telemetry_count(TELEMETRY_TIMEOUTS, 1);
+	exec_start_ns = 0;
+
+	synchronization_disable_pt(cpu);
+	hypercall_snd_char(KAFL_PROTO_TIMEOUT);
+
+	/* park the vCPU until the next RELEASE - the frontend restarts us anyway */
+	synchronization_kvm_loop_waiting = true;
+	pthread_cond_wait(&synchronization_lock_condition, &synchronization_lock_mutex);
+	synchronization_kvm_loop_waiting = false;
+	pthread_mutex_unlock(&synchronization_lock_mutex);
+}
+
 void synchronization_check_reload_pending(CPUState *cpu){
 	bool value;
 	pthread_mutex_lock(&synchronization_lock_mutex);
@@ -42,12 +122,21 @@ void synchronization_unlock(void){
 	pthread_mutex_lock(&synchronization_lock_mutex);
 	pthread_cond_signal(&synchronization_lock_condition);
 	hypercall_reset_hprintf_counter();
+	synchronization_exec_timer_arm();
+	exec_start_ns = telemetry_now();
 	pthread_mutex_unlock(&synchronization_lock_mutex);
 }	
 
 void synchronization_lock(CPUState *cpu){
 
 	pthread_mutex_lock(&synchronization_lock_mutex);
+	synchronization_exec_timer_disarm();
+	atomic_set(&synchronization_timeout_pending, false);
+	if(exec_start_ns){
+		telemetry_count(TELEMETRY_EXECS, 1);
+		telemetry_record(TELEMETRY_HIST_EXEC, telemetry_now() - exec_start_ns);
+		exec_start_ns = 0;
+	}
 	if(!synchronization_reload_pending){
 		synchronization_kvm_loop_waiting = true;
 
@@ -65,7 +154,10 @@ void synchronization_lock(CPUState *cpu){
 		pthread_mutex_unlock(&synchronization_lock_mutex);
 		return;
 	}
+	TELEMETRY_PHASE_COMMIT();
+	TELEMETRY_SPAN_BEGIN(span);
 	pthread_cond_wait(&synchronization_lock_condition, &synchronization_lock_mutex);
+	TELEMETRY_SPAN_END(TELEMETRY_PHASE_LOCK_WAIT, span);
 	synchronization_kvm_loop_waiting = false;
 	pthread_mutex_unlock(&synchronization_lock_mutex);
 }	
@@ -17,3 +17,7 @@ void synchronization_unlock(void);
 void synchronization_lock(CPUState *cpu);
 void synchronization_reload_vm(void);
 void synchronization_disable_pt(CPUState *cpu);
+
+void synchronization_set_timeout(uint32_t usec);
+void synchronization_cancel_timeout(void);
+void synchronization_check_timeout(CPUState *cpu);
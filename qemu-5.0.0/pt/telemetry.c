@@ -0,0 +1,170 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Shared-memory telemetry - see telemetry.h.
+ *
+ * All updates are done from the vCPU thread, which makes Qemu the single
+ * writer of its block. Counters persist across Qemu restarts, the segment
+ * is reset by the frontend when a slave starts.
+ *
+ * A standby instance maps the segment of its slave, but only starts writing
+ * when it is adopted - the slave's current instance may still be running.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/atomic.h"
+#include <sys/mman.h>
+
+#include "pt/telemetry.h"
+#include "pt/debug.h"
+
+#define TELEMETRY_PREFIX	"Telem: "
+
+static telemetry_block_t* block = NULL;
+static telemetry_block_t* standby_block = NULL;
+
+#ifdef TELEMETRY_PHASE_SPANS
+/* phase cycles of the current exec cycle, published by telemetry_phase_commit() */
+static uint64_t phase_cycles[TELEMETRY_PHASES];
+
+static uint64_t estimate_tsc_hz(void){
+	uint64_t tsc = telemetry_tsc();
+	uint64_t ns = telemetry_now();
+
+	usleep(10000);
+	return (telemetry_tsc() - tsc) * 1000000000ULL / (telemetry_now() - ns);
+}
+#endif
+
+bool telemetry_init(const char* filename, bool standby){
+	telemetry_header_t* header;
+	void* ptr;
+	int fd;
+
+	assert(!block);
+
+	fd = open(filename, O_RDWR);
+	if (fd == -1){
+		QEMU_PT_ERROR(TELEMETRY_PREFIX, "Could not open %s: %s", filename, strerror(errno));
+		return false;
+	}
+
+	ptr = mmap(NULL, TELEMETRY_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (ptr == MAP_FAILED){
+		QEMU_PT_ERROR(TELEMETRY_PREFIX, "Could not map %s: %s", filename, strerror(errno));
+		return false;
+	}
+
+	header = ptr;
+	if (header->magic != TELEMETRY_MAGIC || header->version != TELEMETRY_VERSION ||
+		header->block_size != TELEMETRY_BLOCK_SIZE || header->hist_buckets != TELEMETRY_HIST_BUCKETS){
+		QEMU_PT_ERROR(TELEMETRY_PREFIX, "%s: layout mismatch, telemetry disabled", filename);
+		munmap(ptr, TELEMETRY_SIZE);
+		return false;
+	}
+
+	standby_block = (telemetry_block_t*)((uint8_t*)ptr + TELEMETRY_HEADER_SIZE + TELEMETRY_BLOCK_QEMU * TELEMETRY_BLOCK_SIZE);
+	if (!standby){
+		telemetry_attach();
+	}
+	return true;
+}
+
+void telemetry_attach(void){
+	if (!standby_block){
+		return;
+	}
+	block = standby_block;
+	standby_block = NULL;
+
+	/* a previous instance may have died mid-update */
+	if (block->seq & 1){
+		block->seq++;
+	}
+	block->pid = getpid();
+#ifdef TELEMETRY_PHASE_SPANS
+	block->tsc_hz = estimate_tsc_hz();
+#endif
+}
+
+static inline void telemetry_begin(void){
+	atomic_set(&block->seq, block->seq + 1);
+	smp_wmb();
+}
+
+static inline void telemetry_end(void){
+	block->update_ns = telemetry_now();
+	smp_wmb();
+	atomic_set(&block->seq, block->seq + 1);
+}
+
+void telemetry_count(int counter, uint64_t n){
+	if (!block){
+		return;
+	}
+	telemetry_begin();
+	block->counters[counter] += n;
+	telemetry_end();
+}
+
+void telemetry_crash_ip(uint64_t ip){
+	if (!block){
+		return;
+	}
+	telemetry_begin();
+	block->crash_ip = ip;
+	telemetry_end();
+}
+
+void telemetry_record(int hist, uint64_t ns){
+	telemetry_hist_t* h;
+
+	if (!block){
+		return;
+	}
+	h = &block->hists[hist];
+
+	telemetry_begin();
+	h->count++;
+	h->sum += ns;
+	if (ns > h->max){
+		h->max = ns;
+	}
+	h->buckets[telemetry_bucket(ns)]++;
+	telemetry_end();
+}
+
+#ifdef TELEMETRY_PHASE_SPANS
+void telemetry_phase_add(int phase, uint64_t cycles){
+	phase_cycles[phase] += cycles;
+}
+
+void telemetry_phase_commit(void){
+	telemetry_phase_t* p;
+	uint64_t cycles;
+
+	if (!block){
+		memset(phase_cycles, 0, sizeof(phase_cycles));
+		return;
+	}
+
+	telemetry_begin();
+	block->phase_runs++;
+	for (int i = 0; i < TELEMETRY_PHASES; i++){
+		p = &block->phases[i];
+		cycles = phase_cycles[i];
+		p->cycles += cycles;
+		p->last = cycles;
+		if (cycles > p->max){
+			p->max = cycles;
+		}
+		/* signed update, the average may move in either direction */
+		p->ema = (int64_t)p->ema + ((int64_t)cycles - (int64_t)p->ema) / 64;
+		phase_cycles[i] = 0;
+	}
+	telemetry_end();
+}
+#endif
@@ -0,0 +1,163 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Shared-memory telemetry. The fuzzer frontend creates one segment per slave
+ * holding two fixed-layout blocks: one written by the Python slave and one
+ * written by Qemu. Each block has a single writer and is protected by a
+ * seqlock, readers (kAFL-Fuzzer/common/telemetry.py) retry on concurrent
+ * updates.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <time.h>
+
+#define TELEMETRY_MAGIC				0x4c45544b	/* "KTEL" */
+#define TELEMETRY_VERSION			6
+
+/* rdtsc spans around the phases of the kAFL exec cycle (see TELEMETRY_PHASE_*) */
+//#define TELEMETRY_PHASE_SPANS
+
+#define TELEMETRY_HEADER_SIZE		4096
+#define TELEMETRY_BLOCK_SIZE		32768
+#define TELEMETRY_SIZE				(TELEMETRY_HEADER_SIZE + 2 * TELEMETRY_BLOCK_SIZE)
+
+#define TELEMETRY_BLOCK_SLAVE		0
+#define TELEMETRY_BLOCK_QEMU		1
+
+/* counters - same indices in both blocks, unused ones stay 0 */
+#define TELEMETRY_EXECS				0
+#define TELEMETRY_RELOADS			1
+#define TELEMETRY_TIMEOUTS			2
+#define TELEMETRY_CRASHES			3
+#define TELEMETRY_KASAN				4
+#define TELEMETRY_FUNKY				5
+#define TELEMETRY_PT_OVERFLOWS		6	/* ToPA overflows */
+#define TELEMETRY_PT_TRASHED		7	/* decoder errors / trashed runs */
+#define TELEMETRY_CRASH_DUPS		8	/* crashes not sent to the master, known signature */
+#define TELEMETRY_COUNTERS			16
+
+/* latency histograms, values in ns */
+#define TELEMETRY_HIST_EXEC			0
+#define TELEMETRY_HIST_DECODE		1
+#define TELEMETRY_HIST_BITMAP		2
+#define TELEMETRY_HIST_PAYLOAD		3
+#define TELEMETRY_HISTS				8
+
+/*
+ * Phases of the exec cycle between KVM_EXIT_KAFL_RELEASE and the next
+ * acquire, in TSC cycles. Spans may nest (e.g. DECODE within RELEASE) and
+ * are summed per cycle, which ends when the vCPU blocks for the next payload.
+ */
+#define TELEMETRY_PHASE_RELEASE		0	/* KVM_EXIT_KAFL_RELEASE handler */
+#define TELEMETRY_PHASE_PT_DISABLE	1	/* pt_disable() incl. decoder flush */
+#define TELEMETRY_PHASE_DECODE		2	/* decode_buffer() in pt_dump() */
+#define TELEMETRY_PHASE_PT_SYNC		3	/* pt_sync() */
+#define TELEMETRY_PHASE_LOCK_WAIT	4	/* waiting on the frontend in synchronization_lock() */
+#define TELEMETRY_PHASE_NEXT_PAYLOAD	5	/* KVM_EXIT_KAFL_NEXT_PAYLOAD handler, incl. LOCK_WAIT */
+#define TELEMETRY_PHASE_PAYLOAD		6	/* payload injection into the guest */
+#define TELEMETRY_PHASE_ACQUIRE		7	/* KVM_EXIT_KAFL_ACQUIRE handler */
+#define TELEMETRY_PHASE_OVERFLOW	8	/* KVM_EXIT_KAFL_TOPA_MAIN_FULL handler */
+#define TELEMETRY_PHASES			16
+
+/* havoc operator/stacking depth scheduling, only written to the slave block */
+#define TELEMETRY_HAVOC_OPS			32
+#define TELEMETRY_HAVOC_DEPTHS		8
+#define TELEMETRY_HAVOC_NAMES		256	/* offset of operator names in the header page */
+
+/*
+ * Log-linear buckets: values below 2^SUB_BITS are exact, above that each
+ * power of two is split into 2^SUB_BITS buckets (~12% precision). The last
+ * bucket collects everything from ~64s upwards.
+ */
+#define TELEMETRY_HIST_SUB_BITS		3
+#define TELEMETRY_HIST_BUCKETS		272
+
+typedef struct telemetry_header_s {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t header_size;
+	uint32_t block_size;
+	uint32_t counters;
+	uint32_t hists;
+	uint32_t hist_buckets;
+	uint32_t hist_sub_bits;
+} __attribute__((packed)) telemetry_header_t;
+
+typedef struct telemetry_hist_s {
+	uint64_t count;
+	uint64_t sum;
+	uint64_t max;
+	uint64_t buckets[TELEMETRY_HIST_BUCKETS];
+} __attribute__((packed)) telemetry_hist_t;
+
+typedef struct telemetry_phase_s {
+	uint64_t cycles;		/* sum over all exec cycles */
+	uint64_t max;
+	uint64_t last;			/* last exec cycle */
+	uint64_t ema;			/* moving average, alpha = 1/64 */
+} __attribute__((packed)) telemetry_phase_t;
+
+typedef struct telemetry_block_s {
+	uint64_t seq;			/* odd while an update is in progress */
+	uint64_t pid;
+	uint64_t update_ns;		/* CLOCK_MONOTONIC of last update */
+	uint64_t counters[TELEMETRY_COUNTERS];
+	telemetry_hist_t hists[TELEMETRY_HISTS];
+	uint64_t tsc_hz;		/* 0 unless built with TELEMETRY_PHASE_SPANS */
+	uint64_t phase_runs;	/* exec cycles committed to phases[] */
+	telemetry_phase_t phases[TELEMETRY_PHASES];
+	uint64_t havoc_ops[TELEMETRY_HAVOC_OPS][2];			/* uses, finds */
+	uint64_t havoc_depths[TELEMETRY_HAVOC_DEPTHS][2];	/* execs, finds */
+	uint64_t crash_ip;		/* Qemu block: return address of the last kernel PANIC/KASAN report */
+	uint64_t placement[5];	/* slave block: CPU/NUMA placement, see common/placement.py */
+	uint64_t template_ram[3];	/* slave block: RAM template sharing, see common/template.py */
+} __attribute__((packed)) telemetry_block_t;
+
+bool telemetry_init(const char* filename, bool standby);
+void telemetry_attach(void);
+void telemetry_count(int counter, uint64_t n);
+void telemetry_record(int hist, uint64_t ns);
+void telemetry_crash_ip(uint64_t ip);
+
+#ifdef TELEMETRY_PHASE_SPANS
+void telemetry_phase_add(int phase, uint64_t cycles);
+void telemetry_phase_commit(void);
+
+static inline uint64_t telemetry_tsc(void){
+	return __builtin_ia32_rdtsc();
+}
+
+#define TELEMETRY_SPAN_BEGIN(var)			uint64_t var = telemetry_tsc()
+#define TELEMETRY_SPAN_END(phase, var)		telemetry_phase_add(phase, telemetry_tsc() - (var))
+#define TELEMETRY_PHASE_COMMIT()			telemetry_phase_commit()
+#else
+#define TELEMETRY_SPAN_BEGIN(var)
+#define TELEMETRY_SPAN_END(phase, var)
+#define TELEMETRY_PHASE_COMMIT()
+#endif
+
+static inline uint64_t telemetry_now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static inline int telemetry_bucket(uint64_t value){
+	int e, idx;
+
+	if (value < (1 << TELEMETRY_HIST_SUB_BITS)){
+		return value;
+	}
+	e = 63 - __builtin_clzll(value);
+	idx = ((e - TELEMETRY_HIST_SUB_BITS + 1) << TELEMETRY_HIST_SUB_BITS) +
+		  ((value >> (e - TELEMETRY_HIST_SUB_BITS)) & ((1 << TELEMETRY_HIST_SUB_BITS) - 1));
+	return idx < TELEMETRY_HIST_BUCKETS ? idx : TELEMETRY_HIST_BUCKETS - 1;
+}
+
+#endif
@@ -0,0 +1,92 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Shared guest RAM template - see template.h.
+ *
+ * The export is started from a bottom half, as qmp_migrate() needs the
+ * iothread lock and must not run on the vCPU thread. Qemu exits once the
+ * migration has completed, the frontend checks the exit code.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/main-loop.h"
+#include "qemu/notify.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "block/aio.h"
+#include "migration/misc.h"
+#include "sysemu/runstate.h"
+#include "sysemu/sysemu.h"
+
+#include "pt/template.h"
+#include "pt/debug.h"
+
+#define TEMPLATE_PREFIX	"Template: "
+
+static char* template_filename = NULL;
+static bool template_started = false;
+static Notifier migration_notifier;
+static Notifier init_done_notifier;
+
+static void template_export_bh(void* opaque){
+	Error *err = NULL;
+	char* uri;
+
+	uri = g_strdup_printf("exec:cat > '%s'", template_filename);
+	qmp_migrate(uri, false, false, false, false, false, false, false, false, &err);
+	g_free(uri);
+	if (err){
+		error_reportf_err(err, TEMPLATE_PREFIX "export failed: ");
+		exit(1);
+	}
+}
+
+static void template_schedule_export(void){
+	if (template_started){
+		return;
+	}
+	template_started = true;
+	QEMU_PT_PRINTF(TEMPLATE_PREFIX, "Exporting device state to %s", template_filename);
+	aio_bh_schedule_oneshot(qemu_get_aio_context(), template_export_bh, NULL);
+}
+
+static void template_migration_state(Notifier *notifier, void *data){
+	MigrationState *s = data;
+
+	if (migration_has_finished(s)){
+		QEMU_PT_PRINTF(TEMPLATE_PREFIX, "Done. Shutting down..");
+		qemu_system_shutdown_request(SHUTDOWN_CAUSE_HOST_SIGNAL);
+	} else if (migration_has_failed(s)){
+		QEMU_PT_ERROR(TEMPLATE_PREFIX, "Export of %s failed", template_filename);
+		exit(1);
+	}
+}
+
+/* started paused after -loadvm: the snapshot already is past HYPERCALL_KAFL_LOCK */
+static void template_init_done(Notifier *notifier, void *data){
+	if (!autostart){
+		template_schedule_export();
+	}
+}
+
+void template_init(const char* filename){
+	assert(!template_filename);
+
+	template_filename = g_strdup(filename);
+	migration_notifier.notify = template_migration_state;
+	add_migration_state_change_notifier(&migration_notifier);
+	init_done_notifier.notify = template_init_done;
+	qemu_add_machine_init_done_notifier(&init_done_notifier);
+}
+
+bool template_enabled(void){
+	return template_filename != NULL;
+}
+
+void template_export(void){
+	/* the vCPU must not touch the shared RAM after this point */
+	vm_stop(RUN_STATE_PAUSED);
+	template_schedule_export();
+}
@@ -0,0 +1,27 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Shared guest RAM template. A template instance runs with its RAM in a
+ * shared memory-backend-file and exports the device state once the agent
+ * reaches HYPERCALL_KAFL_LOCK - or right away when started paused (-S)
+ * after -loadvm. The export is a regular migration stream with
+ * x-ignore-shared, so it holds everything but the main RAM.
+ *
+ * Slaves map the RAM file with share=off and load the stream via
+ * -incoming, only pages dirtied by a slave are copied.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef TEMPLATE_H
+#define TEMPLATE_H
+
+#include <stdbool.h>
+
+void template_init(const char* filename);
+bool template_enabled(void);
+
+/* called on HYPERCALL_KAFL_LOCK from the vCPU thread */
+void template_export(void);
+
+#endif
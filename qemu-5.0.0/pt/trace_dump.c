@@ -0,0 +1,394 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Asynchronous Intel PT trace archive writer.
+ *
+ * pt_dump() used to fwrite() each ToPA region synchronously on the vCPU
+ * thread. Instead, trace data is now copied into a ring of large buffers
+ * which are drained to disk by a background thread (O_DIRECT if supported
+ * by the target file system). A buffer collects the chunks of several
+ * execs and is handed to the writer once it is full, or right away if the
+ * writer is idle. If the writer falls behind, data is dropped and the
+ * affected exec is flagged - the vCPU thread never blocks on I/O.
+ * Once the archive exceeds PT_TRACE_DUMP_MAX_SIZE, the writer moves it
+ * aside and starts a new one, so at most two archives are kept on disk.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#include "qemu/osdep.h"
+#include <pthread.h>
+
+#ifdef PT_TRACE_DUMP_LZ4
+#include <lz4.h>
+#endif
+
+#include "pt/trace_dump.h"
+#include "pt/debug.h"
+
+#define FRAME_HEADER_SIZE	sizeof(pt_trace_dump_frame_t)
+
+typedef struct trace_dump_buffer_s {
+	uint8_t* data;
+	size_t used;
+	size_t frame;			/* offset of the open chunk header, or -1 */
+	volatile bool full;
+} trace_dump_buffer_t;
+
+static trace_dump_buffer_t buffers[PT_TRACE_DUMP_BUFFERS];
+static trace_dump_buffer_t* current = NULL;
+static uint32_t producer = 0;
+static uint32_t consumer = 0;
+static uint32_t pending = 0;
+
+static uint64_t exec_id = 0;
+static bool exec_dropped = false;
+static uint64_t dropped_bytes = 0;
+
+static int fd = -1;
+static char* archive_filename = NULL;
+static bool direct_io = false;
+static bool stop = false;
+static pthread_t writer_thread;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t drained = PTHREAD_COND_INITIALIZER;
+
+#ifdef PT_TRACE_DUMP_LZ4
+#define SCRATCH_SIZE		(PT_TRACE_DUMP_BUFFER_SIZE * 2)
+static uint8_t* scratch = NULL;
+#endif
+
+static inline size_t align_up(size_t size){
+	return (size + PT_TRACE_DUMP_ALIGN - 1) & ~((size_t)PT_TRACE_DUMP_ALIGN - 1);
+}
+
+static void write_all(uint8_t* data, size_t len){
+	if (direct_io){
+		memset(data + len, 0, align_up(len) - len);
+		len = align_up(len);
+	}
+
+	while (len){
+		ssize_t ret = write(fd, data, len);
+		if (ret < 0){
+			if (errno == EINTR){
+				continue;
+			}
+			QEMU_PT_ERROR(TRACE_DUMP_PREFIX, "write failed: %s", strerror(errno));
+			return;
+		}
+		data += ret;
+		len -= ret;
+	}
+}
+
+static void write_buffer(trace_dump_buffer_t* buf){
+#ifdef PT_TRACE_DUMP_LZ4
+	size_t in = 0, out = 0;
+	while (in < buf->used){
+		pt_trace_dump_frame_t* header = (pt_trace_dump_frame_t*)(buf->data + in);
+		pt_trace_dump_frame_t* dst = (pt_trace_dump_frame_t*)(scratch + out);
+		int ret = LZ4_compress_default((const char*)header + FRAME_HEADER_SIZE, (char*)dst + FRAME_HEADER_SIZE,
+									   header->size, SCRATCH_SIZE - PT_TRACE_DUMP_ALIGN - out - FRAME_HEADER_SIZE);
+		*dst = *header;
+		if (ret > 0){
+			dst->flags |= PT_TRACE_DUMP_FLAG_LZ4;
+			dst->size = ret;
+		}
+		else {
+			memcpy((uint8_t*)dst + FRAME_HEADER_SIZE, (uint8_t*)header + FRAME_HEADER_SIZE, header->size);
+		}
+		in += FRAME_HEADER_SIZE + header->size;
+		out += FRAME_HEADER_SIZE + dst->size;
+	}
+	write_all(scratch, out);
+#else
+	write_all(buf->data, buf->used);
+#endif
+}
+
+static int open_archive(const char* filename){
+	int ret = open(filename, O_WRONLY | O_CREAT | O_DIRECT, 0644);
+	if (ret != -1){
+		direct_io = true;
+	}
+	else {
+		/* tmpfs and friends do not support O_DIRECT */
+		ret = open(filename, O_WRONLY | O_CREAT, 0644);
+		direct_io = false;
+	}
+	return ret;
+}
+
+/* writer thread - start over with an empty archive, keeping the full one as <filename>.1 */
+static void rotate_archive(void){
+	char* old_filename;
+	int new_fd;
+
+	if (lseek(fd, 0, SEEK_CUR) < PT_TRACE_DUMP_MAX_SIZE){
+		return;
+	}
+	if (asprintf(&old_filename, "%s.1", archive_filename) == -1){
+		return;
+	}
+	if (rename(archive_filename, old_filename)){
+		QEMU_PT_ERROR(TRACE_DUMP_PREFIX, "Could not rotate %s: %s", archive_filename, strerror(errno));
+	}
+	else {
+		new_fd = open_archive(archive_filename);
+		if (new_fd == -1){
+			QEMU_PT_ERROR(TRACE_DUMP_PREFIX, "Could not open %s: %s", archive_filename, strerror(errno));
+		}
+		else {
+			close(fd);
+			fd = new_fd;
+		}
+	}
+	free(old_filename);
+}
+
+static void* trace_dump_thread(void* arg){
+	pthread_mutex_lock(&lock);
+	while (true){
+		trace_dump_buffer_t* buf = &buffers[consumer];
+		if (!buf->full){
+			if (stop){
+				break;
+			}
+			pthread_cond_wait(&cond, &lock);
+			continue;
+		}
+		pthread_mutex_unlock(&lock);
+
+		write_buffer(buf);
+		rotate_archive();
+
+		pthread_mutex_lock(&lock);
+		buf->full = false;
+		pending--;
+		consumer = (consumer + 1) % PT_TRACE_DUMP_BUFFERS;
+		if (!pending){
+			pthread_cond_broadcast(&drained);
+		}
+	}
+	pthread_mutex_unlock(&lock);
+	return NULL;
+}
+
+static trace_dump_buffer_t* acquire_buffer(void){
+	trace_dump_buffer_t* buf = NULL;
+
+	pthread_mutex_lock(&lock);
+	if (!buffers[producer].full){
+		buf = &buffers[producer];
+		producer = (producer + 1) % PT_TRACE_DUMP_BUFFERS;
+	}
+	pthread_mutex_unlock(&lock);
+
+	if (buf){
+		buf->used = 0;
+		buf->frame = (size_t)-1;
+	}
+	return buf;
+}
+
+static void close_frame(uint32_t flags){
+	pt_trace_dump_frame_t* header;
+
+	if (current->frame == (size_t)-1){
+		return;
+	}
+	header = (pt_trace_dump_frame_t*)(current->data + current->frame);
+	header->magic = PT_TRACE_DUMP_MAGIC;
+	header->flags = flags | (exec_dropped ? PT_TRACE_DUMP_FLAG_DROPPED : 0);
+	header->exec_id = exec_id;
+	header->size = current->used - current->frame - FRAME_HEADER_SIZE;
+	header->raw_size = header->size;
+	current->frame = (size_t)-1;
+}
+
+static void seal_buffer(void){
+	pthread_mutex_lock(&lock);
+	current->full = true;
+	pending++;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+
+	current = NULL;
+}
+
+/* make sure a chunk of the current exec is open, false if the ring is full */
+static bool open_frame(void){
+	while (true){
+		if (!current){
+			current = acquire_buffer();
+			if (!current){
+				exec_dropped = true;
+				return false;
+			}
+		}
+		if (current->frame != (size_t)-1){
+			return true;
+		}
+		if (PT_TRACE_DUMP_BUFFER_SIZE - current->used <= FRAME_HEADER_SIZE){
+			seal_buffer();
+			continue;
+		}
+		current->frame = current->used;
+		current->used += FRAME_HEADER_SIZE;
+		return true;
+	}
+}
+
+bool pt_trace_dump_init(const char* filename){
+	off_t end;
+
+	assert(fd == -1);
+
+	fd = open_archive(filename);
+	if (fd == -1){
+		QEMU_PT_ERROR(TRACE_DUMP_PREFIX, "Could not open %s: %s", filename, strerror(errno));
+		return false;
+	}
+
+	/* keep the archive across Qemu restarts - append at the next aligned offset */
+	end = lseek(fd, 0, SEEK_END);
+	if (direct_io && end % PT_TRACE_DUMP_ALIGN){
+		end = align_up(end);
+		if (ftruncate(fd, end)){
+			QEMU_PT_ERROR(TRACE_DUMP_PREFIX, "ftruncate failed: %s", strerror(errno));
+		}
+	}
+	lseek(fd, end, SEEK_SET);
+
+	for (int i = 0; i < PT_TRACE_DUMP_BUFFERS; i++){
+		if (posix_memalign((void**)&buffers[i].data, PT_TRACE_DUMP_ALIGN, PT_TRACE_DUMP_BUFFER_SIZE)){
+			goto fail;
+		}
+		buffers[i].full = false;
+	}
+
+#ifdef PT_TRACE_DUMP_LZ4
+	if (posix_memalign((void**)&scratch, PT_TRACE_DUMP_ALIGN, SCRATCH_SIZE)){
+		goto fail;
+	}
+#endif
+
+	stop = false;
+	if (pthread_create(&writer_thread, NULL, trace_dump_thread, NULL)){
+		goto fail;
+	}
+
+	archive_filename = g_strdup(filename);
+	QEMU_PT_PRINTF(TRACE_DUMP_PREFIX, "Dumping PT trace to %s (O_DIRECT: %d)", filename, direct_io);
+	atexit(pt_trace_dump_destroy);
+	return true;
+
+fail:
+	QEMU_PT_ERROR(TRACE_DUMP_PREFIX, "Could not set up trace writer");
+	for (int i = 0; i < PT_TRACE_DUMP_BUFFERS; i++){
+		free(buffers[i].data);
+		buffers[i].data = NULL;
+	}
+	close(fd);
+	fd = -1;
+	return false;
+}
+
+bool pt_trace_dump_enabled(void){
+	return fd != -1;
+}
+
+void pt_trace_dump_write(const void* data, size_t bytes){
+	const uint8_t* src = data;
+
+	while (bytes){
+		if (!open_frame()){
+			dropped_bytes += bytes;
+			return;
+		}
+
+		size_t len = PT_TRACE_DUMP_BUFFER_SIZE - current->used;
+		if (len > bytes){
+			len = bytes;
+		}
+		memcpy(current->data + current->used, src, len);
+		current->used += len;
+		src += len;
+		bytes -= len;
+
+		if (current->used == PT_TRACE_DUMP_BUFFER_SIZE){
+			close_frame(0);
+			seal_buffer();
+		}
+	}
+}
+
+void pt_trace_dump_commit(void){
+	/* the last chunk may be empty, e.g. if the trace has just filled up a buffer */
+	if (open_frame()){
+		bool writer_idle;
+
+		close_frame(PT_TRACE_DUMP_FLAG_LAST);
+
+		/* keep batching while the writer is busy, but don't let data sit around when it is idle */
+		pthread_mutex_lock(&lock);
+		writer_idle = !pending;
+		pthread_mutex_unlock(&lock);
+		if (writer_idle){
+			seal_buffer();
+		}
+	}
+	if (exec_dropped){
+		QEMU_PT_DEBUG(TRACE_DUMP_PREFIX, "Writer too slow, dropped %lu bytes so far", dropped_bytes);
+	}
+	exec_dropped = false;
+	exec_id++;
+}
+
+void pt_trace_dump_flush(void){
+	if (fd == -1){
+		return;
+	}
+
+	if (current){
+		seal_buffer();
+	}
+
+	pthread_mutex_lock(&lock);
+	while (pending){
+		pthread_cond_wait(&drained, &lock);
+	}
+	pthread_mutex_unlock(&lock);
+}
+
+void pt_trace_dump_destroy(void){
+	if (fd == -1){
+		return;
+	}
+
+	if (current){
+		close_frame(PT_TRACE_DUMP_FLAG_LAST);
+		seal_buffer();
+	}
+
+	pthread_mutex_lock(&lock);
+	stop = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(writer_thread, NULL);
+
+	for (int i = 0; i < PT_TRACE_DUMP_BUFFERS; i++){
+		free(buffers[i].data);
+		buffers[i].data = NULL;
+	}
+#ifdef PT_TRACE_DUMP_LZ4
+	free(scratch);
+	scratch = NULL;
+#endif
+	close(fd);
+	fd = -1;
+	g_free(archive_filename);
+	archive_filename = NULL;
+}
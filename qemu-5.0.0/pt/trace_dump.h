@@ -0,0 +1,59 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Asynchronous Intel PT trace archive writer.
+ *
+ * SPDX-License-Identifier: GPL-2.0-or-later
+ */
+
+#ifndef TRACE_DUMP_H
+#define TRACE_DUMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* enable LZ4 framing of trace chunks (requires linking with -llz4) */
+//#define PT_TRACE_DUMP_LZ4
+
+#define PT_TRACE_DUMP_MAGIC			0x4450544b	/* "KTPD" */
+#define PT_TRACE_DUMP_BUFFER_SIZE	(8 << 20)
+#define PT_TRACE_DUMP_BUFFERS		8
+#define PT_TRACE_DUMP_ALIGN			4096
+/* archive size after which it is moved to <filename>.1, replacing an older one */
+#define PT_TRACE_DUMP_MAX_SIZE		(256 << 20)
+
+#define PT_TRACE_DUMP_FLAG_LZ4		(1 << 0)	/* payload is a raw LZ4 block */
+#define PT_TRACE_DUMP_FLAG_DROPPED	(1 << 1)	/* data of this exec was lost (ring full) */
+#define PT_TRACE_DUMP_FLAG_LAST		(1 << 2)	/* final chunk of this exec */
+
+/*
+ * The archive is a sequence of chunks, each starting with this header.
+ * Qemu appends to an existing archive, so exec_id restarts at 0 whenever
+ * a new Qemu instance takes over.
+ * Large traces are split across several chunks sharing the same exec_id,
+ * the last one is flagged PT_TRACE_DUMP_FLAG_LAST (and may be empty).
+ * With O_DIRECT, zero padding up to the next PT_TRACE_DUMP_ALIGN boundary
+ * may follow a chunk - readers skip ahead if the magic does not match.
+ */
+typedef struct pt_trace_dump_frame_s {
+	uint32_t magic;
+	uint32_t flags;
+	uint64_t exec_id;
+	uint32_t size;			/* payload bytes following the header */
+	uint32_t raw_size;		/* payload bytes after decompression */
+} __attribute__((packed)) pt_trace_dump_frame_t;
+
+bool pt_trace_dump_init(const char* filename);
+bool pt_trace_dump_enabled(void);
+
+/* producer side - only call from the vCPU thread */
+void pt_trace_dump_write(const void* data, size_t bytes);
+void pt_trace_dump_commit(void);
+
+/* write out all committed execs and wait for the writer - only while the vCPU is parked */
+void pt_trace_dump_flush(void);
+
+void pt_trace_dump_destroy(void);
+
+#endif
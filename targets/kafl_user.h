@@ -108,7 +108,9 @@ typedef struct{
 #define KAFL_MODE_32	1
 #define KAFL_MODE_16	2
 
-#if defined(__i386__)
+#if defined(KAFL_MOCK_HYPERCALL)
+#include "kafl_user_mock.h"
+#elif defined(__i386__)
 static void kAFL_hypercall(uint32_t rbx, uint32_t rcx){
 	printf("%s %x %x \n", __func__, rbx, rcx);
 # ifndef __NOKAFL
@@ -0,0 +1,166 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Host mock of the kAFL hypercall interface (build with -DKAFL_MOCK_HYPERCALL).
+ *
+ * Lets guest agents run on plain Linux without KVM-PT, e.g. to test and
+ * benchmark the agent loop. Payloads are taken from $KAFL_MOCK_INPUT (or a
+ * built-in default) with one byte flipped per exec. After $KAFL_MOCK_EXECS
+ * execs (default 10000), a summary is printed to stderr and the agent exits.
+ * Set $KAFL_MOCK_VERBOSE to see hprintf() output.
+ *
+ * State is kept in a shared mapping, so it survives fork() in the agent.
+ *
+ * Copyright 2020 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#ifndef KAFL_USER_MOCK_H
+#define KAFL_USER_MOCK_H
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+typedef struct {
+	uint64_t execs;
+	uint64_t crashes;
+	uint64_t kasan;
+	uint64_t timeouts;
+	uint64_t limit;
+	uint64_t start_ns;
+	uint64_t rng;
+	pid_t root;
+	int done;
+} kafl_mock_state_t;
+
+static kafl_mock_state_t* kafl_mock_state = NULL;
+static void* kafl_mock_payload = NULL;
+static uint8_t* kafl_mock_input = NULL;
+static size_t kafl_mock_input_size = 0;
+static int kafl_mock_log = -1;
+static int kafl_mock_verbose = 0;
+
+static uint64_t kafl_mock_now(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+/* the agent redirects stderr to /dev/null, keep a copy for reporting */
+__attribute__((constructor)) static void kafl_mock_setup(void){
+	kafl_mock_log = dup(STDERR_FILENO);
+	kafl_mock_verbose = getenv("KAFL_MOCK_VERBOSE") != NULL;
+}
+
+static void kafl_mock_init(void){
+	const char* input = getenv("KAFL_MOCK_INPUT");
+	const char* execs = getenv("KAFL_MOCK_EXECS");
+	FILE* f;
+
+	kafl_mock_state = mmap(NULL, sizeof(kafl_mock_state_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+	memset(kafl_mock_state, 0, sizeof(kafl_mock_state_t));
+	kafl_mock_state->limit = execs ? strtoull(execs, NULL, 0) : 10000;
+	kafl_mock_state->root = getpid();
+	kafl_mock_state->rng = 0x2545f4914f6cdd1dULL;
+
+	if (input && (f = fopen(input, "rb"))){
+		kafl_mock_input = malloc(PAYLOAD_SIZE);
+		kafl_mock_input_size = fread(kafl_mock_input, 1, PAYLOAD_SIZE - sizeof(int32_t) - sizeof(uint8_t), f);
+		fclose(f);
+	}
+	else {
+		kafl_mock_input = (uint8_t*)strdup("kAFL mock payload\n");
+		kafl_mock_input_size = strlen((char*)kafl_mock_input);
+	}
+	kafl_mock_state->start_ns = kafl_mock_now();
+}
+
+static void kafl_mock_finish(void){
+	double secs = (kafl_mock_now() - kafl_mock_state->start_ns) / 1e9;
+
+	if (__sync_bool_compare_and_swap(&kafl_mock_state->done, 0, 1)){
+		dprintf(kafl_mock_log, "kAFL mock: %lu execs in %.2fs (%.0f execs/s), %lu crashes, %lu kasan, %lu timeouts\n",
+				(unsigned long)kafl_mock_state->execs, secs, kafl_mock_state->execs / secs,
+				(unsigned long)kafl_mock_state->crashes, (unsigned long)kafl_mock_state->kasan,
+				(unsigned long)kafl_mock_state->timeouts);
+	}
+	_exit(0);
+}
+
+static void kafl_mock_next_payload(void){
+	kAFL_payload* payload = kafl_mock_payload;
+	uint64_t x;
+
+	if (!payload){
+		return;
+	}
+	memcpy(payload->data, kafl_mock_input, kafl_mock_input_size);
+	payload->size = kafl_mock_input_size;
+	payload->redqueen_mode = 0;
+
+	/* xorshift64 - flip one byte so that inputs differ */
+	x = __sync_fetch_and_add(&kafl_mock_state->rng, 0x9e3779b97f4a7c15ULL);
+	x ^= x << 13;
+	x ^= x >> 7;
+	x ^= x << 17;
+	if (kafl_mock_input_size){
+		payload->data[x % kafl_mock_input_size] ^= (uint8_t)(x >> 32) | 1;
+	}
+}
+
+static void kAFL_hypercall(uint64_t rbx, uint64_t rcx){
+	if (!kafl_mock_state){
+		kafl_mock_init();
+	}
+	/* a child finished the run, the agent's next call stops the parent too */
+	if (kafl_mock_state->done && getpid() == kafl_mock_state->root){
+		_exit(0);
+	}
+
+	switch (rbx){
+		case HYPERCALL_KAFL_GET_PAYLOAD:
+			kafl_mock_payload = (void*)(uintptr_t)rcx;
+			break;
+		case HYPERCALL_KAFL_USER_RANGE_ADVISE:
+			/* no trace ranges to lock in memory */
+			memset((void*)(uintptr_t)rcx, 0, sizeof(kAFL_ranges));
+			break;
+		case HYPERCALL_KAFL_ACQUIRE:
+		case HYPERCALL_KAFL_USER_FAST_ACQUIRE:
+		case HYPERCALL_KAFL_NEXT_PAYLOAD:
+			if (kafl_mock_state->execs >= kafl_mock_state->limit){
+				kafl_mock_finish();
+			}
+			kafl_mock_next_payload();
+			break;
+		case HYPERCALL_KAFL_RELEASE:
+			__sync_fetch_and_add(&kafl_mock_state->execs, 1);
+			break;
+		case HYPERCALL_KAFL_PANIC:
+			__sync_fetch_and_add(&kafl_mock_state->crashes, 1);
+			break;
+		case HYPERCALL_KAFL_KASAN:
+			__sync_fetch_and_add(&kafl_mock_state->kasan, 1);
+			break;
+		case HYPERCALL_KAFL_TIMEOUT:
+			__sync_fetch_and_add(&kafl_mock_state->timeouts, 1);
+			break;
+		case HYPERCALL_KAFL_PRINTF:
+			if (kafl_mock_verbose){
+				dprintf(kafl_mock_log, "%s", (char*)(uintptr_t)rcx);
+			}
+			break;
+		case HYPERCALL_KAFL_USER_ABORT:
+			dprintf(kafl_mock_log, "kAFL mock: agent aborted\n");
+			kafl_mock_finish();
+			break;
+		default:
+			break;
+	}
+}
+
+#endif
@@ -0,0 +1,55 @@
+#
+# This file is part of Redqueen.
+#
+# Host benchmark of the userspace agent against the mock hypercall backend.
+# Compares exec rates for stdin, file and memfd payload delivery, in fork
+# and persistent mode.
+#
+# Usage: bench_mock.sh [execs] [persistent iterations]
+#
+# Copyright 2020 Intel Corporation
+#
+# SPDX-License-Identifier: MIT
+#
+set -e
+
+SCRIPT_ROOT="$(dirname ${PWD}/${0})"
+EXECS=${1:-20000}
+PERSISTENT=${2:-1000}
+WORKDIR=$(mktemp -d)
+trap "rm -rf $WORKDIR" EXIT
+
+pushd $SCRIPT_ROOT > /dev/null
+
+gcc -shared -O2 -m64 -Werror -fPIC -DKAFL_MOCK_HYPERCALL -DAGENT_TIMEOUT_USEC=100000 src/ld_preload_fuzz.c src/mock_argv.c -o $WORKDIR/agent.so -ldl
+
+# reads its input from stdin or from the file given as argument
+cat > $WORKDIR/target.c << TARGET
+#include <stdio.h>
+int main(int argc, char** argv){
+	char buf[4096];
+	FILE* f = argc > 1 ? fopen(argv[1], "rb") : stdin;
+	size_t n;
+	if (!f)
+		return 1;
+	n = fread(buf, 1, sizeof(buf), f);
+	if (f != stdin)
+		fclose(f);
+	return n > 2 && buf[0] == 'X' && buf[1] == 'Y';
+}
+TARGET
+gcc -O2 $WORKDIR/target.c -o $WORKDIR/target
+
+popd > /dev/null
+
+bench() {
+	printf "%-10s %-11s " "$1" "$2"
+	env KAFL_MOCK_EXECS=$EXECS KAFL_MOCK_PERSISTENT=$3 $4 LD_PRELOAD=$WORKDIR/agent.so $WORKDIR/target $5
+}
+
+for persistent in 0 $PERSISTENT; do
+	[ $persistent -eq 0 ] && mode=fork || mode=persistent
+	bench stdin $mode $persistent
+	bench file $mode $persistent "KAFL_MOCK_FILE=$WORKDIR/input" $WORKDIR/input
+	bench memfd $mode $persistent "KAFL_MOCK_FILE=$WORKDIR/input KAFL_MOCK_MEMFD=1" $WORKDIR/input
+done
@@ -31,6 +31,10 @@ gcc -c -static -shared -O0 -m64 -Werror -fPIC src/ld_preload_fuzz.c -o bin/ld_pr
 gcc -c -static -shared -O0 -m32 -Werror -fPIC -DASAN_BUILD src/ld_preload_fuzz.c -o bin/ld_preload_fuzz_32_asan.o -ldl
 gcc -c -static -shared -O0 -m64 -Werror -fPIC -DASAN_BUILD src/ld_preload_fuzz.c -o bin/ld_preload_fuzz_64_asan.o -ldl
 
+# host build against the mock hypercall backend, for testing and benchmarking without KVM-PT:
+#   KAFL_MOCK_PERSISTENT=1000 LD_PRELOAD=bin/ld_preload_fuzz_mock.so ./target
+gcc -shared -O2 -m64 -Werror -fPIC -DKAFL_MOCK_HYPERCALL -DAGENT_TIMEOUT_USEC=100000 src/ld_preload_fuzz.c src/mock_argv.c -o bin/ld_preload_fuzz_mock.so -ldl
+
 gcc -c -static -O0 -m32 -Werror src/userspace_loader.c -o bin/userspace_loader_32.o
 gcc -c -static -O0 -m64 -Werror src/userspace_loader.c -o bin/userspace_loader_64.o
 
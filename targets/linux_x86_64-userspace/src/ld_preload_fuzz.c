@@ -22,11 +22,23 @@
 #include <inttypes.h>
 #include <sys/syscall.h>
 #include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/time.h>
+#include <stdio_ext.h>
+#include <getopt.h>
+#include <stdarg.h>
+#include <stdio.h>
 
 #include "../../kafl_user.h"
 
 #define ASAN_EXIT_CODE 101
+/* persistent child has released all of its inputs */
+#define PERSISTENT_EXIT_CODE 102
+
+/* per-exec CPU time limit outside of redqueen mode */
+#ifndef AGENT_TIMEOUT_USEC
+#define AGENT_TIMEOUT_USEC 5
+#endif
 //#define REDIRECT_STDERR_TO_HPRINTF
 //#define REDIRECT_STDOUT_TO_HPRINTF
 
@@ -35,8 +47,503 @@ extern char* output_filename;
 
 extern uint32_t memlimit;
 
+/*
+ * Persistent mode: run this many inputs in each forked child before forking
+ * a new one (0 = one child per input). The target entry is
+ * LLVMFuzzerTestOneInput() if the target exports it, main() otherwise.
+ * LLVMFuzzerInitialize() is run once before the first fork (deferred init).
+ * Target state is not reset between inputs of one child.
+ */
+uint32_t persistent_iterations __attribute__((weak)) = 0;
+
+/*
+ * Memory-backed file mode: keep the payload in a memfd instead of writing
+ * output_filename for every exec. open()/fopen() and stat()/access() of
+ * output_filename by the target are served from the memfd, so read(), fstat()
+ * and mmap() work on the payload without going through the guest's
+ * filesystem. The path must match output_filename exactly.
+ */
+uint8_t memfd_mode __attribute__((weak)) = 0;
+
+typedef int (*target_main_t)(int, char**, char**);
+typedef int (*test_one_input_t)(const uint8_t*, size_t);
+typedef int (*initialize_t)(int*, char***);
+
+static kAFL_payload* payload_buffer;
+static kAFL_ranges* range_buffer;
+static struct rlimit r;
+static target_main_t target_main;
+static test_one_input_t test_one_input;
+static int payload_fd = -1;
+
 int _mlock(void* dst, size_t size) {
-    syscall(SYS_mlock, dst, size);
+    return syscall(SYS_mlock, dst, size);
+}
+
+static void lock_ranges(void){
+    int i;
+
+    for(i = 0; i < 4; i++){
+        if(range_buffer->enabled[i]){
+            if(_mlock((void*)(intptr_t)(range_buffer->ip[i]), (size_t)(range_buffer->size[i]))){
+                hprintf("_mlock(%l"PRIx64", %l"PRIx64") failed!\n", (void*)(intptr_t)(range_buffer->ip[i]), (size_t)(range_buffer->size[i]));
+                kAFL_hypercall(HYPERCALL_KAFL_USER_ABORT, 0);
+            }
+        }
+    }
+    if(_mlock((void*)payload_buffer, (size_t)PAYLOAD_SIZE)){
+        hprintf("_mlock(%l"PRIx64", %l"PRIx64") failed!\n", (void*)payload_buffer, (size_t)PAYLOAD_SIZE);
+        kAFL_hypercall(HYPERCALL_KAFL_USER_ABORT, 0);
+    }
+}
+
+static void set_timer(uint8_t redqueen_mode, uint8_t enable){
+    struct itimerval timer;
+
+    if (!enable){
+        timer.it_value.tv_sec = 0;
+        timer.it_value.tv_usec = 0;
+    }
+    else if (redqueen_mode){
+        timer.it_value.tv_sec = 10;
+        timer.it_value.tv_usec = 0;
+    }
+    else {
+        timer.it_value.tv_sec = AGENT_TIMEOUT_USEC / 1000000;
+        timer.it_value.tv_usec = AGENT_TIMEOUT_USEC % 1000000;
+    }
+    timer.it_interval.tv_sec  = 0;
+    timer.it_interval.tv_usec = 0;
+    setitimer (ITIMER_VIRTUAL, &timer, NULL);
+}
+
+/* hand the current payload to the target via stdin or output_filename */
+static void deliver_payload(void){
+    struct iovec iov;
+    int pipefd[2];
+    int fd;
+
+    if (stdin_mode){
+        if (pipe(pipefd)){
+            kAFL_hypercall(HYPERCALL_KAFL_USER_ABORT, 0);
+        }
+        iov.iov_base = payload_buffer->data;
+        iov.iov_len = payload_buffer->size;
+
+        vmsplice(pipefd[1], &iov, 1, SPLICE_F_GIFT);
+        dup2(pipefd[0], STDIN_FILENO);
+        close(pipefd[0]);
+        close(pipefd[1]);
+    }
+    else if (payload_fd >= 0){
+        /* exact size, so that fstat() and mmap() of the file see the payload only */
+        ftruncate(payload_fd, payload_buffer->size);
+        pwrite(payload_fd, payload_buffer->data, payload_buffer->size, 0);
+    }
+    else{
+        fd = open(output_filename, O_RDWR | O_CREAT | O_TRUNC, 0644);
+        write(fd, payload_buffer->data, payload_buffer->size);
+        close(fd);
+    }
+}
+
+static int is_payload_path(const char* pathname){
+    return payload_fd >= 0 && pathname && !strcmp(pathname, output_filename);
+}
+
+/* new file description of the payload memfd, with its own offset */
+static int open_payload(int flags){
+    char path[32];
+    int fd;
+
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", payload_fd);
+    fd = syscall(SYS_openat, AT_FDCWD, path, flags & ~(O_CREAT | O_TRUNC | O_EXCL));
+    if (fd < 0){
+        /* no /proc in the guest, a dup() would share the offset with other opens - hand out a copy */
+        fd = syscall(SYS_memfd_create, "kafl_payload", 0);
+        if (fd >= 0){
+            pwrite(fd, payload_buffer->data, payload_buffer->size, 0);
+        }
+    }
+    return fd;
+}
+
+static mode_t open_mode(int flags, va_list args){
+    return ((flags & O_CREAT) || (flags & O_TMPFILE) == O_TMPFILE) ? va_arg(args, mode_t) : 0;
+}
+
+static int fopen_flags(const char* mode){
+    int flags;
+
+    switch (mode[0]){
+        case 'w':
+            flags = O_WRONLY | O_TRUNC;
+            break;
+        case 'a':
+            flags = O_WRONLY | O_APPEND;
+            break;
+        default:
+            flags = O_RDONLY;
+            break;
+    }
+    if (strchr(mode, '+')){
+        flags = (flags & ~O_WRONLY) | O_RDWR;
+    }
+    return flags;
+}
+
+static int access_payload(int mode){
+    if (mode & X_OK){
+        errno = EACCES;
+        return -1;
+    }
+    return 0;
+}
+
+int open(const char* pathname, int flags, ...){
+    static int (*original_open)(const char*, int, ...) = NULL;
+    va_list args;
+    mode_t mode;
+
+    va_start(args, flags);
+    mode = open_mode(flags, args);
+    va_end(args);
+
+    if (is_payload_path(pathname)){
+        return open_payload(flags);
+    }
+    if (!original_open){
+        original_open = dlsym(RTLD_NEXT, "open");
+    }
+    return original_open(pathname, flags, mode);
+}
+
+int open64(const char* pathname, int flags, ...){
+    static int (*original_open64)(const char*, int, ...) = NULL;
+    va_list args;
+    mode_t mode;
+
+    va_start(args, flags);
+    mode = open_mode(flags, args);
+    va_end(args);
+
+    if (is_payload_path(pathname)){
+        return open_payload(flags);
+    }
+    if (!original_open64){
+        original_open64 = dlsym(RTLD_NEXT, "open64");
+    }
+    return original_open64(pathname, flags, mode);
+}
+
+int openat(int dirfd, const char* pathname, int flags, ...){
+    static int (*original_openat)(int, const char*, int, ...) = NULL;
+    va_list args;
+    mode_t mode;
+
+    va_start(args, flags);
+    mode = open_mode(flags, args);
+    va_end(args);
+
+    if (is_payload_path(pathname)){
+        return open_payload(flags);
+    }
+    if (!original_openat){
+        original_openat = dlsym(RTLD_NEXT, "openat");
+    }
+    return original_openat(dirfd, pathname, flags, mode);
+}
+
+int openat64(int dirfd, const char* pathname, int flags, ...){
+    static int (*original_openat64)(int, const char*, int, ...) = NULL;
+    va_list args;
+    mode_t mode;
+
+    va_start(args, flags);
+    mode = open_mode(flags, args);
+    va_end(args);
+
+    if (is_payload_path(pathname)){
+        return open_payload(flags);
+    }
+    if (!original_openat64){
+        original_openat64 = dlsym(RTLD_NEXT, "openat64");
+    }
+    return original_openat64(dirfd, pathname, flags, mode);
+}
+
+/* libc opens files for stdio internally, bypassing open() */
+FILE* fopen(const char* pathname, const char* mode){
+    static FILE* (*original_fopen)(const char*, const char*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fdopen(open_payload(fopen_flags(mode)), mode);
+    }
+    if (!original_fopen){
+        original_fopen = dlsym(RTLD_NEXT, "fopen");
+    }
+    return original_fopen(pathname, mode);
+}
+
+FILE* fopen64(const char* pathname, const char* mode){
+    static FILE* (*original_fopen64)(const char*, const char*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fdopen(open_payload(fopen_flags(mode)), mode);
+    }
+    if (!original_fopen64){
+        original_fopen64 = dlsym(RTLD_NEXT, "fopen64");
+    }
+    return original_fopen64(pathname, mode);
+}
+
+/* size checks of the target need to see the payload, not output_filename */
+int stat(const char* pathname, struct stat* buf){
+    static int (*original_stat)(const char*, struct stat*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat(payload_fd, buf);
+    }
+    if (!original_stat){
+        original_stat = dlsym(RTLD_NEXT, "stat");
+    }
+    return original_stat(pathname, buf);
+}
+
+int stat64(const char* pathname, struct stat64* buf){
+    static int (*original_stat64)(const char*, struct stat64*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat64(payload_fd, buf);
+    }
+    if (!original_stat64){
+        original_stat64 = dlsym(RTLD_NEXT, "stat64");
+    }
+    return original_stat64(pathname, buf);
+}
+
+int lstat(const char* pathname, struct stat* buf){
+    static int (*original_lstat)(const char*, struct stat*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat(payload_fd, buf);
+    }
+    if (!original_lstat){
+        original_lstat = dlsym(RTLD_NEXT, "lstat");
+    }
+    return original_lstat(pathname, buf);
+}
+
+int lstat64(const char* pathname, struct stat64* buf){
+    static int (*original_lstat64)(const char*, struct stat64*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat64(payload_fd, buf);
+    }
+    if (!original_lstat64){
+        original_lstat64 = dlsym(RTLD_NEXT, "lstat64");
+    }
+    return original_lstat64(pathname, buf);
+}
+
+int fstatat(int dirfd, const char* pathname, struct stat* buf, int flags){
+    static int (*original_fstatat)(int, const char*, struct stat*, int) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat(payload_fd, buf);
+    }
+    if (!original_fstatat){
+        original_fstatat = dlsym(RTLD_NEXT, "fstatat");
+    }
+    return original_fstatat(dirfd, pathname, buf, flags);
+}
+
+int fstatat64(int dirfd, const char* pathname, struct stat64* buf, int flags){
+    static int (*original_fstatat64)(int, const char*, struct stat64*, int) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat64(payload_fd, buf);
+    }
+    if (!original_fstatat64){
+        original_fstatat64 = dlsym(RTLD_NEXT, "fstatat64");
+    }
+    return original_fstatat64(dirfd, pathname, buf, flags);
+}
+
+/* before glibc 2.33, the stat family is inlined into calls of these */
+int __xstat(int ver, const char* pathname, struct stat* buf){
+    static int (*original_xstat)(int, const char*, struct stat*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat(payload_fd, buf);
+    }
+    if (!original_xstat){
+        original_xstat = dlsym(RTLD_NEXT, "__xstat");
+    }
+    return original_xstat(ver, pathname, buf);
+}
+
+int __xstat64(int ver, const char* pathname, struct stat64* buf){
+    static int (*original_xstat64)(int, const char*, struct stat64*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat64(payload_fd, buf);
+    }
+    if (!original_xstat64){
+        original_xstat64 = dlsym(RTLD_NEXT, "__xstat64");
+    }
+    return original_xstat64(ver, pathname, buf);
+}
+
+int __lxstat(int ver, const char* pathname, struct stat* buf){
+    static int (*original_lxstat)(int, const char*, struct stat*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat(payload_fd, buf);
+    }
+    if (!original_lxstat){
+        original_lxstat = dlsym(RTLD_NEXT, "__lxstat");
+    }
+    return original_lxstat(ver, pathname, buf);
+}
+
+int __lxstat64(int ver, const char* pathname, struct stat64* buf){
+    static int (*original_lxstat64)(int, const char*, struct stat64*) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat64(payload_fd, buf);
+    }
+    if (!original_lxstat64){
+        original_lxstat64 = dlsym(RTLD_NEXT, "__lxstat64");
+    }
+    return original_lxstat64(ver, pathname, buf);
+}
+
+int __fxstatat(int ver, int dirfd, const char* pathname, struct stat* buf, int flags){
+    static int (*original_fxstatat)(int, int, const char*, struct stat*, int) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat(payload_fd, buf);
+    }
+    if (!original_fxstatat){
+        original_fxstatat = dlsym(RTLD_NEXT, "__fxstatat");
+    }
+    return original_fxstatat(ver, dirfd, pathname, buf, flags);
+}
+
+int __fxstatat64(int ver, int dirfd, const char* pathname, struct stat64* buf, int flags){
+    static int (*original_fxstatat64)(int, int, const char*, struct stat64*, int) = NULL;
+
+    if (is_payload_path(pathname)){
+        return fstat64(payload_fd, buf);
+    }
+    if (!original_fxstatat64){
+        original_fxstatat64 = dlsym(RTLD_NEXT, "__fxstatat64");
+    }
+    return original_fxstatat64(ver, dirfd, pathname, buf, flags);
+}
+
+int access(const char* pathname, int mode){
+    static int (*original_access)(const char*, int) = NULL;
+
+    if (is_payload_path(pathname)){
+        return access_payload(mode);
+    }
+    if (!original_access){
+        original_access = dlsym(RTLD_NEXT, "access");
+    }
+    return original_access(pathname, mode);
+}
+
+int faccessat(int dirfd, const char* pathname, int mode, int flags){
+    static int (*original_faccessat)(int, const char*, int, int) = NULL;
+
+    if (is_payload_path(pathname)){
+        return access_payload(mode);
+    }
+    if (!original_faccessat){
+        original_faccessat = dlsym(RTLD_NEXT, "faccessat");
+    }
+    return original_faccessat(dirfd, pathname, mode, flags);
+}
+
+/* report how a child ended, returns 0 if it already released its inputs */
+static int report_status(int status){
+    if(WIFSIGNALED(status)){
+        if(WTERMSIG(status)==SIGVTALRM){
+            hprintf("TIMEOUT found\n");
+            kAFL_hypercall(HYPERCALL_KAFL_TIMEOUT, 1);
+        }else{
+            kAFL_hypercall(HYPERCALL_KAFL_PANIC, 1);
+        }
+    } else if (WEXITSTATUS(status) == ASAN_EXIT_CODE) {
+        kAFL_hypercall(HYPERCALL_KAFL_KASAN, 1);
+    } else if (persistent_iterations && WEXITSTATUS(status) == PERSISTENT_EXIT_CODE) {
+        return 0;
+    }
+    return 1;
+}
+
+static void persistent_child(int argc, char** argv, char** envp){
+    uint32_t i;
+
+    lock_ranges();
+#ifndef ASAN_BUILD
+    setrlimit(RLIMIT_AS, &r);
+#endif
+
+    for(i = 0; i < persistent_iterations; i++){
+        kAFL_hypercall(HYPERCALL_KAFL_USER_FAST_ACQUIRE, 0);
+        set_timer(payload_buffer->redqueen_mode, 1);
+
+        if (test_one_input){
+            test_one_input(payload_buffer->data, payload_buffer->size);
+        }
+        else {
+            deliver_payload();
+            /* drop what main() left buffered from the previous input */
+            __fpurge(stdin);
+            clearerr(stdin);
+            optind = 1;
+            target_main(argc, argv, envp);
+        }
+
+        set_timer(0, 0);
+        kAFL_hypercall(HYPERCALL_KAFL_RELEASE, 0);
+    }
+    _exit(PERSISTENT_EXIT_CODE);
+}
+
+/* runs after libc init of the target, so that forked children skip it */
+__attribute__((noreturn)) static int persistent_main(int argc, char** argv, char** envp){
+    initialize_t initialize = (initialize_t)dlsym(RTLD_DEFAULT, "LLVMFuzzerInitialize");
+    int status = 0;
+    int pid;
+
+    test_one_input = (test_one_input_t)dlsym(RTLD_DEFAULT, "LLVMFuzzerTestOneInput");
+    hprintf("Persistent mode: %u iterations per child, entry %s\n", persistent_iterations,
+            test_one_input ? "LLVMFuzzerTestOneInput" : "main");
+
+    if (initialize){
+        initialize(&argc, &argv);
+    }
+
+    while(1){
+        pid = fork();
+
+        if(!pid){
+            persistent_child(argc, argv, envp);
+        }
+        else if(pid > 0){
+            waitpid(pid, &status, WUNTRACED);
+            if (report_status(status)){
+                kAFL_hypercall(HYPERCALL_KAFL_RELEASE, 0);
+            }
+        }
+        else{
+            hprintf("FORK FAILED ?!\n");
+        }
+    }
 }
 
 long int random(void){
@@ -65,24 +572,21 @@ int __libc_start_main(int (*main) (int,char **,char **),
     char buf[HPRINTF_MAX_SIZE];
     #endif
 
-    struct rlimit r;
-    int fd, fd2 = 0;
-    int pipefd[2];
-    int ret = pipe(pipefd);
-
     #ifdef REDIRECT_STDERR_TO_HPRINTF
     int pipe_stderr_hprintf[2];
-    ret = pipe(pipe_stderr_hprintf);
+    if (pipe(pipe_stderr_hprintf)){
+        kAFL_hypercall(HYPERCALL_KAFL_USER_ABORT, 0);
+    }
     #endif
     #ifdef REDIRECT_STDOUT_TO_HPRINTF
     int pipe_stdout_hprintf[2];
-    ret = pipe(pipe_stdout_hprintf);
+    if (pipe(pipe_stdout_hprintf)){
+        kAFL_hypercall(HYPERCALL_KAFL_USER_ABORT, 0);
+    }
     #endif
 
-    struct iovec iov;
     int pid;
     int status=0;
-    int res = 0;
     int i;
 
     r.rlim_max = (rlim_t)(memlimit << 20);
@@ -97,12 +601,12 @@ int __libc_start_main(int (*main) (int,char **,char **),
         dup2(open("/dev/null", O_RDONLY), STDIN_FILENO);
     }
                 
-    kAFL_payload* payload_buffer = mmap((void*)NULL, PAYLOAD_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    payload_buffer = mmap((void*)NULL, PAYLOAD_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
     memset(payload_buffer, 0x00, PAYLOAD_SIZE);
     _mlock((void*)payload_buffer, (size_t)PAYLOAD_SIZE);
     kAFL_hypercall(HYPERCALL_KAFL_GET_PAYLOAD, (uintptr_t)payload_buffer);
 
-    kAFL_ranges* range_buffer = mmap((void*)NULL, 0x1000, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    range_buffer = mmap((void*)NULL, 0x1000, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
     memset(range_buffer, 0xff, 0x1000);
     kAFL_hypercall(HYPERCALL_KAFL_USER_RANGE_ADVISE, (uintptr_t)range_buffer);
  
@@ -116,44 +620,27 @@ int __libc_start_main(int (*main) (int,char **,char **),
     kAFL_hypercall(HYPERCALL_KAFL_USER_SUBMIT_MODE, KAFL_MODE_64);
 #endif
 
+    if (!stdin_mode && memfd_mode){
+        payload_fd = syscall(SYS_memfd_create, "kafl_payload", 0);
+        if (payload_fd < 0){
+            hprintf("memfd_create failed, writing payloads to %s\n", output_filename);
+        }
+    }
+
+    if (persistent_iterations){
+        target_main = main;
+        return original__libc_start_main(persistent_main,argc,ubp_av, init,fini,rtld_fini,stack_end);
+    }
+
     while(1){
         pid = fork();
 
         if(!pid){
-            for(i = 0; i < 4; i++){
-                if(range_buffer->enabled[i]){
-                    if(_mlock((void*)(intptr_t)(range_buffer->ip[i]), (size_t)(range_buffer->size[i]))){
-                        hprintf("_mlock(%l"PRIx64", %l"PRIx64") failed!\n", (void*)(intptr_t)(range_buffer->ip[i]), (size_t)(range_buffer->size[i]));
-                        kAFL_hypercall(HYPERCALL_KAFL_USER_ABORT, 0);
-                    }
-                }
-            }
-            if(_mlock((void*)payload_buffer, (size_t)PAYLOAD_SIZE)){
-                hprintf("_mlock(%l"PRIx64", %l"PRIx64") failed!\n", (void*)payload_buffer, (size_t)PAYLOAD_SIZE);
-                kAFL_hypercall(HYPERCALL_KAFL_USER_ABORT, 0);
-            }
-
-            if(stdin_mode){
-                pipe(pipefd);
-            }
-            else{
-                fd = open(output_filename, O_RDWR | O_CREAT | O_TRUNC);
-            }
+            lock_ranges();
 
             kAFL_hypercall(HYPERCALL_KAFL_USER_FAST_ACQUIRE, 0);
 
-            if (stdin_mode){
-                iov.iov_base = payload_buffer->data;
-                iov.iov_len = payload_buffer->size;
-
-                ret = vmsplice(pipefd[1], &iov, 1, SPLICE_F_GIFT);
-                dup2(pipefd[0],STDIN_FILENO);
-                close(pipefd[1]);  
-            }
-            else{
-                write(fd, payload_buffer->data, payload_buffer->size);
-                close(fd);
-            }
+            deliver_payload();
 
             #ifdef REDIRECT_STDERR_TO_HPRINTF
             dup2(pipe_stderr_hprintf[1], STDERR_FILENO);
@@ -168,18 +655,7 @@ int __libc_start_main(int (*main) (int,char **,char **),
             /* disable setrlimtit in case of ASAN builds... */
             setrlimit(RLIMIT_AS, &r);
 #endif
-            struct itimerval timer;
-            if (payload_buffer->redqueen_mode){
-                timer.it_value.tv_sec = 10;
-                timer.it_value.tv_usec = 0;
-            }
-            else {
-                timer.it_value.tv_sec = 0;
-                timer.it_value.tv_usec = 5;
-            }
-            timer.it_interval.tv_sec  = 0;
-            timer.it_interval.tv_usec = 0;
-            setitimer (ITIMER_VIRTUAL, &timer, NULL);
+            set_timer(payload_buffer->redqueen_mode, 1);
 
             return original__libc_start_main(main,argc,ubp_av, init,fini,rtld_fini,stack_end);
 
@@ -210,16 +686,7 @@ int __libc_start_main(int (*main) (int,char **,char **),
             #endif 
 
 
-            if(WIFSIGNALED(status)){
-                                if(WTERMSIG(status)==SIGVTALRM){
-                                    hprintf("TIMEOUT found\n");
-                                    kAFL_hypercall(HYPERCALL_KAFL_TIMEOUT, 1);
-                                }else{
-                                    kAFL_hypercall(HYPERCALL_KAFL_PANIC, 1);
-                                }
-            } else if (WEXITSTATUS(status) == ASAN_EXIT_CODE) {
-                kAFL_hypercall(HYPERCALL_KAFL_KASAN, 1);
-            }
+            report_status(status);
             kAFL_hypercall(HYPERCALL_KAFL_RELEASE, 0);
         }
         else{
@@ -0,0 +1,44 @@
+/*
+ * This file is part of Redqueen.
+ *
+ * Agent configuration for host builds against the mock hypercall backend.
+ * Stands in for the argv.c generated by kafl_user_prepare.py, with values
+ * taken from the environment:
+ *
+ *   KAFL_MOCK_FILE        pass inputs via this file instead of stdin
+ *   KAFL_MOCK_MEMFD       serve KAFL_MOCK_FILE from memory (memfd_mode)
+ *   KAFL_MOCK_PERSISTENT  persistent mode iterations per child (default 0)
+ *   KAFL_MOCK_MEMLIMIT    memory limit in MB (default 4096)
+ *
+ * Copyright 2020 Intel Corporation
+ *
+ * SPDX-License-Identifier: MIT
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+
+uint8_t stdin_mode = 1;
+char* output_filename = "";
+uint32_t memlimit = 4096;
+uint32_t persistent_iterations = 0;
+uint8_t memfd_mode = 0;
+
+/* runs before the __libc_start_main() hook reads any of these */
+__attribute__((constructor)) static void mock_argv_setup(void){
+	char* value;
+
+	if ((value = getenv("KAFL_MOCK_FILE"))){
+		stdin_mode = 0;
+		output_filename = value;
+	}
+	if (getenv("KAFL_MOCK_MEMFD")){
+		memfd_mode = 1;
+	}
+	if ((value = getenv("KAFL_MOCK_PERSISTENT"))){
+		persistent_iterations = strtoul(value, NULL, 0);
+	}
+	if ((value = getenv("KAFL_MOCK_MEMLIMIT"))){
+		memlimit = strtoul(value, NULL, 0);
+	}
+}
@@ -0,0 +1,110 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020 Intel Corporation
+#
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Measure the per-exec cost of handing payload and bitmap between frontend and Qemu.
+
+Compares the former /dev/shm files opened with O_SYNC and flushed with
+msync(MS_SYNC) on every exec against memfd-backed shared memory published
+with a generation counter.
+"""
+
+import argparse
+import mmap
+import os
+import random
+import struct
+import time
+
+BITMAP_SIZE = 0x10000
+BITMAP_TRAILER_SIZE = 0x1000
+PAYLOAD_SIZE = (128 << 10)
+
+
+def map_file(fd, size):
+    os.ftruncate(fd, size)
+    return mmap.mmap(fd, size, mmap.MAP_SHARED, mmap.PROT_WRITE | mmap.PROT_READ)
+
+
+def simulate_exec(payload_mm, bitmap_mm, payload, edges):
+    payload_mm.seek(0)
+    payload_mm.write(struct.pack(">I", len(payload)))
+    payload_mm.write(payload)
+    for offset in edges:
+        bitmap_mm[offset] = (bitmap_mm[offset] + 1) & 0xff
+
+
+def bench_msync(execs, payloads, edges):
+    name = "/dev/shm/kafl_bench_%d_" % os.getpid()
+    bitmap_f = os.open(name + "bitmap", os.O_RDWR | os.O_SYNC | os.O_CREAT)
+    payload_f = os.open(name + "payload", os.O_RDWR | os.O_SYNC | os.O_CREAT)
+    try:
+        bitmap_mm = map_file(bitmap_f, BITMAP_SIZE)
+        payload_mm = map_file(payload_f, PAYLOAD_SIZE)
+
+        start = time.perf_counter()
+        for i in range(execs):
+            simulate_exec(payload_mm, bitmap_mm, payloads[i % len(payloads)], edges[i % len(edges)])
+            payload_mm.flush()      # set_payload()
+            bitmap_mm.flush()       # pt_sync()
+        return time.perf_counter() - start
+    finally:
+        os.close(bitmap_f)
+        os.close(payload_f)
+        os.remove(name + "bitmap")
+        os.remove(name + "payload")
+
+
+def bench_baseline(execs, payloads, edges):
+    bitmap_mm = mmap.mmap(-1, BITMAP_SIZE)
+    payload_mm = mmap.mmap(-1, PAYLOAD_SIZE)
+
+    start = time.perf_counter()
+    for i in range(execs):
+        simulate_exec(payload_mm, bitmap_mm, payloads[i % len(payloads)], edges[i % len(edges)])
+    return time.perf_counter() - start
+
+
+def bench_generation(execs, payloads, edges):
+    bitmap_f = os.memfd_create("kafl_bench_bitmap")
+    payload_f = os.memfd_create("kafl_bench_payload")
+    try:
+        bitmap_mm = map_file(bitmap_f, BITMAP_SIZE + BITMAP_TRAILER_SIZE)
+        payload_mm = map_file(payload_f, PAYLOAD_SIZE)
+
+        generation = 0
+        start = time.perf_counter()
+        for i in range(execs):
+            simulate_exec(payload_mm, bitmap_mm, payloads[i % len(payloads)], edges[i % len(edges)])
+            generation += 1
+            struct.pack_into("<Q", bitmap_mm, BITMAP_SIZE, generation)
+            assert struct.unpack_from("<Q", bitmap_mm, BITMAP_SIZE)[0] == generation
+        return time.perf_counter() - start
+    finally:
+        os.close(bitmap_f)
+        os.close(payload_f)
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Benchmark per-exec shared memory publication")
+    parser.add_argument("-n", "--execs", type=int, default=20000, help="simulated executions")
+    parser.add_argument("-s", "--payload-size", type=int, default=1024, help="payload size in bytes")
+    parser.add_argument("-e", "--edges", type=int, default=200, help="bitmap entries touched per exec")
+    args = parser.parse_args()
+
+    payloads = [os.urandom(args.payload_size) for _ in range(64)]
+    edges = [random.sample(range(BITMAP_SIZE), args.edges) for _ in range(64)]
+
+    # report the publication overhead on top of the payload/bitmap writes themselves
+    baseline = bench_baseline(args.execs, payloads, edges)
+    for name, bench in (("msync", bench_msync), ("generation", bench_generation)):
+        total = bench(args.execs, payloads, edges)
+        print("%-12s %8.2f us/exec (+%.2f us over plain writes)" %
+              (name, 1e6 * total / args.execs, 1e6 * (total - baseline) / args.execs))
+
+
+if __name__ == "__main__":
+    main()
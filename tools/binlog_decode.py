@@ -0,0 +1,119 @@
+#!/usr/bin/env python3
+#
+# Copyright 2020 Intel Corporation
+#
+# SPDX-License-Identifier: AGPL-3.0-or-later
+
+"""
+Decode binary Qemu-PT logs (qemu_binlog_<n>) written by qemu-5.0.0/pt/binlog.c
+"""
+
+import re
+import struct
+import sys
+
+BINLOG_MAGIC = 0x474c424b
+BINLOG_ID_FORMAT = 0
+BINLOG_ID_DROPPED = 1
+
+FILE_HEADER = struct.Struct("<IIQQQ")
+RECORD_HEADER = struct.Struct("<QHBBI")
+
+C_FORMAT = re.compile(r"%([-+ #0]*)(\d+)?(\.\d+)?(hh|h|ll|l|q|j|z|t)?([diouxXcsp%])")
+
+
+def to_signed(value, bits):
+    value &= (1 << bits) - 1
+    return value - (1 << bits) if value >> (bits - 1) else value
+
+
+def c_format(fmt, args):
+    args = iter(args)
+
+    def convert(match):
+        flags, width, precision, length, conv = match.groups()
+        if conv == '%':
+            return '%'
+        value = next(args, None)
+        if value is None:
+            return match.group(0)
+        spec = "%" + flags + (width or "") + (precision or "")
+        bits = 64 if length in ("l", "ll", "q", "j", "z", "t") else 32
+        if conv == 's':
+            return (spec + "s") % value
+        if conv == 'p':
+            return "0x%x" % value
+        if conv == 'c':
+            return chr(value & 0xff)
+        if conv in "di":
+            return (spec + "d") % to_signed(value, bits)
+        return (spec + conv) % (value & ((1 << bits) - 1))
+
+    return C_FORMAT.sub(convert, fmt)
+
+
+def records(data):
+    offset = FILE_HEADER.size
+    while offset + RECORD_HEADER.size <= len(data):
+        tsc, fmt_id, nargs, ring, size = RECORD_HEADER.unpack_from(data, offset)
+        if offset + size > len(data):
+            break
+        words = struct.unpack_from("<%dQ" % nargs, data, offset + RECORD_HEADER.size)
+        strings = offset + RECORD_HEADER.size + 8 * nargs
+        offset += size
+        yield tsc, fmt_id, ring, words, strings
+
+
+def decode(filename):
+    with open(filename, 'rb') as f:
+        data = f.read()
+
+    magic, version, tsc_hz, tsc_start, time_start = FILE_HEADER.unpack_from(data, 0)
+    if magic != BINLOG_MAGIC:
+        raise ValueError("%s: not a binlog file" % filename)
+
+    # the drain thread may write a format after the first records using it - collect
+    # all formats before decoding
+    formats = dict()
+    for tsc, fmt_id, ring, words, strings in records(data):
+        if fmt_id == BINLOG_ID_FORMAT:
+            formats[words[0]] = data[strings:strings + words[1]].decode(errors='replace')
+
+    for tsc, fmt_id, ring, words, strings in records(data):
+        if fmt_id == BINLOG_ID_FORMAT:
+            continue
+
+        timestamp = (tsc - tsc_start) / tsc_hz if tsc_hz else 0
+        if fmt_id == BINLOG_ID_DROPPED:
+            yield timestamp, ring, "[binlog] ring full, dropped %d records\n" % words[0]
+            continue
+
+        fmt = formats.get(fmt_id, "<unknown format %d>\n" % fmt_id)
+        args = list()
+        for (i, match) in enumerate(C_FORMAT.finditer(fmt.replace("%%", ""))):
+            if i >= len(words):
+                break
+            if match.group(5) == 's':
+                args.append(data[strings:strings + words[i]].decode(errors='replace'))
+                strings += words[i]
+            else:
+                args.append(words[i])
+        yield timestamp, ring, c_format(fmt, args)
+
+
+def main():
+    if len(sys.argv) < 2:
+        print("Usage: %s <qemu_binlog_file>.." % sys.argv[0])
+        return 1
+
+    for filename in sys.argv[1:]:
+        # records are grouped per ring on disk - restore global order
+        for timestamp, ring, msg in sorted(decode(filename), key=lambda rec: rec[0]):
+            sys.stdout.write("[%12.6f] [%d] %s" % (timestamp, ring, msg))
+            if not msg.endswith("\n"):
+                sys.stdout.write("\n")
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,711 @@
+/*
+ * Copyright 2020 Intel Corporation
+ * SPDX-License-Identifier: MIT
+ *
+ * Aggregate the edges of all kAFL traces in a traces/ folder (see kafl_cov.py).
+ *
+ * Trace files are LZ4 frames holding one JSON object per line. Worker
+ * threads decompress and scan them for {"edge": [src,dst] } lines, count
+ * the edges of each trace locally and merge them into a sharded hash table.
+ *
+ * Results are written to the traces/ folder:
+ *
+ *   edges_uniq.lst   unique edges, one "src,dst" per line
+ *   edges.csv        src;dst;hits;first_time;first_payload
+ *   edges.db         state for incremental runs
+ *
+ * The first-seen time of a payload is taken from traces/manifest.jsonl, or
+ * from the trace file mtime if the payload is not listed there. Traces
+ * recorded in edges.db with the same size and mtime are not read again.
+ *
+ * Build: cc -O2 -pthread -o edge_agg edge_agg.c -llz4
+ */
+
+#define _GNU_SOURCE
+#include <dirent.h>
+#include <errno.h>
+#include <getopt.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <lz4frame.h>
+
+#define EDGE_DB_MAGIC		0x4244454b	/* "KEDB" */
+#define EDGE_DB_VERSION		1
+
+#define SHARDS			64
+#define READ_SIZE		(1 << 20)
+#define OUT_SIZE		(4 << 20)
+
+static const char edge_token[] = "{\"edge\": [";
+
+typedef struct {
+	uint64_t src;
+	uint64_t dst;
+	uint64_t hits;			/* 0 marks an empty slot */
+	double first_time;
+	uint32_t first_trace;
+} __attribute__((packed)) edge_t;
+
+typedef struct {
+	edge_t* slots;
+	size_t num;
+	size_t cap;			/* power of 2 */
+	pthread_mutex_t lock;
+} edge_table_t;
+
+typedef struct {
+	char* name;
+	uint64_t size;
+	int64_t mtime;
+	double time;
+	bool done;			/* edges are in the table */
+} trace_t;
+
+typedef struct {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t num_traces;
+	uint64_t num_edges;
+} __attribute__((packed)) edge_db_header_t;
+
+/* followed by name_len bytes of the name */
+typedef struct {
+	uint64_t size;
+	int64_t mtime;
+	double time;
+	uint16_t name_len;
+} __attribute__((packed)) edge_db_trace_t;
+
+static edge_table_t shards[SHARDS];
+static trace_t* traces = NULL;
+static size_t num_traces = 0;
+static size_t traces_cap = 0;
+static const char* trace_dir = NULL;
+static size_t next_trace = 0;	/* work index, taken atomically */
+static size_t num_failed = 0;
+
+static void* xrealloc(void* ptr, size_t size) {
+	ptr = realloc(ptr, size);
+	if (!ptr) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	return ptr;
+}
+
+static uint64_t edge_hash(uint64_t src, uint64_t dst) {
+	uint64_t h = src * 0x9e3779b97f4a7c15ULL ^ (dst + 0x632be59bd9b4e019ULL + (src << 6) + (src >> 2));
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/* slot of (src, dst), empty if not in the table - does not grow */
+static edge_t* table_slot(edge_table_t* t, uint64_t src, uint64_t dst, uint64_t hash) {
+	size_t i = (hash >> 6) & (t->cap - 1);
+	while (t->slots[i].hits && (t->slots[i].src != src || t->slots[i].dst != dst)) {
+		i = (i + 1) & (t->cap - 1);
+	}
+	return &t->slots[i];
+}
+
+static void table_grow(edge_table_t* t) {
+	edge_t* old = t->slots;
+	size_t old_cap = t->cap;
+
+	t->cap = old_cap ? old_cap * 2 : 1024;
+	t->slots = calloc(t->cap, sizeof(edge_t));
+	if (!t->slots) {
+		fprintf(stderr, "Out of memory\n");
+		exit(1);
+	}
+	for (size_t i = 0; i < old_cap; i++) {
+		if (old[i].hits) {
+			*table_slot(t, old[i].src, old[i].dst, edge_hash(old[i].src, old[i].dst)) = old[i];
+		}
+	}
+	free(old);
+}
+
+/* merge an edge with its hits and first sighting, caller holds the lock */
+static void table_add(edge_table_t* t, const edge_t* e, uint64_t hash) {
+	edge_t* slot;
+
+	if (2 * (t->num + 1) > t->cap) {
+		table_grow(t);
+	}
+	slot = table_slot(t, e->src, e->dst, hash);
+	if (!slot->hits) {
+		*slot = *e;
+		t->num++;
+		return;
+	}
+	slot->hits += e->hits;
+	if (e->first_time < slot->first_time ||
+	    (e->first_time == slot->first_time && e->first_trace < slot->first_trace)) {
+		slot->first_time = e->first_time;
+		slot->first_trace = e->first_trace;
+	}
+}
+
+static void table_reset(edge_table_t* t) {
+	free(t->slots);
+	t->slots = NULL;
+	t->num = 0;
+	t->cap = 0;
+}
+
+static int trace_cmp(const void* a, const void* b) {
+	return strcmp(((const trace_t*)a)->name, ((const trace_t*)b)->name);
+}
+
+static trace_t* trace_find(const char* name) {
+	trace_t key = { .name = (char*)name };
+	return bsearch(&key, traces, num_traces, sizeof(trace_t), trace_cmp);
+}
+
+static trace_t* trace_add(const char* name) {
+	trace_t* t;
+	if (num_traces == traces_cap) {
+		traces_cap = traces_cap ? traces_cap * 2 : 1024;
+		traces = xrealloc(traces, traces_cap * sizeof(trace_t));
+	}
+	t = &traces[num_traces++];
+	memset(t, 0, sizeof(trace_t));
+	t->name = strdup(name);
+	return t;
+}
+
+/*
+ * Per-thread state: the edges of the current trace, deduplicated in a local
+ * table before they are merged into the shards.
+ */
+typedef struct {
+	edge_table_t local;
+	uint8_t* in;
+	uint8_t* out;
+	char* carry;			/* partial line from the previous chunk */
+	size_t carry_len;
+	size_t carry_cap;
+} worker_t;
+
+static bool parse_u64(const char** p, const char* end, char stop, uint64_t* value) {
+	const char* s = *p;
+	uint64_t v = 0;
+
+	if (s == end || *s < '0' || *s > '9') {
+		return false;
+	}
+	while (s < end && *s >= '0' && *s <= '9') {
+		v = v * 10 + (*s++ - '0');
+	}
+	if (s == end || *s != stop) {
+		return false;
+	}
+	*value = v;
+	*p = s + 1;
+	return true;
+}
+
+static void parse_line(worker_t* w, const char* line, const char* end, uint32_t trace_idx) {
+	const char* p;
+	uint64_t src, dst, hash;
+	edge_t* slot;
+
+	if (end - line < (ptrdiff_t)sizeof(edge_token) || memcmp(line, edge_token, sizeof(edge_token) - 1)) {
+		return;
+	}
+	p = line + sizeof(edge_token) - 1;
+	if (!parse_u64(&p, end, ',', &src) || !parse_u64(&p, end, ']', &dst)) {
+		return;
+	}
+
+	hash = edge_hash(src, dst);
+	if (2 * (w->local.num + 1) > w->local.cap) {
+		table_grow(&w->local);
+	}
+	slot = table_slot(&w->local, src, dst, hash);
+	if (slot->hits) {
+		slot->hits++;
+		return;
+	}
+	slot->src = src;
+	slot->dst = dst;
+	slot->hits = 1;
+	slot->first_time = traces[trace_idx].time;
+	slot->first_trace = trace_idx;
+	w->local.num++;
+}
+
+/* scan complete lines, keep a trailing partial line for the next chunk */
+static void parse_chunk(worker_t* w, const char* data, size_t size, uint32_t trace_idx) {
+	const char* end = data + size;
+	const char* nl;
+
+	if (w->carry_len) {
+		nl = memchr(data, '\n', size);
+		size_t len = nl ? (size_t)(nl - data) : size;
+		if (w->carry_len + len > w->carry_cap) {
+			w->carry_cap = w->carry_len + len;
+			w->carry = xrealloc(w->carry, w->carry_cap);
+		}
+		memcpy(w->carry + w->carry_len, data, len);
+		w->carry_len += len;
+		if (!nl) {
+			return;
+		}
+		parse_line(w, w->carry, w->carry + w->carry_len, trace_idx);
+		w->carry_len = 0;
+		data = nl + 1;
+	}
+
+	while (data < end && (nl = memchr(data, '\n', end - data))) {
+		parse_line(w, data, nl, trace_idx);
+		data = nl + 1;
+	}
+
+	if (data < end) {
+		if ((size_t)(end - data) > w->carry_cap) {
+			w->carry_cap = end - data;
+			w->carry = xrealloc(w->carry, w->carry_cap);
+		}
+		memcpy(w->carry, data, end - data);
+		w->carry_len = end - data;
+	}
+}
+
+static bool read_trace(worker_t* w, uint32_t trace_idx) {
+	LZ4F_decompressionContext_t ctx;
+	char* path;
+	FILE* f;
+	size_t ret = 1;
+	bool ok = true;
+
+	if (asprintf(&path, "%s/%s", trace_dir, traces[trace_idx].name) == -1) {
+		return false;
+	}
+	f = fopen(path, "rb");
+	if (!f) {
+		fprintf(stderr, "Could not open %s: %s\n", path, strerror(errno));
+		free(path);
+		return false;
+	}
+	if (LZ4F_isError(LZ4F_createDecompressionContext(&ctx, LZ4F_VERSION))) {
+		fclose(f);
+		free(path);
+		return false;
+	}
+
+	w->carry_len = 0;
+	while (ret) {
+		size_t in_len = fread(w->in, 1, READ_SIZE, f);
+		size_t pos = 0;
+		if (!in_len) {
+			break;
+		}
+		while (pos < in_len && ret) {
+			size_t out_len = OUT_SIZE;
+			size_t src_len = in_len - pos;
+			ret = LZ4F_decompress(ctx, w->out, &out_len, w->in + pos, &src_len, NULL);
+			if (LZ4F_isError(ret)) {
+				fprintf(stderr, "%s: %s\n", path, LZ4F_getErrorName(ret));
+				ok = false;
+				ret = 0;
+				break;
+			}
+			parse_chunk(w, (const char*)w->out, out_len, trace_idx);
+			pos += src_len;
+		}
+	}
+	if (ok && w->carry_len) {
+		parse_line(w, w->carry, w->carry + w->carry_len, trace_idx);
+	}
+
+	LZ4F_freeDecompressionContext(ctx);
+	fclose(f);
+	free(path);
+	return ok;
+}
+
+/* move the local edges into the shards, taking each shard lock once */
+static void merge_local(worker_t* w) {
+	edge_t* by_shard[SHARDS] = { NULL };
+	size_t count[SHARDS] = { 0 };
+
+	for (size_t i = 0; i < w->local.cap; i++) {
+		if (w->local.slots[i].hits) {
+			count[edge_hash(w->local.slots[i].src, w->local.slots[i].dst) % SHARDS]++;
+		}
+	}
+	for (int s = 0; s < SHARDS; s++) {
+		by_shard[s] = count[s] ? xrealloc(NULL, count[s] * sizeof(edge_t)) : NULL;
+		count[s] = 0;
+	}
+	for (size_t i = 0; i < w->local.cap; i++) {
+		edge_t* e = &w->local.slots[i];
+		if (e->hits) {
+			int s = edge_hash(e->src, e->dst) % SHARDS;
+			by_shard[s][count[s]++] = *e;
+		}
+	}
+
+	for (int s = 0; s < SHARDS; s++) {
+		if (!count[s]) {
+			continue;
+		}
+		pthread_mutex_lock(&shards[s].lock);
+		for (size_t i = 0; i < count[s]; i++) {
+			table_add(&shards[s], &by_shard[s][i], edge_hash(by_shard[s][i].src, by_shard[s][i].dst));
+		}
+		pthread_mutex_unlock(&shards[s].lock);
+		free(by_shard[s]);
+	}
+
+	memset(w->local.slots, 0, w->local.cap * sizeof(edge_t));
+	w->local.num = 0;
+}
+
+static void* worker_loop(void* arg) {
+	worker_t* w = arg;
+	size_t idx;
+
+	w->in = xrealloc(NULL, READ_SIZE);
+	w->out = xrealloc(NULL, OUT_SIZE);
+
+	while ((idx = __atomic_fetch_add(&next_trace, 1, __ATOMIC_RELAXED)) < num_traces) {
+		if (traces[idx].done) {
+			continue;
+		}
+		if (read_trace(w, idx)) {
+			merge_local(w);
+			traces[idx].done = true;
+		} else {
+			memset(w->local.slots, 0, w->local.cap * sizeof(edge_t));
+			w->local.num = 0;
+			__atomic_fetch_add(&num_failed, 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	free(w->in);
+	free(w->out);
+	free(w->carry);
+	table_reset(&w->local);
+	return NULL;
+}
+
+static void scan_traces(void) {
+	struct dirent* entry;
+	struct stat st;
+	DIR* dir = opendir(trace_dir);
+	char* path;
+
+	if (!dir) {
+		fprintf(stderr, "Could not open %s: %s\n", trace_dir, strerror(errno));
+		exit(1);
+	}
+	while ((entry = readdir(dir))) {
+		size_t len = strlen(entry->d_name);
+		if (len < 4 || strcmp(entry->d_name + len - 4, ".lz4")) {
+			continue;
+		}
+		if (asprintf(&path, "%s/%s", trace_dir, entry->d_name) == -1 || stat(path, &st)) {
+			continue;
+		}
+		free(path);
+		trace_t* t = trace_add(entry->d_name);
+		t->size = st.st_size;
+		t->mtime = st.st_mtime;
+		t->time = st.st_mtime;
+	}
+	closedir(dir);
+	qsort(traces, num_traces, sizeof(trace_t), trace_cmp);
+}
+
+/* first-seen times as recorded by kafl_cov */
+static void read_manifest(void) {
+	char* path;
+	char* line = NULL;
+	size_t line_cap = 0;
+	FILE* f;
+
+	if (asprintf(&path, "%s/manifest.jsonl", trace_dir) == -1) {
+		return;
+	}
+	f = fopen(path, "r");
+	free(path);
+	if (!f) {
+		return;
+	}
+	while (getline(&line, &line_cap, f) > 0) {
+		char* input = strstr(line, "\"input\": \"");
+		char* time = strstr(line, "\"time\": ");
+		char* name;
+		char* end;
+		char trace_name[NAME_MAX + 1];
+		trace_t* t;
+
+		if (!input || !time) {
+			continue;
+		}
+		input += strlen("\"input\": \"");
+		end = strchr(input, '"');
+		if (!end) {
+			continue;
+		}
+		*end = 0;
+		name = strrchr(input, '/');
+		name = name ? name + 1 : input;
+		if (snprintf(trace_name, sizeof(trace_name), "%s.lz4", name) >= (int)sizeof(trace_name)) {
+			continue;
+		}
+		if ((t = trace_find(trace_name))) {
+			t->time = strtod(time + strlen("\"time\": "), NULL);
+		}
+	}
+	free(line);
+	fclose(f);
+}
+
+/*
+ * Load a previous run. Its traces are marked done if unchanged. If any of
+ * them has changed or disappeared, the old counts cannot be corrected and
+ * everything is read again.
+ */
+static bool load_db(const char* path) {
+	edge_db_header_t header;
+	edge_db_trace_t record;
+	uint32_t* trace_map = NULL;
+	char name[NAME_MAX + 1];
+	edge_t e;
+	FILE* f = fopen(path, "rb");
+	bool ok = false;
+
+	if (!f) {
+		return false;
+	}
+	if (fread(&header, sizeof(header), 1, f) != 1 || header.magic != EDGE_DB_MAGIC || header.version != EDGE_DB_VERSION) {
+		fprintf(stderr, "%s: unknown format, rebuilding\n", path);
+		goto out;
+	}
+
+	trace_map = xrealloc(NULL, (header.num_traces + 1) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < header.num_traces; i++) {
+		trace_t* t;
+		if (fread(&record, sizeof(record), 1, f) != 1 || record.name_len > NAME_MAX ||
+		    fread(name, record.name_len, 1, f) != 1) {
+			fprintf(stderr, "%s: truncated, rebuilding\n", path);
+			goto out;
+		}
+		name[record.name_len] = 0;
+		t = trace_find(name);
+		if (!t || t->size != record.size || t->mtime != record.mtime) {
+			fprintf(stderr, "%s changed since the last run, rebuilding\n", name);
+			goto out;
+		}
+		t->done = true;
+		t->time = record.time;
+		trace_map[i] = t - traces;
+	}
+
+	for (uint64_t i = 0; i < header.num_edges; i++) {
+		if (fread(&e, sizeof(e), 1, f) != 1 || e.first_trace >= header.num_traces) {
+			fprintf(stderr, "%s: truncated, rebuilding\n", path);
+			goto out;
+		}
+		e.first_trace = trace_map[e.first_trace];
+		uint64_t hash = edge_hash(e.src, e.dst);
+		table_add(&shards[hash % SHARDS], &e, hash);
+	}
+	ok = true;
+
+out:
+	if (!ok) {
+		for (size_t i = 0; i < num_traces; i++) {
+			traces[i].done = false;
+		}
+		for (int s = 0; s < SHARDS; s++) {
+			table_reset(&shards[s]);
+		}
+	}
+	free(trace_map);
+	fclose(f);
+	return ok;
+}
+
+static int edge_cmp(const void* a, const void* b) {
+	const edge_t* x = a;
+	const edge_t* y = b;
+	if (x->src != y->src) {
+		return x->src < y->src ? -1 : 1;
+	}
+	if (x->dst != y->dst) {
+		return x->dst < y->dst ? -1 : 1;
+	}
+	return 0;
+}
+
+static FILE* open_tmp(const char* name, char** path, char** tmp_path) {
+	FILE* f;
+	if (asprintf(path, "%s/%s", trace_dir, name) == -1 || asprintf(tmp_path, "%s.tmp", *path) == -1) {
+		exit(1);
+	}
+	f = fopen(*tmp_path, "wb");
+	if (!f) {
+		fprintf(stderr, "Could not open %s: %s\n", *tmp_path, strerror(errno));
+		exit(1);
+	}
+	return f;
+}
+
+static void close_tmp(FILE* f, char* path, char* tmp_path) {
+	if (fclose(f) || rename(tmp_path, path)) {
+		fprintf(stderr, "Could not write %s: %s\n", path, strerror(errno));
+		exit(1);
+	}
+	free(path);
+	free(tmp_path);
+}
+
+static void write_results(void) {
+	edge_db_header_t header = { EDGE_DB_MAGIC, EDGE_DB_VERSION, 0, 0 };
+	uint32_t* trace_map = xrealloc(NULL, (num_traces + 1) * sizeof(uint32_t));
+	edge_t* edges;
+	size_t num = 0;
+	char *path, *tmp_path;
+	FILE *uniq, *csv, *db;
+
+	for (int s = 0; s < SHARDS; s++) {
+		header.num_edges += shards[s].num;
+	}
+	edges = xrealloc(NULL, (header.num_edges + 1) * sizeof(edge_t));
+	for (int s = 0; s < SHARDS; s++) {
+		for (size_t i = 0; i < shards[s].cap; i++) {
+			if (shards[s].slots[i].hits) {
+				edges[num++] = shards[s].slots[i];
+			}
+		}
+	}
+	qsort(edges, num, sizeof(edge_t), edge_cmp);
+
+	uniq = open_tmp("edges_uniq.lst", &path, &tmp_path);
+	for (size_t i = 0; i < num; i++) {
+		fprintf(uniq, "%lu,%lu\n", (unsigned long)edges[i].src, (unsigned long)edges[i].dst);
+	}
+	close_tmp(uniq, path, tmp_path);
+
+	csv = open_tmp("edges.csv", &path, &tmp_path);
+	for (size_t i = 0; i < num; i++) {
+		const char* name = traces[edges[i].first_trace].name;
+		fprintf(csv, "%lu;%lu;%lu;%.0f;%.*s\n", (unsigned long)edges[i].src, (unsigned long)edges[i].dst,
+			(unsigned long)edges[i].hits, edges[i].first_time, (int)strlen(name) - 4, name);
+	}
+	close_tmp(csv, path, tmp_path);
+
+	/* only traces that were read are recorded, failed ones are tried again next time */
+	db = open_tmp("edges.db", &path, &tmp_path);
+	for (size_t i = 0; i < num_traces; i++) {
+		header.num_traces += traces[i].done;
+	}
+	fwrite(&header, sizeof(header), 1, db);
+	for (size_t i = 0, j = 0; i < num_traces; i++) {
+		edge_db_trace_t record = { traces[i].size, traces[i].mtime, traces[i].time, strlen(traces[i].name) };
+		if (!traces[i].done) {
+			continue;
+		}
+		trace_map[i] = j++;
+		fwrite(&record, sizeof(record), 1, db);
+		fwrite(traces[i].name, record.name_len, 1, db);
+	}
+	for (size_t i = 0; i < num; i++) {
+		edges[i].first_trace = trace_map[edges[i].first_trace];
+		fwrite(&edges[i], sizeof(edge_t), 1, db);
+	}
+	close_tmp(db, path, tmp_path);
+
+	free(edges);
+	free(trace_map);
+}
+
+static void usage(const char* argv0) {
+	fprintf(stderr,
+		"Usage: %s [-j <threads>] [-f] <trace_dir>\n\n"
+		"  -j <n>  number of worker threads (default: number of CPUs)\n"
+		"  -f      ignore edges.db and read all traces again\n",
+		argv0);
+	exit(1);
+}
+
+int main(int argc, char** argv) {
+	long num_threads = sysconf(_SC_NPROCESSORS_ONLN);
+	bool force = false;
+	size_t todo = 0;
+	pthread_t* threads;
+	worker_t* workers;
+	char* db_path;
+	int opt;
+
+	while ((opt = getopt(argc, argv, "j:fh")) != -1) {
+		switch (opt) {
+			case 'j':
+				num_threads = strtol(optarg, NULL, 0);
+				break;
+			case 'f':
+				force = true;
+				break;
+			default:
+				usage(argv[0]);
+		}
+	}
+	if (optind != argc - 1 || num_threads < 1) {
+		usage(argv[0]);
+	}
+	trace_dir = argv[optind];
+
+	for (int s = 0; s < SHARDS; s++) {
+		pthread_mutex_init(&shards[s].lock, NULL);
+	}
+
+	scan_traces();
+	read_manifest();
+	if (asprintf(&db_path, "%s/edges.db", trace_dir) == -1) {
+		return 1;
+	}
+	if (!force && load_db(db_path)) {
+		printf("Loaded previous results from %s\n", db_path);
+	}
+	free(db_path);
+
+	for (size_t i = 0; i < num_traces; i++) {
+		todo += !traces[i].done;
+	}
+	printf("Reading %zu of %zu traces using %ld threads..\n", todo, num_traces, num_threads);
+
+	threads = xrealloc(NULL, num_threads * sizeof(pthread_t));
+	workers = calloc(num_threads, sizeof(worker_t));
+	for (long i = 0; i < num_threads; i++) {
+		pthread_create(&threads[i], NULL, worker_loop, &workers[i]);
+	}
+	for (long i = 0; i < num_threads; i++) {
+		pthread_join(threads[i], NULL);
+	}
+	free(threads);
+	free(workers);
+
+	write_results();
+
+	size_t num_edges = 0;
+	for (int s = 0; s < SHARDS; s++) {
+		num_edges += shards[s].num;
+	}
+	printf("%zu unique edges, %zu traces failed. Results stored in %s/edges_uniq.lst\n",
+	       num_edges, num_failed, trace_dir);
+	return num_failed ? 2 : 0;
+}
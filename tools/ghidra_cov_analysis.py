@@ -17,7 +17,7 @@
 # [...]
 #
 # Processing large amounts of traces can be quite slow.
-# Consider aggregating traces using sort -u.
+# Consider aggregating traces using tools/unique_edges.sh.
 #
 #@category Fuzzing
 #@author Steffen Schulz
@@ -4,13 +4,17 @@
 # SPDX-License-Identifier: MIT
 #
 
-# Given a workdir with per-payload trace files in traces/, grep and sort your
-# way through all the traces to obtain list of unique discovered edges.
+# Given a workdir with per-payload trace files in traces/, obtain the list of
+# unique discovered edges plus per-edge hit counts and first sighting.
+# The work is done by edge_agg (edge_agg.c), which is built on first use.
+# Repeated runs only read traces that were added since the last run.
 
 WORKDIR="$1"; shift
+TOOLDIR="$(dirname "$(realpath "$0")")"
+EDGE_AGG="$TOOLDIR/edge_agg"
 
 function usage() {
-	echo -e "Usage:\n\t$1 <workdir>\n"
+	echo -e "Usage:\n\t$1 <workdir> [edge_agg options]\n"
 	exit
 }
 
@@ -22,23 +26,9 @@ function fatal_exit() {
 test -d "$WORKDIR" || usage "$0"
 test -d "$WORKDIR/traces/" || fatal_exit "Could not find $WORKDIR/traces/"
 
-which lz4cat || fatal_exit "Could not find lz4cat tool."
-which mktemp || fatal_exit "Could not find mktemp tool."
+if [ ! -x "$EDGE_AGG" ] || [ "$TOOLDIR/edge_agg.c" -nt "$EDGE_AGG" ]; then
+	echo "Building $EDGE_AGG.."
+	cc -O2 -pthread -o "$EDGE_AGG" "$TOOLDIR/edge_agg.c" -llz4 || fatal_exit "Failed to build edge_agg, liblz4 headers missing?"
+fi
 
-TMPFILE=$(mktemp)
-OUTFILE="$WORKDIR/traces/edges_uniq.lst"
-
-pushd "$WORKDIR/traces/"
-
-# can be LOTS of traces, so do sort/uniq on individual files first..
-for trace in ./payload_*.lz4; do
-	echo "lz4cat $trace |grep edge|sort -u >> $TMPFILE"
-	lz4cat $trace|grep edge|sort -u >> $TMPFILE
-done
-
-echo -n "Sorting final output..."
-sort -u $TMPFILE |sed -e 's/.*\[//' -e 's/\].*//' > $OUTFILE
-rm $TMPFILE
-echo -e "done!\nResults stored in $OUTFILE"
-
-popd
+"$EDGE_AGG" "$@" "$WORKDIR/traces"